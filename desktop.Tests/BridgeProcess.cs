@@ -0,0 +1,301 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+using System.Net.Http;
+using System.Net.Sockets;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+public sealed record BridgeOptions {
+    // Defaults to the harness's bridge port
+    public int? Port { get; init; }
+
+    // The mocks' ports, the range probed for Discord; nothing else on the machine is touched.
+    // The first one also serves the token endpoint.
+    public required int[] RpcPorts { get; init; }
+
+    // websocket, ipc or auto
+    public string Transport { get; init; } = "websocket";
+
+    // Where discord-ipc-N sockets are looked for; an empty directory by default
+    public string? IpcDir { get; init; }
+
+    // XDG_CONFIG_HOME, where the token store lives; pass an earlier bridge's
+    // to start with its cached token. A fresh one by default.
+    public string? ConfigDir { get; init; }
+
+    // Another build of the bridge, e.g. a published app, run as `<command> --headless --port N`
+    public string[]? Command { get; init; }
+
+    public bool Headless { get; init; } = true;
+
+    public Dictionary<string, string> Environment { get; init; } = [];
+}
+
+// The bridge under test in its own process, run the way systemd runs it:
+// `--headless`, readiness reported over NOTIFY_SOCKET, SIGTERM to stop. By
+// default it is this executable, which compiles the bridge's sources and
+// starts HeadlessHost just like `Pebble Companion --headless` does.
+public sealed class BridgeProcess : IAsyncDisposable {
+    private static readonly HttpClient Http = new() { Timeout = TimeSpan.FromSeconds(10) };
+    private static readonly TimeSpan StartTimeout = TimeSpan.FromSeconds(30);
+    private static readonly TimeSpan StopTimeout = TimeSpan.FromSeconds(10);
+    private static int _started;
+
+    private readonly Process process;
+    private readonly StreamWriter log;
+    private readonly Lock logLock = new();
+    private bool logClosed;
+
+    public int Port { get; }
+    public int Pid => process.Id;
+    public string LogPath { get; }
+    public string ConfigDir { get; }
+
+    // Process start until READY=1; null for GUI builds, which don't report readiness
+    public TimeSpan? StartupTime { get; private set; }
+
+    // Stopwatch timestamp taken just before the process was started
+    public long StartedAt { get; private set; }
+
+    public bool HasExited => process.HasExited;
+
+    private BridgeProcess(Process process, int port, string logPath, string configDir) {
+        this.process = process;
+        Port = port;
+        LogPath = logPath;
+        ConfigDir = configDir;
+        log = new StreamWriter(logPath) { AutoFlush = true };
+    }
+
+    public static async Task<BridgeProcess> StartAsync(ScenarioContext context, BridgeOptions options) {
+        var instance = Interlocked.Increment(ref _started);
+        var port = options.Port ?? context.Config.BridgePort;
+        var home = Path.Combine(context.WorkDir, $"bridge-{instance}");
+        var ipcDir = options.IpcDir ?? Path.Combine(home, "ipc");
+        Directory.CreateDirectory(ipcDir);
+        // .NET ignores XDG_CONFIG_HOME unless the directory exists
+        var configDir = Directory.CreateDirectory(options.ConfigDir ?? Path.Combine(home, "config")).FullName;
+
+        var command = options.Command ?? SelfCommand();
+        var startInfo = new ProcessStartInfo(command[0]) {
+            RedirectStandardOutput = true,
+            RedirectStandardError = true,
+            UseShellExecute = false,
+        };
+        foreach (var argument in command.Skip(1)) {
+            startInfo.ArgumentList.Add(argument);
+        }
+
+        if (options.Headless) {
+            startInfo.ArgumentList.Add("--headless");
+        }
+
+        startInfo.ArgumentList.Add("--port");
+        startInfo.ArgumentList.Add(port.ToString(CultureInfo.InvariantCulture));
+
+        // Its own token store, so a developer's real Discord token is never touched
+        startInfo.Environment["XDG_CONFIG_HOME"] = configDir;
+        startInfo.Environment["PEBBLE_COMPANION_RPC_PORTS"] = $"{options.RpcPorts.Min()}-{options.RpcPorts.Max()}";
+        startInfo.Environment["PEBBLE_COMPANION_RPC_TRANSPORT"] = options.Transport;
+        startInfo.Environment["PEBBLE_COMPANION_IPC_DIR"] = ipcDir;
+        startInfo.Environment["PEBBLE_COMPANION_TOKEN_URL"] = $"http://127.0.0.1:{options.RpcPorts[0]}/token";
+        foreach (var (name, value) in options.Environment) {
+            startInfo.Environment[name] = value;
+        }
+
+        using var notify = new Socket(AddressFamily.Unix, SocketType.Dgram, ProtocolType.Unspecified);
+        var notifyPath = Path.Combine(home, "notify.sock");
+        notify.Bind(new UnixDomainSocketEndPoint(notifyPath));
+        startInfo.Environment["NOTIFY_SOCKET"] = notifyPath;
+
+        var started = Stopwatch.GetTimestamp();
+        var process = Process.Start(startInfo) ?? throw new ScenarioFailure($"Could not start {command[0]}");
+        var bridge = new BridgeProcess(process, port, Path.Combine(home, "bridge.log"), configDir) {
+            StartedAt = started,
+        };
+        process.OutputDataReceived += (_, e) => bridge.Append(e.Data);
+        process.ErrorDataReceived += (_, e) => bridge.Append(e.Data);
+        process.BeginOutputReadLine();
+        process.BeginErrorReadLine();
+
+        if (!options.Headless) {
+            await bridge.WaitForPortAsync(context);
+            return bridge;
+        }
+
+        try {
+            await bridge.WaitForReadyAsync(notify);
+        }
+        catch {
+            await bridge.DisposeAsync();
+            throw;
+        }
+
+        bridge.StartupTime = Stopwatch.GetElapsedTime(started);
+        context.Log($"Bridge {bridge.Pid} ready on port {port} after {bridge.StartupTime.Value.TotalMilliseconds:F0}ms");
+        return bridge;
+    }
+
+    // This executable again, through `dotnet` when that is how we were started
+    internal static string[] SelfCommand() {
+        var processPath = System.Environment.ProcessPath ?? throw new InvalidOperationException("No process path");
+        return Path.GetFileNameWithoutExtension(processPath) == "dotnet"
+            ? [processPath, typeof(BridgeProcess).Assembly.Location]
+            : [processPath];
+    }
+
+    private void Append(string? line) {
+        if (line == null) {
+            return;
+        }
+
+        lock (logLock) {
+            if (!logClosed) {
+                log.WriteLine(line);
+            }
+        }
+    }
+
+    private async Task WaitForReadyAsync(Socket notify) {
+        var buffer = new byte[256];
+        using var timeout = new CancellationTokenSource(StartTimeout);
+        var exited = process.WaitForExitAsync(timeout.Token);
+        while (true) {
+            var received = notify.ReceiveAsync(buffer, SocketFlags.None, timeout.Token).AsTask();
+            if (await Task.WhenAny(received, exited) == exited) {
+                throw new ScenarioFailure(process.HasExited
+                    ? $"Bridge exited with {process.ExitCode} before READY=1, see {LogPath}"
+                    : $"Bridge not ready after {StartTimeout.TotalSeconds}s, see {LogPath}");
+            }
+
+            int length;
+            try {
+                length = await received;
+            }
+            catch (OperationCanceledException) {
+                throw new ScenarioFailure($"Bridge not ready after {StartTimeout.TotalSeconds}s, see {LogPath}");
+            }
+
+            if (Encoding.UTF8.GetString(buffer, 0, length).Split('\n').Contains("READY=1")) {
+                return;
+            }
+        }
+    }
+
+    // The GUI build has no readiness notification; it's up once its server answers
+    private async Task WaitForPortAsync(ScenarioContext context) {
+        await context.WaitUntilAsync(async () => {
+            if (process.HasExited) {
+                throw new ScenarioFailure($"Bridge exited with {process.ExitCode}, see {LogPath}");
+            }
+
+            try {
+                using var response = await Http.GetAsync($"http://127.0.0.1:{Port}/");
+                return response.IsSuccessStatusCode;
+            }
+            catch (HttpRequestException) {
+                return false;
+            }
+        }, StartTimeout, $"the bridge on port {Port}");
+    }
+
+    // ---------------------- MEASUREMENTS ----------------------
+
+    // Resident set size from /proc, the same number `ps` and systemd show
+    public long RssBytes() {
+        foreach (var line in File.ReadLines($"/proc/{Pid}/status")) {
+            if (line.StartsWith("VmRSS:", StringComparison.Ordinal)) {
+                return long.Parse(line.Split(' ', StringSplitOptions.RemoveEmptyEntries)[1],
+                    CultureInfo.InvariantCulture) * 1024;
+            }
+        }
+
+        throw new InvalidDataException($"No VmRSS for process {Pid}");
+    }
+
+    public TimeSpan CpuTime() {
+        process.Refresh();
+        return process.TotalProcessorTime;
+    }
+
+    // /healthz: authenticated with Discord
+    public async Task<bool> IsHealthyAsync() {
+        using var response = await Http.GetAsync($"http://127.0.0.1:{Port}/healthz");
+        return response.IsSuccessStatusCode;
+    }
+
+    // The bridge's own /metrics, by series name including labels
+    public async Task<Dictionary<string, double>> ScrapeMetricsAsync() {
+        var text = await Http.GetStringAsync($"http://127.0.0.1:{Port}/metrics");
+        var metrics = new Dictionary<string, double>(StringComparer.Ordinal);
+        foreach (var line in text.Split('\n')) {
+            if (line.Length == 0 || line[0] == '#') {
+                continue;
+            }
+
+            var split = line.LastIndexOf(' ');
+            if (split > 0 && double.TryParse(line[(split + 1)..], NumberStyles.Float, CultureInfo.InvariantCulture,
+                    out var value)) {
+                metrics[line[..split]] = value;
+            }
+        }
+
+        return metrics;
+    }
+
+    // ---------------------- SHUTDOWN ----------------------
+
+    [DllImport("libc", SetLastError = true)]
+    private static extern int kill(int pid, int signal);
+
+    private const int SigTerm = 15;
+
+    // SIGTERM like `systemctl stop`; returns the exit code
+    public async Task<int> StopAsync() {
+        if (!process.HasExited) {
+            kill(Pid, SigTerm);
+            using var timeout = new CancellationTokenSource(StopTimeout);
+            try {
+                await process.WaitForExitAsync(timeout.Token);
+            }
+            catch (OperationCanceledException) {
+                process.Kill(entireProcessTree: true);
+                await process.WaitForExitAsync();
+                throw new ScenarioFailure($"Bridge ignored SIGTERM for {StopTimeout.TotalSeconds}s, see {LogPath}");
+            }
+        }
+
+        return process.ExitCode;
+    }
+
+    // Like Discord crashing under it: no shutdown at all
+    public async Task KillAsync() {
+        if (!process.HasExited) {
+            process.Kill(entireProcessTree: true);
+            await process.WaitForExitAsync();
+        }
+    }
+
+    public async ValueTask DisposeAsync() {
+        try {
+            await StopAsync();
+        }
+        catch (ScenarioFailure) {
+            // Already killed
+        }
+
+        process.Dispose();
+        lock (logLock) {
+            logClosed = true;
+            log.Dispose();
+        }
+    }
+}
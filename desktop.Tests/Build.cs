@@ -0,0 +1,29 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+namespace Pebble_Companion.Tests;
+
+// A build of the bridge to measure. "jit" is this harness, which compiles the
+// bridge's sources and runs them on the JIT; others are published apps given
+// with --builds, e.g. `--builds aot=publish/Pebble Companion,before=old/Pebble Companion`.
+public sealed record Build(string Name, string[]? Command) {
+    public static List<Build> FromOptions(ScenarioContext context) {
+        List<Build> builds = [new("jit", null)];
+        foreach (var entry in (context.Option("builds") ?? "").Split(',', StringSplitOptions.RemoveEmptyEntries)) {
+            var split = entry.IndexOf('=');
+            if (split <= 0) {
+                throw new ScenarioFailure($"--builds takes name=path pairs, got {entry}");
+            }
+
+            var path = Path.GetFullPath(entry[(split + 1)..]);
+            if (!File.Exists(path)) {
+                throw new ScenarioFailure($"No build at {path}");
+            }
+
+            builds.Add(new Build(entry[..split], [path]));
+        }
+
+        return builds;
+    }
+}
@@ -0,0 +1,102 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Frames sent for a bursty trace with different coalescing windows, 0 being
+// the old one-broadcast-per-event behaviour. The trace is a meeting filling
+// up and emptying in bursts, with the user muting and unmuting in the middle
+// of each; mute is timed too, since it must not wait for the window.
+public static class CoalesceScenario {
+    private const int Rounds = 3;
+    private const int Joins = 30;
+    private const int Leaves = 25;
+    private const int FinalUsers = 1 + Rounds * (Joins - Leaves);
+
+    // 30 joins in about a second, like the start of a meeting
+    private static readonly TimeSpan EventInterval = TimeSpan.FromMilliseconds(33);
+    private static readonly TimeSpan Pause = TimeSpan.FromSeconds(1);
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var windows = (context.Option("windows") ?? "0,50,100,150").Split(',').Select(int.Parse);
+        foreach (var window in windows) {
+            await RunWindowAsync(context, window);
+        }
+    }
+
+    private static async Task RunWindowAsync(ScenarioContext context, int window) {
+        var mock = context.StartMock();
+        mock.SetChannel(Stack.ChannelId, "General", [new MockUser("self", "Self")]);
+        var bridge = await context.StartBridgeAsync(new BridgeOptions {
+            RpcPorts = [mock.Port],
+            Environment = { ["PEBBLE_COMPANION_COALESCE_MS"] = window.ToString() },
+        });
+        await context.WaitUntilAsync(() => mock.IsSubscribed("VOICE_STATE_CREATE", Stack.ChannelId),
+            Stack.StepTimeout, "the bridge to subscribe to the channel");
+        var watch = await context.StartWatchAsync(bridge.Port);
+        await watch.WaitForStateAsync(Stack.StepTimeout);
+
+        var sentBefore = watch.Sent;
+        var broadcastsBefore = (await bridge.ScrapeMetricsAsync())["pebble_broadcasts_total"];
+        var mutes = new List<(long At, bool Mute)>();
+        var next = 0;
+        for (var round = 0; round < Rounds; round++) {
+            var joined = new List<string>();
+            for (var i = 0; i < Joins; i++) {
+                if (i == Joins / 2) {
+                    mutes.Add((Stopwatch.GetTimestamp(), true));
+                    await mock.SetVoiceSettingsAsync(mute: true, deaf: false);
+                }
+
+                var id = $"user-{next++}";
+                joined.Add(id);
+                await mock.AddUserAsync(new MockUser(id, id));
+                await Task.Delay(EventInterval);
+            }
+
+            await Task.Delay(Pause);
+            for (var i = 0; i < Leaves; i++) {
+                if (i == Leaves / 2) {
+                    mutes.Add((Stopwatch.GetTimestamp(), false));
+                    await mock.SetVoiceSettingsAsync(mute: false, deaf: false);
+                }
+
+                await mock.RemoveUserAsync(joined[i]);
+                await Task.Delay(EventInterval);
+            }
+
+            await Task.Delay(Pause);
+        }
+
+        await watch.WaitForDisplayAsync(display => (int?)display["VOICE_USER_COUNT"] == FinalUsers,
+            Stack.StepTimeout, $"the final count of {FinalUsers}");
+        // Anything still in flight would be counted against the next window
+        await Task.Delay(TimeSpan.FromMilliseconds(Math.Max(500, window * 2)));
+
+        var events = Rounds * (Joins + Leaves + 2);
+        var frames = watch.Sent - sentBefore;
+        var broadcasts = (await bridge.ScrapeMetricsAsync())["pebble_broadcasts_total"] - broadcastsBefore;
+        context.Report($"window_{window}ms_events", events);
+        context.Report($"window_{window}ms_watch_frames", frames);
+        context.Report($"window_{window}ms_broadcasts", broadcasts);
+
+        // Mute timed from the Discord event to the first frame showing it
+        var history = watch.History();
+        var muteLatencies = new List<double>();
+        foreach (var (at, mute) in mutes) {
+            var shown = history.FirstOrDefault(message => message.ReceivedAt >= at &&
+                                                          message.Int("MUTE_STATE") == (mute ? 1 : 0))
+                        ?? throw new ScenarioFailure($"The watch never showed MUTE_STATE {(mute ? 1 : 0)}");
+            muteLatencies.Add(Stopwatch.GetElapsedTime(at, shown.ReceivedAt).TotalMilliseconds);
+        }
+
+        context.Report($"window_{window}ms_mute", Summary.Of(muteLatencies));
+
+        await context.StopAsync(watch);
+        await context.StopAsync(bridge);
+        await context.StopAsync(mock);
+    }
+}
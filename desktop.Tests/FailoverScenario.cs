@@ -0,0 +1,69 @@
+using System;
+using System.Diagnostics;
+using System.Text.Json.Nodes;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Two Discord clients running side by side, like Stable and Canary on
+// neighbouring ports. The bridge holds a connection to both, the watch
+// follows whichever one is in a call (the latest to join if both are) and
+// its commands go there, and when the followed client exits the watch
+// switches to the other one straight away.
+public static class FailoverScenario {
+    // Switching is local, it shouldn't wait for a reconnect or a probe
+    private static readonly TimeSpan MaxFailover = TimeSpan.FromSeconds(1);
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var stable = context.StartMock();
+        var canary = context.StartMock(context.Config.RpcPort + 1);
+        canary.SetChannel("canary-call", "Canary Call", [new MockUser("self", "Self"), new MockUser("a", "A")]);
+        var bridge = await context.StartBridgeAsync(new BridgeOptions { RpcPorts = [stable.Port, canary.Port] });
+        await context.WaitUntilAsync(() => stable.AuthenticatedConnections == 1 && canary.AuthenticatedConnections == 1,
+            Stack.StepTimeout, "the bridge to connect to both clients");
+
+        // ---------------------- ONE CLIENT IN A CALL ----------------------
+        var watch = await context.StartWatchAsync(bridge.Port);
+        await watch.WaitForDisplayAsync(display => (string?)display["VOICE_CHANNEL_NAME"] == "#Canary Call" &&
+                                                   (int?)display["VOICE_USER_COUNT"] == 2,
+            Stack.StepTimeout, "the call on the client that is in one");
+        await MuteAsync(context, watch, canary, stable, true);
+
+        // ---------------------- BOTH IN A CALL ----------------------
+        await stable.JoinChannelAsync("stable-call", "Stable Call", [new MockUser("self", "Self")]);
+        await watch.WaitForDisplayAsync(display => (string?)display["VOICE_CHANNEL_NAME"] == "#Stable Call" &&
+                                                   (int?)display["VOICE_USER_COUNT"] == 1 &&
+                                                   (int?)display["MUTE_STATE"] == 0,
+            Stack.StepTimeout, "the call joined last");
+        await MuteAsync(context, watch, stable, canary, true);
+
+        // ---------------------- FOLLOWED CLIENT EXITS ----------------------
+        var stopped = Stopwatch.GetTimestamp();
+        stable.Stop();
+        await watch.WaitForDisplayAsync(display => (string?)display["VOICE_CHANNEL_NAME"] == "#Canary Call" &&
+                                                   (int?)display["VOICE_USER_COUNT"] == 2 &&
+                                                   (int?)display["MUTE_STATE"] == 1,
+            Stack.StepTimeout, "the remaining client's call");
+        var failover = Stopwatch.GetElapsedTime(stopped);
+        context.Report("failover_ms", failover.TotalMilliseconds);
+        context.Check(failover <= MaxFailover,
+            $"The watch should switch clients within {MaxFailover.TotalMilliseconds}ms, took {failover.TotalMilliseconds:F0}ms");
+        context.Check(await bridge.IsHealthyAsync(), "/healthz should stay ok while a client is left");
+
+        await MuteAsync(context, watch, canary, stable, false);
+    }
+
+    // A press on the watch has to reach the followed client and only that one
+    private static async Task MuteAsync(ScenarioContext context, WatchDriver watch, MockDiscord followed,
+        MockDiscord other, bool mute) {
+        followed.ResetCounts();
+        other.ResetCounts();
+        await watch.SendAsync(new JsonObject { ["SET_MUTE"] = mute ? 1 : 0 });
+        await context.WaitUntilAsync(() => followed.Mute == mute, Stack.StepTimeout,
+            $"the followed client on port {followed.Port} to {(mute ? "mute" : "unmute")}");
+        await watch.WaitForDisplayAsync(display => (int?)display["MUTE_STATE"] == (mute ? 1 : 0),
+            Stack.StepTimeout, $"MUTE_STATE {(mute ? 1 : 0)}");
+        context.Check(other.Count("SET_VOICE_SETTINGS") == 0,
+            $"The client on port {other.Port} isn't followed and shouldn't get the press");
+    }
+}
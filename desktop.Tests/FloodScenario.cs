@@ -0,0 +1,108 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Net.WebSockets;
+using System.Text;
+using System.Text.Json.Nodes;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// One LAN client sends "deafen" in a tight loop while a real watch keeps
+// pressing mute. The watch's presses must still go through promptly, and
+// Discord must never see more commands than the global limit lets through,
+// or it would rate-limit everyone.
+public static class FloodScenario {
+    // The bridge's global limit: a burst of 20, then 10 a second
+    private const int GlobalBurst = 20;
+    private const int GlobalPerSecond = 10;
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var config = context.Config.Flood;
+        var duration = TimeSpan.FromSeconds(context.Option("duration", config.DurationSeconds));
+        var (mock, bridge, watch) = await context.StartStackAsync();
+
+        var setVoiceSettings = 0;
+        mock.CommandReceived += (command, _) => {
+            if (command == "SET_VOICE_SETTINGS") {
+                Interlocked.Increment(ref setVoiceSettings);
+            }
+        };
+
+        using var flooding = new CancellationTokenSource(duration);
+        var flood = FloodAsync(bridge.Port, flooding.Token);
+
+        var presses = new List<double>();
+        var mute = mock.Mute;
+        var started = Stopwatch.GetTimestamp();
+        while (!flooding.IsCancellationRequested) {
+            mute = !mute;
+            var pressed = Stopwatch.GetTimestamp();
+            await watch.SendAsync(new JsonObject { ["SET_MUTE"] = mute ? 1 : 0 });
+            var shown = await watch.WaitForAsync(message => message.Int("MUTE_STATE") == (mute ? 1 : 0),
+                Stack.StepTimeout, "MUTE_STATE while another client floods");
+            presses.Add(Stopwatch.GetElapsedTime(pressed, shown.ReceivedAt).TotalMilliseconds);
+            await Task.Delay(config.PressIntervalMs);
+        }
+
+        var elapsed = Stopwatch.GetElapsedTime(started);
+        var flooded = await flood;
+        var metrics = await bridge.ScrapeMetricsAsync();
+
+        var press = Summary.Of(presses);
+        context.Report("press", press);
+        context.Report("flood_commands", flooded);
+        context.Report("discord_set_voice_settings", setVoiceSettings);
+        context.Report("throttled_coalesced", metrics["pebble_throttled_commands_total{action=\"coalesced\"}"]);
+        context.Report("throttled_dropped", metrics["pebble_throttled_commands_total{action=\"dropped\"}"]);
+
+        context.Check(flooded > GlobalBurst + GlobalPerSecond * elapsed.TotalSeconds,
+            $"The flood should exceed the global limit to test anything, sent only {flooded}");
+        // One second of slack for the tokens refilled while the flood wound down
+        var allowed = GlobalBurst + GlobalPerSecond * (elapsed.TotalSeconds + 1);
+        context.Check(setVoiceSettings <= allowed,
+            $"Discord should get at most {allowed:F0} commands, got {setVoiceSettings}");
+        context.Check(mock.Mute == mute, "Discord should end up with the watch's last mute state");
+        context.Check(press.P99 <= config.MaxPressP99Ms,
+            $"Watch presses p99 should be within {config.MaxPressP99Ms}ms during the flood, was {press.P99:F1}ms");
+    }
+
+    // A client that speaks the protocol but has a stuck button: as many
+    // toggles as the socket takes, reading whatever the bridge sends back.
+    // The bridge stops reading a throttled client, so sends end up waiting on
+    // a full socket; the flooder hangs up rather than wait for it to drain.
+    private static async Task<int> FloodAsync(int port, CancellationToken cancellationToken) {
+        using var socket = new ClientWebSocket();
+        await socket.ConnectAsync(new Uri($"ws://127.0.0.1:{port}/"), CancellationToken.None);
+        var drain = Task.Run(async () => {
+            var buffer = new byte[4096];
+            try {
+                while (socket.State == WebSocketState.Open) {
+                    await socket.ReceiveAsync(buffer, CancellationToken.None);
+                }
+            }
+            catch (Exception ex) when (ex is WebSocketException or OperationCanceledException) {
+                // Aborted below
+            }
+        }, CancellationToken.None);
+
+        var command = Encoding.UTF8.GetBytes("deafen");
+        var sent = 0;
+        try {
+            while (!cancellationToken.IsCancellationRequested) {
+                await socket.SendAsync(command, WebSocketMessageType.Text, true, cancellationToken);
+                sent++;
+                // Sends complete synchronously until the socket fills; don't hog the harness's own threads
+                await Task.Yield();
+            }
+        }
+        catch (OperationCanceledException) {
+            // Done flooding
+        }
+
+        socket.Abort();
+        await drain;
+        return sent;
+    }
+}
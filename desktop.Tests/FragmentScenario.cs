@@ -0,0 +1,148 @@
+using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+using System.Text.Json.Nodes;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Messages bigger than the watch's inbox, split into fragments by index.js:
+// fragments sent and bytes per second for each inbox size the watch may open
+// (the 256 byte fallback and the per-platform budgets), with channel names
+// long enough to need splitting. The driver acks every AppMessage after
+// --ack-ms, standing in for the Bluetooth round trip that makes small inboxes
+// slow; the ack time doesn't grow with the message, so the numbers are the
+// per-message cost and not the radio's byte rate. Fragments are reassembled
+// and decoded here the way the watch does it, so a bad split fails the run.
+public static class FragmentScenario {
+    // What index.js adds to each chunk: FRAG_ID, FRAG_INDEX and FRAG_COUNT as
+    // ints and FRAG_DATA's header, in a dictionary of four tuples
+    private const int FragmentOverhead = 1 + 4 * 7 + 3 * 4;
+
+    // The watch's reassembly buffer on everything but aplite
+    private const int ReassemblyBudget = 8192;
+
+    // The SDK numbers message keys in package.json order from here
+    private const int FirstMessageKey = 10000;
+
+    private const int TupleByteArray = 0;
+    private const int TupleCString = 1;
+    private const int TupleInt = 3;
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var ackMs = context.Option("ack-ms", 20);
+        var inboxes = (context.Option("inboxes") ?? "256,1024,2048,4096").Split(',').Select(int.Parse);
+        var sizes = (context.Option("sizes") ?? "500,2000,7000").Split(',').Select(int.Parse).ToList();
+        var keys = MessageKeys();
+
+        var mock = context.StartMock();
+        mock.SetChannel(Stack.ChannelId, "General", [new MockUser("self", "Self")]);
+        var bridge = await context.StartBridgeAsync(new BridgeOptions { RpcPorts = [mock.Port] });
+        await context.WaitUntilAsync(() => mock.IsSubscribed("VOICE_STATE_CREATE", Stack.ChannelId),
+            Stack.StepTimeout, "the bridge to subscribe to the channel");
+        var watch = await context.StartWatchAsync(bridge.Port, new WatchOptions { AckMs = ackMs });
+        await watch.WaitForStateAsync(Stack.StepTimeout);
+
+        var channels = 0;
+        foreach (var inbox in inboxes) {
+            await watch.SendAsync(new JsonObject { ["INBOX_SIZE"] = inbox });
+            // index.js reads stdin in order, but the bridge's messages come in on another path
+            await Task.Delay(TimeSpan.FromMilliseconds(100));
+
+            foreach (var size in sizes) {
+                var name = LongName(size);
+                var channelId = $"channel-long-{++channels}";
+                await mock.JoinChannelAsync(channelId, name, [new MockUser("self", "Self")]);
+
+                var fragments = new List<WatchMessage>();
+                var last = await watch.WaitForAsync(message => {
+                    if (!message.Has("FRAG_DATA")) {
+                        return (string?)message.Payload["VOICE_CHANNEL_NAME"] == "#" + name;
+                    }
+
+                    if (message.Int("FRAG_INDEX") == 0) {
+                        fragments.Clear();
+                    }
+
+                    fragments.Add(message);
+                    return message.Int("FRAG_INDEX") == message.Int("FRAG_COUNT") - 1;
+                }, Stack.StepTimeout, $"a {size} byte channel name");
+                if (!last.Has("FRAG_DATA")) {
+                    context.Log($"A {size} byte name fits a {inbox} byte inbox whole, not measured");
+                    continue;
+                }
+
+                var chunks = fragments.Select(fragment => ((JsonArray)fragment.Payload["FRAG_DATA"]!)
+                    .Select(value => (byte)(int)value!).ToArray()).ToList();
+                var message = chunks.SelectMany(chunk => chunk).ToArray();
+                var state = Decode(message, keys);
+
+                var metric = $"inbox_{inbox}_name_{size}";
+                context.Check(fragments.Count == fragments[0].Int("FRAG_COUNT"),
+                    $"{metric}: got {fragments.Count} of {fragments[0].Int("FRAG_COUNT")} fragments");
+                context.Check(chunks[0].Length == inbox - FragmentOverhead,
+                    $"{metric}: fragments should fill the inbox, the first carried {chunks[0].Length} bytes");
+                context.Check(fragments.Count * chunks[0].Length <= ReassemblyBudget,
+                    $"{metric}: {fragments.Count} fragments of {chunks[0].Length} bytes overflow the watch's buffer");
+                context.Check(state.GetValueOrDefault("VOICE_CHANNEL_NAME") as string == "#" + name,
+                    $"{metric}: the reassembled message should carry the channel name");
+
+                // From the first fragment going out until the last one is acked
+                var transferMs = fragments[^1].DriverMs - fragments[0].DriverMs + ackMs;
+                context.Report($"{metric}_bytes", message.Length);
+                context.Report($"{metric}_fragments", fragments.Count);
+                context.Report($"{metric}_transfer_ms", transferMs);
+                context.Report($"{metric}_bytes_per_second", message.Length / transferMs * 1000);
+            }
+        }
+    }
+
+    // Multi-byte characters, so a chunk boundary can fall inside one
+    private static string LongName(int bytes) {
+        var name = new StringBuilder();
+        while (Encoding.UTF8.GetByteCount(name.ToString()) + 7 <= bytes) {
+            name.Append("频道 ");
+        }
+
+        return name.Append('x', bytes - Encoding.UTF8.GetByteCount(name.ToString())).ToString();
+    }
+
+    private static string[] MessageKeys() {
+        var package = JsonNode.Parse(File.ReadAllText(Path.Combine(Harness.RepoRoot, "pebble-app", "package.json")));
+        return package!["pebble"]!["messageKeys"]!.AsArray().Select(key => (string)key!).ToArray();
+    }
+
+    // Pebble Dictionary layout: tuple count, then per tuple a little-endian
+    // uint32 key, a type byte, a uint16 length and the value
+    private static Dictionary<string, object> Decode(byte[] message, string[] keys) {
+        var tuples = new Dictionary<string, object>();
+        try {
+            var offset = 1;
+            for (var i = 0; i < message[0]; i++) {
+                var key = BinaryPrimitives.ReadUInt32LittleEndian(message.AsSpan(offset));
+                var type = message[offset + 4];
+                var length = BinaryPrimitives.ReadUInt16LittleEndian(message.AsSpan(offset + 5));
+                var value = message.AsSpan(offset + 7, length);
+                tuples[keys[key - FirstMessageKey]] = type switch {
+                    TupleCString => Encoding.UTF8.GetString(value[..^1]),
+                    TupleInt => BinaryPrimitives.ReadInt32LittleEndian(value),
+                    TupleByteArray => value.ToArray(),
+                    _ => throw new ScenarioFailure($"Unexpected tuple type {type} in a reassembled message"),
+                };
+                offset += 7 + length;
+            }
+
+            if (offset != message.Length) {
+                throw new ScenarioFailure($"{message.Length - offset} bytes left over after the last tuple");
+            }
+        }
+        catch (Exception ex) when (ex is ArgumentOutOfRangeException or IndexOutOfRangeException) {
+            throw new ScenarioFailure("A reassembled message ran past its end");
+        }
+
+        return tuples;
+    }
+}
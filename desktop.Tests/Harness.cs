@@ -0,0 +1,120 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Linq;
+using System.Text.Json;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Ci scenarios check thresholds and run on every push. Bench scenarios are
+// benchmarks that only report numbers for comparing builds. Nightly ones run
+// for hours and are only started by name.
+public enum Suite {
+    Ci,
+    Bench,
+    Nightly,
+}
+
+public sealed record Scenario(string Name, string Description, Suite Suite, Func<ScenarioContext, Task> RunAsync);
+
+public static class Harness {
+    public static readonly Scenario[] Scenarios = [
+        new("latency", "Watch command and Discord event round trips, event throughput", Suite.Ci,
+            LatencyScenario.RunAsync),
+        new("reconnect", "Discord restarting, cached token reuse and revocation", Suite.Ci,
+            ReconnectScenario.RunAsync),
+        new("flood", "One client flooding commands, a watch's presses still go through", Suite.Ci,
+            FloodScenario.RunAsync),
+        new("failover", "Two Discord clients, the watch following the one in a call", Suite.Ci,
+            FailoverScenario.RunAsync),
+        new("volume", "RPC calls made for holding a volume button on the watch", Suite.Ci, VolumeScenario.RunAsync),
+        new("resync", "Broadcasts dropped while Discord is gone, the watch catching up afterwards", Suite.Ci,
+            ResyncScenario.RunAsync),
+        new("ptt", "Push-to-talk press to unmute, against the toggle path and under load", Suite.Bench,
+            PttScenario.RunAsync),
+        new("startup", "Time to ready and connected, settled RSS, per build", Suite.Bench, StartupScenario.RunAsync),
+        new("idle", "RSS and CPU of an idle bridge, headless builds and the desktop app", Suite.Bench,
+            IdleScenario.RunAsync),
+        new("hosts", "Time to connected with stale addresses among the phone's candidates", Suite.Bench,
+            HostRaceScenario.RunAsync),
+        new("coalesce", "Frames sent for a bursty trace per coalescing window, mute latency meanwhile", Suite.Bench,
+            CoalesceScenario.RunAsync),
+        new("fragment", "Throughput of messages split into fragments, per watch inbox size", Suite.Bench,
+            FragmentScenario.RunAsync),
+        new("transport", "Connect time and round trips over Discord's WebSocket and IPC transports", Suite.Bench,
+            TransportScenario.RunAsync),
+        new("soak", "Hours of events and connection churn, failing on heap, handle or RSS growth", Suite.Nightly,
+            SoakScenario.RunAsync),
+    ];
+
+    // The checkout, found from the build output or else the working directory
+    public static string RepoRoot { get; } = FindRepoRoot();
+
+    private static string FindRepoRoot() {
+        foreach (var start in new[] { AppContext.BaseDirectory, Environment.CurrentDirectory }) {
+            for (var directory = new DirectoryInfo(start); directory != null; directory = directory.Parent) {
+                if (Directory.Exists(Path.Combine(directory.FullName, "pebble-app")) &&
+                    Directory.Exists(Path.Combine(directory.FullName, "desktop"))) {
+                    return directory.FullName;
+                }
+            }
+        }
+
+        throw new DirectoryNotFoundException("Run the harness from inside the repository");
+    }
+
+    // Runs the scenarios one after another and writes a result file for each.
+    // Returns false if any failed.
+    public static async Task<bool> RunAsync(IEnumerable<Scenario> scenarios, HarnessConfig config,
+        Dictionary<string, string> options, string resultsDir) {
+        Directory.CreateDirectory(resultsDir);
+        var results = new List<ScenarioResult>();
+        foreach (var scenario in scenarios) {
+            results.Add(await RunAsync(scenario, config, options, resultsDir));
+            var path = Path.Combine(resultsDir, $"{scenario.Name}.json");
+            await File.WriteAllTextAsync(path,
+                JsonSerializer.Serialize(results[^1], HarnessJsonContext.Default.ScenarioResult));
+        }
+
+        Console.WriteLine();
+        foreach (var result in results) {
+            Console.WriteLine($"{(result.Passed ? "PASS" : "FAIL")} {result.Scenario} ({result.DurationSeconds:F1}s)" +
+                              (result.Failure != null ? $": {result.Failure}" : ""));
+        }
+
+        Console.WriteLine($"Results in {Path.GetFullPath(resultsDir)}");
+        return results.All(result => result.Passed);
+    }
+
+    private static async Task<ScenarioResult> RunAsync(Scenario scenario, HarnessConfig config,
+        Dictionary<string, string> options, string resultsDir) {
+        var started = Stopwatch.GetTimestamp();
+        var context = new ScenarioContext(scenario.Name, config, options, resultsDir);
+        context.Log(scenario.Description);
+        string? failure = null;
+        try {
+            await using (context) {
+                await scenario.RunAsync(context);
+            }
+        }
+        catch (ScenarioFailure ex) {
+            failure = ex.Message;
+        }
+        catch (Exception ex) {
+            failure = ex.ToString();
+        }
+
+        if (failure == null) {
+            Directory.Delete(context.WorkDir, recursive: true);
+        }
+        else {
+            context.Log($"FAILED: {failure}");
+            context.Log($"Logs kept in {context.WorkDir}");
+        }
+
+        return new ScenarioResult(scenario.Name, failure == null, Stopwatch.GetElapsedTime(started).TotalSeconds,
+            failure, context.Metrics, context.Notes);
+    }
+}
@@ -0,0 +1,71 @@
+using System;
+using System.IO;
+using System.Text.Json;
+using System.Text.Json.Serialization;
+
+namespace Pebble_Companion.Tests;
+
+// harness.json: ports and the thresholds the gating scenarios check. The
+// defaults here are what an unconfigured run uses; CI runners are slower
+// than a desk machine, so the committed limits leave plenty of headroom.
+public sealed record HarnessConfig {
+    // Where the mock Discord listens, the real client's port by default
+    public int RpcPort { get; init; } = 6463;
+
+    // Where the bridge under test serves the watch; not 5983, so a companion
+    // already running on the machine doesn't get in the way
+    public int BridgePort { get; init; } = 15983;
+
+    public LatencyConfig Latency { get; init; } = new();
+    public FloodConfig Flood { get; init; } = new();
+    public SoakConfig Soak { get; init; } = new();
+
+    public static HarnessConfig Load(string path) {
+        using var file = File.OpenRead(path);
+        return JsonSerializer.Deserialize(file, HarnessJsonContext.Default.HarnessConfig)
+               ?? throw new InvalidDataException($"{path} is empty");
+    }
+}
+
+public sealed record LatencyConfig {
+    public int Warmup { get; init; } = 10;
+    public int Iterations { get; init; } = 100;
+
+    // Watch presses are paced below the per-client command rate limit, so the
+    // numbers are the pipeline's and not the throttle's
+    public int PressIntervalMs { get; init; } = 250;
+
+    public double MaxCommandP99Ms { get; init; } = 250;
+    public double MaxEventP99Ms { get; init; } = 250;
+
+    public int BurstEvents { get; init; } = 2000;
+    public double MinEventsPerSecond { get; init; } = 200;
+}
+
+public sealed record FloodConfig {
+    public int DurationSeconds { get; init; } = 10;
+
+    // A legitimate watch's presses while another client floods
+    public int PressIntervalMs { get; init; } = 500;
+    public double MaxPressP99Ms { get; init; } = 500;
+}
+
+public sealed record SoakConfig {
+    public double DurationMinutes { get; init; } = 120;
+
+    // Samples before this see JIT, tiering and pools filling up rather than leaks
+    public double WarmupMinutes { get; init; } = 5;
+    public int SampleIntervalSeconds { get; init; } = 30;
+
+    // Allowed growth between the first samples after warmup and the last ones
+    public double MaxHeapGrowthMb { get; init; } = 16;
+    public double MaxLohGrowthMb { get; init; } = 8;
+    public int MaxHandleGrowth { get; init; } = 32;
+    public double MaxRssGrowthMb { get; init; } = 48;
+}
+
+[JsonSourceGenerationOptions(PropertyNamingPolicy = JsonKnownNamingPolicy.CamelCase, WriteIndented = true,
+    ReadCommentHandling = JsonCommentHandling.Skip)]
+[JsonSerializable(typeof(HarnessConfig))]
+[JsonSerializable(typeof(ScenarioResult))]
+internal partial class HarnessJsonContext : JsonSerializerContext;
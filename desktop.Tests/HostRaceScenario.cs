@@ -0,0 +1,63 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Time from the phone app starting until the watch shows the call, when some
+// of the addresses it knows belong to networks the laptop is no longer on.
+// Those hang instead of failing, which is what used to leave the watch
+// retrying a dead address; the staggered race should only cost a stagger.
+public static class HostRaceScenario {
+    // Addresses in a private range the driver makes hang
+    private const string StaleWifi = "10.0.0.1";
+    private const string StaleEthernet = "10.0.0.2";
+
+    private static readonly (string Name, WatchOptions Options)[] Cases = [
+        ("direct", new WatchOptions()),
+        ("stale_first", new WatchOptions {
+            Host = $"{StaleWifi},127.0.0.1", Unreachable = [StaleWifi],
+        }),
+        ("two_stale_first", new WatchOptions {
+            Host = $"{StaleWifi},{StaleEthernet},127.0.0.1", Unreachable = [StaleWifi, StaleEthernet],
+        }),
+        // Only the address the server advertised on an earlier connection works
+        ("advertised", new WatchOptions {
+            Host = StaleWifi, Unreachable = [StaleWifi],
+            Storage = new Dictionary<string, string> { ["WS_ADVERTISED"] = "[\"127.0.0.1\"]" },
+        }),
+        // The last host that worked goes first, however long the list
+        ("remembered", new WatchOptions {
+            Host = $"{StaleWifi},{StaleEthernet},127.0.0.1", Unreachable = [StaleWifi, StaleEthernet],
+            Storage = new Dictionary<string, string> { ["WS_LAST_HOST"] = "127.0.0.1" },
+        }),
+    ];
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var runs = context.Option("runs", 10);
+        var mock = context.StartMock();
+        mock.SetChannel(Stack.ChannelId, "General", [new MockUser("self", "Self")]);
+        var bridge = await context.StartBridgeAsync(new BridgeOptions { RpcPorts = [mock.Port] });
+        await context.WaitUntilAsync(() => mock.AuthenticatedConnections == 1, Stack.StepTimeout,
+            "the bridge to authenticate");
+
+        foreach (var (name, options) in Cases) {
+            var connected = new List<double>();
+            // The first run of each case starts Node cold
+            for (var run = 0; run <= runs; run++) {
+                // index.js starts connecting on "ready", Node's own startup doesn't count
+                var watch = await context.StartWatchAsync(bridge.Port, options);
+                var started = Stopwatch.GetTimestamp();
+                var state = await watch.WaitForStateAsync(Stack.StepTimeout);
+                if (run > 0) {
+                    connected.Add(Stopwatch.GetElapsedTime(started, state.ReceivedAt).TotalMilliseconds);
+                }
+
+                await context.StopAsync(watch);
+            }
+
+            context.Report($"{name}_connected", Summary.Of(connected));
+        }
+    }
+}
@@ -0,0 +1,59 @@
+using System;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// What the bridge costs while nothing happens, which is most of the day: a
+// watch connected, the user sitting in a call. Each build runs headless;
+// with `--gui <published app>` the desktop app with its window and tray icon
+// is measured too (it needs a display, CI runs it under xvfb).
+public static class IdleScenario {
+    private static readonly TimeSpan Settle = TimeSpan.FromSeconds(3);
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var duration = context.Option("idle", TimeSpan.FromSeconds(60));
+        var mock = context.StartMock();
+        mock.SetChannel(Stack.ChannelId, "General", [new MockUser("self", "Self")]);
+
+        foreach (var build in Build.FromOptions(context)) {
+            await MeasureAsync(context, mock, build.Name, duration, new BridgeOptions {
+                RpcPorts = [mock.Port], Command = build.Command,
+            });
+        }
+
+        if (context.Option("gui") is not { } gui) {
+            return;
+        }
+
+        if (OperatingSystem.IsLinux() && Environment.GetEnvironmentVariable("DISPLAY") == null) {
+            context.Note("No DISPLAY, skipping the GUI build");
+            return;
+        }
+
+        // The desktop app always listens on the default port
+        await MeasureAsync(context, mock, "gui", duration, new BridgeOptions {
+            RpcPorts = [mock.Port], Command = [gui], Headless = false, Port = PebbleWSServer.DefaultPort,
+        });
+    }
+
+    private static async Task MeasureAsync(ScenarioContext context, MockDiscord mock, string name,
+        TimeSpan duration, BridgeOptions options) {
+        var bridge = await context.StartBridgeAsync(options);
+        await context.WaitUntilAsync(() => mock.AuthenticatedConnections == 1, Stack.StepTimeout,
+            $"{name} to authenticate");
+        var watch = await context.StartWatchAsync(bridge.Port);
+        await watch.WaitForStateAsync(Stack.StepTimeout);
+        await Task.Delay(Settle);
+
+        context.Log($"Idling {name} for {duration}");
+        var cpuBefore = bridge.CpuTime();
+        await Task.Delay(duration);
+        var cpu = bridge.CpuTime() - cpuBefore;
+
+        context.Report($"{name}_idle_rss_mb", bridge.RssBytes() / 1024.0 / 1024.0);
+        context.Report($"{name}_idle_cpu_percent", cpu / duration * 100);
+        await context.StopAsync(watch);
+        await context.StopAsync(bridge);
+        await context.WaitUntilAsync(() => mock.Connections == 0, Stack.StepTimeout, $"{name} to disconnect");
+    }
+}
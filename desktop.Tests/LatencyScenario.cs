@@ -0,0 +1,81 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Text.Json.Nodes;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// The whole path in both directions, watch to Discord and back:
+//
+//   command  a SET_MUTE press on the watch until MUTE_STATE comes back,
+//            through index.js, the bridge and the mock's SET_VOICE_SETTINGS
+//   event    a mute toggled in Discord until the watch shows it
+//   burst    users joining as fast as the mock can send, until the watch
+//            has the final count
+public static class LatencyScenario {
+    public static async Task RunAsync(ScenarioContext context) {
+        var config = context.Config.Latency;
+        var iterations = context.Option("iterations", config.Iterations);
+        var burstEvents = context.Option("burst", config.BurstEvents);
+        var (mock, _, watch) = await context.StartStackAsync();
+
+        // ---------------------- COMMAND ----------------------
+        var mute = mock.Mute;
+        var commands = new List<double>();
+        for (var i = 0; i < config.Warmup + iterations; i++) {
+            mute = !mute;
+            var pressed = Stopwatch.GetTimestamp();
+            await watch.SendAsync(new JsonObject { ["SET_MUTE"] = mute ? 1 : 0 });
+            var shown = await watch.WaitForAsync(message => message.Int("MUTE_STATE") == (mute ? 1 : 0),
+                Stack.StepTimeout, "MUTE_STATE after SET_MUTE");
+            if (i >= config.Warmup) {
+                commands.Add(Stopwatch.GetElapsedTime(pressed, shown.ReceivedAt).TotalMilliseconds);
+            }
+
+            await Task.Delay(config.PressIntervalMs);
+        }
+
+        var command = Summary.Of(commands);
+        context.Report("command", command);
+        context.Check(mock.Mute == mute, "Discord should end up with the mute state the watch last asked for");
+
+        // ---------------------- EVENT ----------------------
+        var events = new List<double>();
+        for (var i = 0; i < config.Warmup + iterations; i++) {
+            mute = !mute;
+            var changed = Stopwatch.GetTimestamp();
+            await mock.SetVoiceSettingsAsync(mute, false);
+            var shown = await watch.WaitForAsync(message => message.Int("MUTE_STATE") == (mute ? 1 : 0),
+                Stack.StepTimeout, "MUTE_STATE after a Discord mute");
+            if (i >= config.Warmup) {
+                events.Add(Stopwatch.GetElapsedTime(changed, shown.ReceivedAt).TotalMilliseconds);
+            }
+        }
+
+        var evt = Summary.Of(events);
+        context.Report("event", evt);
+
+        // ---------------------- BURST ----------------------
+        watch.Drain();
+        var sentBefore = watch.Sent;
+        var burstStarted = Stopwatch.GetTimestamp();
+        for (var i = 0; i < burstEvents; i++) {
+            await mock.AddUserAsync(new MockUser($"user-{i}", $"User {i}"));
+        }
+
+        await watch.WaitForAsync(message => message.Int("VOICE_USER_COUNT") == burstEvents + 1,
+            TimeSpan.FromSeconds(60), $"a user count of {burstEvents + 1}");
+        var burstSeconds = Stopwatch.GetElapsedTime(burstStarted).TotalSeconds;
+        var eventsPerSecond = burstEvents / burstSeconds;
+        context.Report("burst_events_per_second", eventsPerSecond);
+        context.Report("burst_watch_messages", watch.Sent - sentBefore);
+
+        context.Check(command.P99 <= config.MaxCommandP99Ms,
+            $"Command p99 should be within {config.MaxCommandP99Ms}ms, was {command.P99:F1}ms");
+        context.Check(evt.P99 <= config.MaxEventP99Ms,
+            $"Event p99 should be within {config.MaxEventP99Ms}ms, was {evt.P99:F1}ms");
+        context.Check(eventsPerSecond >= config.MinEventsPerSecond,
+            $"Events should reach {config.MinEventsPerSecond}/s, a burst of {burstEvents} ran at {eventsPerSecond:F0}/s");
+    }
+}
@@ -0,0 +1,692 @@
+using System;
+using System.Buffers.Binary;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Net;
+using System.Net.Sockets;
+using System.Net.WebSockets;
+using System.Text;
+using System.Text.Json.Nodes;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+public sealed record MockUser(string Id, string Name, int Volume = 100);
+
+// Stand-in for one Discord client: the RPC WebSocket on 127.0.0.1 (6463 like
+// the real one unless told otherwise), optionally its discord-ipc socket, and
+// the token endpoint the bridge exchanges AUTHORIZE codes at. It speaks as much
+// of the protocol as the bridge uses: READY, AUTHORIZE/AUTHENTICATE, SUBSCRIBE
+// and the voice commands. Tests script what the user does in Discord (join a
+// call, people coming and going, muting in the app) and the matching VOICE_*
+// events go to every connection subscribed to them.
+//
+// Stop and Start again to simulate Discord restarting; the voice state survives.
+public sealed class MockDiscord : IAsyncDisposable {
+    public const string AuthorizeCode = "mock-code";
+
+    private const int IpcHandshake = 0;
+    private const int IpcFrame = 1;
+    private const int IpcClose = 2;
+    private const int IpcPing = 3;
+    private const int IpcPong = 4;
+
+    private readonly Lock stateLock = new();
+    private readonly List<Session> sessions = [];
+    private readonly ConcurrentDictionary<string, int> commandCounts = new();
+    private HttpListener? listener;
+    private Socket? ipcListener;
+    private CancellationTokenSource? running;
+
+    private bool mute;
+    private bool deaf;
+    private MockChannel? channel;
+
+    private sealed class MockChannel(string id, string name, int type, string guildId, string guildName) {
+        public readonly string Id = id;
+        public readonly string Name = name;
+        public readonly int Type = type;
+        public readonly string GuildId = guildId;
+        public readonly string GuildName = guildName;
+        public readonly List<MockUser> Users = [];
+    }
+
+    public int Port { get; }
+
+    // discord-ipc-N path, null to serve only the WebSocket
+    public string? IpcPath { get; }
+
+    public string TokenUrl => $"http://127.0.0.1:{Port}/token";
+
+    // Added before every reply, for Discord's own processing time
+    public TimeSpan ResponseDelay { get; set; }
+
+    private int tokenGeneration = 1;
+
+    // What the token endpoint hands out now; RevokeTokens invalidates it
+    public string AccessToken => $"mock-access-token-{Volatile.Read(ref tokenGeneration)}";
+    public string RefreshToken => $"mock-refresh-token-{Volatile.Read(ref tokenGeneration)}";
+
+    public bool Mute {
+        get {
+            lock (stateLock) {
+                return mute;
+            }
+        }
+    }
+
+    // A user's volume in the current call, as SET_USER_VOICE_SETTINGS left it
+    public int? UserVolume(string userId) {
+        lock (stateLock) {
+            return channel?.Users.Find(user => user.Id == userId)?.Volume;
+        }
+    }
+
+    public int Connections {
+        get {
+            lock (stateLock) {
+                return sessions.Count;
+            }
+        }
+    }
+
+    public int AuthenticatedConnections {
+        get {
+            lock (stateLock) {
+                return sessions.Count(session => session.Authenticated);
+            }
+        }
+    }
+
+    private int tokenExchanges;
+
+    public int TokenExchanges => Volatile.Read(ref tokenExchanges);
+
+    // Raised on the connection's receive loop as each command arrives, with
+    // its args, before any ResponseDelay; handlers must be quick
+    public event Action<string, JsonObject?>? CommandReceived;
+
+    public MockDiscord(int port = 6463, string? ipcPath = null) {
+        Port = port;
+        IpcPath = ipcPath;
+    }
+
+    public void Start() {
+        running = new CancellationTokenSource();
+        listener = new HttpListener();
+        listener.Prefixes.Add($"http://127.0.0.1:{Port}/");
+        listener.Start();
+        _ = AcceptWebSocketsAsync(listener, running.Token);
+
+        if (IpcPath != null) {
+            File.Delete(IpcPath);
+            ipcListener = new Socket(AddressFamily.Unix, SocketType.Stream, ProtocolType.Unspecified);
+            ipcListener.Bind(new UnixDomainSocketEndPoint(IpcPath));
+            ipcListener.Listen(16);
+            _ = AcceptIpcAsync(ipcListener, running.Token);
+        }
+    }
+
+    // Like Discord exiting: the listeners go away and every connection drops
+    public void Stop() {
+        running?.Cancel();
+        listener?.Close();
+        listener = null;
+        ipcListener?.Dispose();
+        ipcListener = null;
+        if (IpcPath != null) {
+            File.Delete(IpcPath);
+        }
+
+        List<Session> dropped;
+        lock (stateLock) {
+            dropped = [..sessions];
+            sessions.Clear();
+        }
+
+        foreach (var session in dropped) {
+            session.Abort();
+        }
+    }
+
+    public ValueTask DisposeAsync() {
+        Stop();
+        return ValueTask.CompletedTask;
+    }
+
+    // Like the user deauthorizing the app: cached tokens stop working and the
+    // next exchange hands out new ones
+    public void RevokeTokens() {
+        Interlocked.Increment(ref tokenGeneration);
+    }
+
+    // Commands the bridge sent since the last reset, by name
+    public int Count(string command) => commandCounts.TryGetValue(command, out var count) ? count : 0;
+
+    public void ResetCounts() => commandCounts.Clear();
+
+    public bool IsSubscribed(string evt, string? channelId = null) {
+        var key = SubscriptionKey(evt, channelId);
+        lock (stateLock) {
+            return sessions.Any(session => session.Subscriptions.Contains(key));
+        }
+    }
+
+    // ---------------------- SCRIPTED EVENTS ----------------------
+
+    // Puts the user in a call before the bridge connects, without events
+    public void SetChannel(string id, string name, IEnumerable<MockUser> users, int type = 2,
+        string guildId = "mock-guild", string guildName = "Mock Guild") {
+        lock (stateLock) {
+            channel = new MockChannel(id, name, type, guildId, guildName);
+            channel.Users.AddRange(users);
+        }
+    }
+
+    public Task JoinChannelAsync(string id, string name, IEnumerable<MockUser> users, int type = 2,
+        string guildId = "mock-guild", string guildName = "Mock Guild") {
+        SetChannel(id, name, users, type, guildId, guildName);
+        return DispatchAsync("VOICE_CHANNEL_SELECT", null, new JsonObject {
+            ["channel_id"] = id,
+            ["guild_id"] = type == 2 ? guildId : null,
+        });
+    }
+
+    public Task LeaveChannelAsync() {
+        lock (stateLock) {
+            channel = null;
+        }
+
+        return DispatchAsync("VOICE_CHANNEL_SELECT", null, new JsonObject {
+            ["channel_id"] = null,
+            ["guild_id"] = null,
+        });
+    }
+
+    public Task AddUserAsync(MockUser user) {
+        string channelId;
+        lock (stateLock) {
+            channelId = RequireChannel().Id;
+            channel!.Users.Add(user);
+        }
+
+        return DispatchAsync("VOICE_STATE_CREATE", channelId, VoiceState(user));
+    }
+
+    public Task RemoveUserAsync(string userId) {
+        string channelId;
+        MockUser? user;
+        lock (stateLock) {
+            channelId = RequireChannel().Id;
+            user = channel!.Users.FirstOrDefault(candidate => candidate.Id == userId);
+            if (user == null) {
+                return Task.CompletedTask;
+            }
+
+            channel.Users.Remove(user);
+        }
+
+        return DispatchAsync("VOICE_STATE_DELETE", channelId, VoiceState(user));
+    }
+
+    // The user clicking mute or deafen in the Discord window
+    public Task SetVoiceSettingsAsync(bool mute, bool deaf) {
+        lock (stateLock) {
+            this.mute = mute;
+            this.deaf = deaf;
+        }
+
+        return DispatchAsync("VOICE_SETTINGS_UPDATE", null, VoiceSettings());
+    }
+
+    private MockChannel RequireChannel() {
+        return channel ?? throw new InvalidOperationException("The mock user is not in a voice channel");
+    }
+
+    private async Task DispatchAsync(string evt, string? channelId, JsonObject data) {
+        var key = SubscriptionKey(evt, channelId);
+        List<Session> subscribed;
+        lock (stateLock) {
+            subscribed = sessions.Where(session => session.Subscriptions.Contains(key)).ToList();
+        }
+
+        var message = Dispatch(evt, data);
+        foreach (var session in subscribed) {
+            await session.SendAsync(message);
+        }
+    }
+
+    // ---------------------- PROTOCOL ----------------------
+
+    private static string Dispatch(string evt, JsonNode? data) {
+        return new JsonObject {
+            ["cmd"] = "DISPATCH",
+            ["data"] = data,
+            ["evt"] = evt,
+            ["nonce"] = null,
+        }.ToJsonString();
+    }
+
+    private static string Reply(string command, string? nonce, JsonNode? data) {
+        return new JsonObject {
+            ["cmd"] = command,
+            ["data"] = data,
+            ["evt"] = null,
+            ["nonce"] = nonce,
+        }.ToJsonString();
+    }
+
+    private static string Error(string command, string? nonce, int code, string message) {
+        return new JsonObject {
+            ["cmd"] = command,
+            ["data"] = new JsonObject { ["code"] = code, ["message"] = message },
+            ["evt"] = "ERROR",
+            ["nonce"] = nonce,
+        }.ToJsonString();
+    }
+
+    private static string SubscriptionKey(string evt, string? channelId) {
+        return channelId == null ? evt : $"{evt}:{channelId}";
+    }
+
+    private static string Ready() {
+        return Dispatch("READY", new JsonObject {
+            ["v"] = 1,
+            ["config"] = new JsonObject { ["cdn_host"] = "cdn.discordapp.com", ["environment"] = "mock" },
+            ["user"] = new JsonObject { ["id"] = "0", ["username"] = "mock" },
+        });
+    }
+
+    private JsonObject VoiceSettings() {
+        lock (stateLock) {
+            return new JsonObject {
+                ["mute"] = mute,
+                ["deaf"] = deaf,
+                ["automatic_gain_control"] = true,
+                ["echo_cancellation"] = true,
+            };
+        }
+    }
+
+    private static JsonObject VoiceState(MockUser user) {
+        return new JsonObject {
+            ["nick"] = user.Name,
+            ["mute"] = false,
+            ["volume"] = user.Volume,
+            ["user"] = new JsonObject { ["id"] = user.Id, ["username"] = user.Name },
+        };
+    }
+
+    // Caller holds stateLock
+    private JsonObject ChannelJson(MockChannel current) {
+        var voiceStates = new JsonArray();
+        foreach (var user in current.Users) {
+            voiceStates.Add(VoiceState(user));
+        }
+
+        return new JsonObject {
+            ["id"] = current.Id,
+            ["name"] = current.Name,
+            ["type"] = current.Type,
+            ["guild_id"] = current.Type == 2 ? current.GuildId : null,
+            ["voice_states"] = voiceStates,
+        };
+    }
+
+    private async Task HandleAsync(Session session, string text) {
+        var request = JsonNode.Parse(text) as JsonObject;
+        var command = (string?)request?["cmd"] ?? string.Empty;
+        var nonce = (string?)request?["nonce"];
+        var args = request?["args"] as JsonObject;
+        commandCounts.AddOrUpdate(command, 1, (_, count) => count + 1);
+        CommandReceived?.Invoke(command, args);
+
+        if (ResponseDelay > TimeSpan.Zero) {
+            await Task.Delay(ResponseDelay);
+        }
+
+        if (!session.Authenticated && command is not ("AUTHORIZE" or "AUTHENTICATE")) {
+            await session.SendAsync(Error(command, nonce, 4006, "Not authenticated or invalid scope"));
+            return;
+        }
+
+        string? followUp = null;
+        string? followUpKey = null;
+        JsonNode? data;
+        lock (stateLock) {
+            switch (command) {
+                case "AUTHORIZE":
+                    data = new JsonObject { ["code"] = AuthorizeCode };
+                    break;
+                case "AUTHENTICATE":
+                    if ((string?)args?["access_token"] != AccessToken) {
+                        // Sent outside the lock below, like every other reply
+                        followUp = Error(command, nonce, 4009, "Invalid OAuth2 access token");
+                        data = null;
+                        break;
+                    }
+
+                    session.Authenticated = true;
+                    data = new JsonObject {
+                        ["access_token"] = AccessToken,
+                        ["user"] = new JsonObject { ["id"] = "0", ["username"] = "mock" },
+                    };
+                    break;
+                case "SUBSCRIBE":
+                case "UNSUBSCRIBE":
+                    var evt = (string?)request?["evt"] ?? string.Empty;
+                    var key = SubscriptionKey(evt, (string?)args?["channel_id"]);
+                    if (command == "SUBSCRIBE") {
+                        session.Subscriptions.Add(key);
+                    }
+                    else {
+                        session.Subscriptions.Remove(key);
+                    }
+
+                    data = new JsonObject { ["evt"] = evt };
+                    break;
+                case "GET_VOICE_SETTINGS":
+                    data = VoiceSettings();
+                    break;
+                case "SET_VOICE_SETTINGS":
+                    mute = (bool?)args?["mute"] ?? mute;
+                    deaf = (bool?)args?["deaf"] ?? deaf;
+                    data = VoiceSettings();
+                    // Discord tells every subscriber, including the connection that asked
+                    followUp = Dispatch("VOICE_SETTINGS_UPDATE", VoiceSettings());
+                    followUpKey = "VOICE_SETTINGS_UPDATE";
+                    break;
+                case "GET_SELECTED_VOICE_CHANNEL":
+                    data = channel == null ? null : ChannelJson(channel);
+                    break;
+                case "GET_CHANNEL":
+                    if (channel == null || channel.Id != (string?)args?["channel_id"]) {
+                        followUp = Error(command, nonce, 4005, "Invalid channel id");
+                        data = null;
+                        break;
+                    }
+
+                    data = ChannelJson(channel);
+                    break;
+                case "GET_GUILD":
+                    data = new JsonObject {
+                        ["id"] = (string?)args?["guild_id"],
+                        ["name"] = channel?.GuildName ?? "Mock Guild",
+                    };
+                    break;
+                case "SET_USER_VOICE_SETTINGS":
+                    var userId = (string?)args?["user_id"];
+                    var volume = (int?)args?["volume"] ?? 100;
+                    var index = channel?.Users.FindIndex(user => user.Id == userId) ?? -1;
+                    if (index >= 0) {
+                        channel!.Users[index] = channel.Users[index] with { Volume = volume };
+                    }
+
+                    data = new JsonObject { ["user_id"] = userId, ["volume"] = volume, ["mute"] = false };
+                    break;
+                case "SELECT_VOICE_CHANNEL":
+                    // Only leaving is supported, that's all the watch can ask for
+                    channel = null;
+                    data = null;
+                    followUp = Dispatch("VOICE_CHANNEL_SELECT",
+                        new JsonObject { ["channel_id"] = null, ["guild_id"] = null });
+                    followUpKey = "VOICE_CHANNEL_SELECT";
+                    break;
+                default:
+                    followUp = Error(command, nonce, 4000, $"Unknown command {command}");
+                    data = null;
+                    break;
+            }
+        }
+
+        if (followUp != null && followUpKey == null) {
+            await session.SendAsync(followUp);
+            return;
+        }
+
+        await session.SendAsync(Reply(command, nonce, data));
+        if (followUp != null) {
+            List<Session> subscribed;
+            lock (stateLock) {
+                subscribed = sessions.Where(other => other.Subscriptions.Contains(followUpKey!)).ToList();
+            }
+
+            foreach (var other in subscribed) {
+                await other.SendAsync(followUp);
+            }
+        }
+    }
+
+    private void Add(Session session) {
+        lock (stateLock) {
+            sessions.Add(session);
+        }
+    }
+
+    private void Remove(Session session) {
+        lock (stateLock) {
+            sessions.Remove(session);
+        }
+    }
+
+    // ---------------------- WEBSOCKET ----------------------
+
+    private async Task AcceptWebSocketsAsync(HttpListener httpListener, CancellationToken cancellationToken) {
+        while (!cancellationToken.IsCancellationRequested) {
+            HttpListenerContext context;
+            try {
+                context = await httpListener.GetContextAsync();
+            }
+            catch (Exception) when (cancellationToken.IsCancellationRequested) {
+                return;
+            }
+
+            _ = ServeHttpAsync(context);
+        }
+    }
+
+    private async Task ServeHttpAsync(HttpListenerContext context) {
+        try {
+            if (context.Request.Url?.AbsolutePath == "/token" && context.Request.HttpMethod == "POST") {
+                await ServeTokenAsync(context);
+                return;
+            }
+
+            if (!context.Request.IsWebSocketRequest) {
+                context.Response.StatusCode = 404;
+                context.Response.Close();
+                return;
+            }
+
+            var webSocket = (await context.AcceptWebSocketAsync(null)).WebSocket;
+            var session = new WebSocketSession(webSocket);
+            Add(session);
+            try {
+                await session.SendAsync(Ready());
+                var buffer = new byte[16 * 1024];
+                var message = new MemoryStream();
+                while (webSocket.State == WebSocketState.Open) {
+                    message.SetLength(0);
+                    WebSocketReceiveResult result;
+                    do {
+                        result = await webSocket.ReceiveAsync(new ArraySegment<byte>(buffer), CancellationToken.None);
+                        message.Write(buffer, 0, result.Count);
+                    } while (!result.EndOfMessage);
+
+                    if (result.MessageType == WebSocketMessageType.Close) {
+                        await session.CloseAsync();
+                        break;
+                    }
+
+                    await HandleAsync(session, Encoding.UTF8.GetString(message.GetBuffer(), 0, (int)message.Length));
+                }
+            }
+            finally {
+                Remove(session);
+                webSocket.Dispose();
+            }
+        }
+        catch (Exception ex) when (ex is WebSocketException or HttpListenerException or ObjectDisposedException
+                                       or IOException) {
+            // The bridge or Stop() dropped the connection
+        }
+    }
+
+    // What streamkit.discord.com does: trade the AUTHORIZE code for tokens
+    private async Task ServeTokenAsync(HttpListenerContext context) {
+        using var reader = new StreamReader(context.Request.InputStream, Encoding.UTF8);
+        var body = JsonNode.Parse(await reader.ReadToEndAsync()) as JsonObject;
+        string response;
+        if ((string?)body?["code"] == AuthorizeCode) {
+            Interlocked.Increment(ref tokenExchanges);
+            response = new JsonObject {
+                ["access_token"] = AccessToken,
+                ["refresh_token"] = RefreshToken,
+                ["token_type"] = "Bearer",
+                ["expires_in"] = 604800,
+            }.ToJsonString();
+        }
+        else {
+            context.Response.StatusCode = 400;
+            response = new JsonObject { ["error"] = "invalid_grant" }.ToJsonString();
+        }
+
+        var bytes = Encoding.UTF8.GetBytes(response);
+        context.Response.ContentType = "application/json";
+        await context.Response.OutputStream.WriteAsync(bytes);
+        context.Response.Close();
+    }
+
+    // ---------------------- IPC ----------------------
+
+    private async Task AcceptIpcAsync(Socket socket, CancellationToken cancellationToken) {
+        while (!cancellationToken.IsCancellationRequested) {
+            Socket client;
+            try {
+                client = await socket.AcceptAsync(cancellationToken);
+            }
+            catch (Exception) when (cancellationToken.IsCancellationRequested) {
+                return;
+            }
+            catch (ObjectDisposedException) {
+                return;
+            }
+
+            _ = ServeIpcAsync(client);
+        }
+    }
+
+    private async Task ServeIpcAsync(Socket client) {
+        var stream = new NetworkStream(client, ownsSocket: true);
+        var session = new IpcSession(stream);
+        try {
+            var handshake = await ReadIpcFrameAsync(stream);
+            if (handshake?.Opcode != IpcHandshake) {
+                return;
+            }
+
+            Add(session);
+            await session.SendAsync(Ready());
+            while (true) {
+                var frame = await ReadIpcFrameAsync(stream);
+                if (frame == null || frame.Value.Opcode == IpcClose) {
+                    break;
+                }
+
+                switch (frame.Value.Opcode) {
+                    case IpcPing:
+                        await session.PongAsync(frame.Value.Payload);
+                        break;
+                    case IpcFrame:
+                        await HandleAsync(session, frame.Value.Payload);
+                        break;
+                }
+            }
+        }
+        catch (Exception ex) when (ex is IOException or SocketException or ObjectDisposedException) {
+            // The bridge or Stop() dropped the connection
+        }
+        finally {
+            Remove(session);
+            await stream.DisposeAsync();
+        }
+    }
+
+    private static async Task<(int Opcode, string Payload)?> ReadIpcFrameAsync(Stream stream) {
+        var header = new byte[8];
+        try {
+            await stream.ReadExactlyAsync(header);
+        }
+        catch (EndOfStreamException) {
+            return null;
+        }
+
+        var payload = new byte[BinaryPrimitives.ReadInt32LittleEndian(header.AsSpan(4))];
+        await stream.ReadExactlyAsync(payload);
+        return (BinaryPrimitives.ReadInt32LittleEndian(header), Encoding.UTF8.GetString(payload));
+    }
+
+    // ---------------------- SESSIONS ----------------------
+
+    private abstract class Session {
+        private readonly SemaphoreSlim sendLock = new(1, 1);
+
+        // "EVT" or "EVT:channel id"; guarded by the mock's state lock
+        public readonly HashSet<string> Subscriptions = [];
+        public bool Authenticated;
+
+        public Task SendAsync(string message) => SendLockedAsync(() => SendCoreAsync(message));
+
+        // One write at a time, whoever it comes from
+        protected async Task SendLockedAsync(Func<Task> send) {
+            await sendLock.WaitAsync();
+            try {
+                await send();
+            }
+            catch (Exception ex) when (ex is WebSocketException or IOException or SocketException
+                                           or ObjectDisposedException) {
+                // Gone; the receive loop cleans up
+            }
+            finally {
+                sendLock.Release();
+            }
+        }
+
+        protected abstract Task SendCoreAsync(string message);
+
+        public abstract void Abort();
+    }
+
+    private sealed class WebSocketSession(WebSocket webSocket) : Session {
+        protected override Task SendCoreAsync(string message) {
+            return webSocket.SendAsync(Encoding.UTF8.GetBytes(message), WebSocketMessageType.Text, true,
+                CancellationToken.None);
+        }
+
+        public Task CloseAsync() {
+            return webSocket.CloseAsync(WebSocketCloseStatus.NormalClosure, null, CancellationToken.None);
+        }
+
+        public override void Abort() => webSocket.Abort();
+    }
+
+    private sealed class IpcSession(NetworkStream stream) : Session {
+        protected override Task SendCoreAsync(string message) => WriteAsync(IpcFrame, message);
+
+        public Task PongAsync(string payload) => SendLockedAsync(() => WriteAsync(IpcPong, payload));
+
+        private async Task WriteAsync(int opcode, string message) {
+            var payload = Encoding.UTF8.GetBytes(message);
+            var frame = new byte[8 + payload.Length];
+            BinaryPrimitives.WriteInt32LittleEndian(frame, opcode);
+            BinaryPrimitives.WriteInt32LittleEndian(frame.AsSpan(4), payload.Length);
+            payload.CopyTo(frame, 8);
+            await stream.WriteAsync(frame);
+        }
+
+        public override void Abort() => stream.Socket.Dispose();
+    }
+}
@@ -0,0 +1,83 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// End-to-end tests and benchmarks for the desktop bridge, against a mock
+// Discord and the phone's index.js. Needs Node 20.10 or later and Linux.
+//
+//   desktop.Tests ci                 every gating scenario
+//   desktop.Tests bench              every benchmark
+//   desktop.Tests <scenario>...      just these
+//   desktop.Tests list
+//
+// Options: --config <harness.json> --results <dir>, and --<name> <value> for
+// scenario settings, e.g. `soak --duration 00:10:00`. With --headless this is
+// the bridge itself, which the scenarios start as a child process.
+public static class Program {
+    public static async Task<int> Main(string[] args) {
+        if (Array.IndexOf(args, "--headless") >= 0) {
+            Capture.Configure(args);
+            return await HeadlessHost.RunAsync(args);
+        }
+
+        var names = args.TakeWhile(arg => !arg.StartsWith("--", StringComparison.Ordinal)).ToList();
+        var options = ParseOptions(args.Skip(names.Count).ToArray());
+        if (options == null || names.Count == 0) {
+            Console.Error.WriteLine("usage: desktop.Tests ci|bench|list|<scenario>... [--config <file>] " +
+                                    "[--results <dir>] [--<option> <value>]...");
+            return 2;
+        }
+
+        if (names is ["list"]) {
+            foreach (var scenario in Harness.Scenarios) {
+                var suite = scenario.Suite.ToString().ToLowerInvariant();
+                Console.WriteLine($"{scenario.Name,-14} {suite,-7} {scenario.Description}");
+            }
+
+            return 0;
+        }
+
+        List<Scenario> selected = [];
+        foreach (var name in names) {
+            switch (name) {
+                case "ci":
+                    selected.AddRange(Harness.Scenarios.Where(scenario => scenario.Suite == Suite.Ci));
+                    break;
+                case "bench":
+                    selected.AddRange(Harness.Scenarios.Where(scenario => scenario.Suite == Suite.Bench));
+                    break;
+                default:
+                    var scenario = Harness.Scenarios.FirstOrDefault(candidate => candidate.Name == name);
+                    if (scenario == null) {
+                        Console.Error.WriteLine($"Unknown scenario {name}, see `desktop.Tests list`");
+                        return 2;
+                    }
+
+                    selected.Add(scenario);
+                    break;
+            }
+        }
+
+        var configPath = options.GetValueOrDefault("config") ?? Path.Combine(AppContext.BaseDirectory, "harness.json");
+        var config = File.Exists(configPath) ? HarnessConfig.Load(configPath) : new HarnessConfig();
+        var resultsDir = options.GetValueOrDefault("results") ?? "TestResults";
+        return await Harness.RunAsync(selected.Distinct(), config, options, resultsDir) ? 0 : 1;
+    }
+
+    private static Dictionary<string, string>? ParseOptions(string[] args) {
+        var options = new Dictionary<string, string>(StringComparer.Ordinal);
+        for (var i = 0; i < args.Length; i += 2) {
+            if (!args[i].StartsWith("--", StringComparison.Ordinal) || i + 1 >= args.Length) {
+                return null;
+            }
+
+            options[args[i][2..]] = args[i + 1];
+        }
+
+        return options;
+    }
+}
@@ -0,0 +1,121 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Text.Json.Nodes;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Push-to-talk: how long from the watch's button edge until Discord is asked
+// to unmute (press) or mute (release), and until the watch shows it. The
+// toggle path is measured the same way for comparison, and presses are
+// repeated while Discord floods the bridge with voice events, which the
+// priority lane should not have to wait behind.
+public static class PttScenario {
+    private static readonly TimeSpan FloodInterval = TimeSpan.FromMilliseconds(5);
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var config = context.Config.Latency;
+        var iterations = context.Option("iterations", config.Iterations);
+        var (mock, _, watch) = await context.StartStackAsync();
+
+        var muteSet = new MuteSetWaiter(mock);
+        var seq = 0;
+
+        async Task<(double Discord, double Watch)> EdgeAsync(JsonObject payload, bool mute) {
+            var applied = muteSet.Next(mute);
+            var pressed = Stopwatch.GetTimestamp();
+            await watch.SendAsync(payload);
+            var atDiscord = await applied.WaitAsync(Stack.StepTimeout);
+            var shown = await watch.WaitForAsync(message => message.Int("MUTE_STATE") == (mute ? 1 : 0),
+                Stack.StepTimeout, $"MUTE_STATE {(mute ? 1 : 0)}");
+            return (Stopwatch.GetElapsedTime(pressed, atDiscord).TotalMilliseconds,
+                Stopwatch.GetElapsedTime(pressed, shown.ReceivedAt).TotalMilliseconds);
+        }
+
+        async Task MeasureAsync(string name, Func<bool, JsonObject> edge) {
+            var toDiscord = new List<double>();
+            var toWatch = new List<double>();
+            for (var i = 0; i < config.Warmup + iterations; i++) {
+                // Start muted, then press (unmute) and release (mute)
+                foreach (var mute in new[] { false, true }) {
+                    var (discord, shown) = await EdgeAsync(edge(mute), mute);
+                    if (i >= config.Warmup && !mute) {
+                        toDiscord.Add(discord);
+                        toWatch.Add(shown);
+                    }
+
+                    await Task.Delay(config.PressIntervalMs);
+                }
+            }
+
+            context.Report($"{name}_to_discord", Summary.Of(toDiscord));
+            context.Report($"{name}_to_watch", Summary.Of(toWatch));
+        }
+
+        if (!mock.Mute) {
+            await EdgeAsync(new JsonObject { ["SET_MUTE"] = 1 }, true);
+        }
+
+        await MeasureAsync("press", mute => new JsonObject { ["PTT_STATE"] = mute ? 0 : 1, ["PTT_SEQ"] = ++seq });
+        await MeasureAsync("toggle", _ => new JsonObject { ["TOGGLE_MUTE"] = 1 });
+
+        // The same presses while users pour into the call, at a pace Discord
+        // could plausibly send and the bridge keeps up with, so what's measured
+        // is the lane and not a backlog
+        using var flooding = new CancellationTokenSource();
+        var flooded = 0;
+        var floodStarted = Stopwatch.GetTimestamp();
+        var flood = Task.Run(async () => {
+            while (!flooding.IsCancellationRequested) {
+                await mock.AddUserAsync(new MockUser($"flood-{flooded}", $"Flood {flooded}"));
+                flooded++;
+                await Task.Delay(FloodInterval);
+            }
+        });
+        try {
+            await MeasureAsync("press_under_load",
+                mute => new JsonObject { ["PTT_STATE"] = mute ? 0 : 1, ["PTT_SEQ"] = ++seq });
+        }
+        finally {
+            flooding.Cancel();
+            await flood;
+        }
+
+        context.Report("load_events_per_second", flooded / Stopwatch.GetElapsedTime(floodStarted).TotalSeconds);
+
+        context.Check(mock.Mute, "Discord should be muted after the last release");
+    }
+
+    // Completes with the time the mock was asked to set a given mute state
+    private sealed class MuteSetWaiter {
+        private readonly Lock waiterLock = new();
+        private TaskCompletionSource<long>? pending;
+        private bool pendingMute;
+
+        public MuteSetWaiter(MockDiscord mock) {
+            mock.CommandReceived += (command, args) => {
+                var receivedAt = Stopwatch.GetTimestamp();
+                if (command != "SET_VOICE_SETTINGS" || args?["mute"] is not JsonValue mute) {
+                    return;
+                }
+
+                lock (waiterLock) {
+                    if (pending != null && (bool)mute == pendingMute) {
+                        pending.TrySetResult(receivedAt);
+                        pending = null;
+                    }
+                }
+            };
+        }
+
+        public Task<long> Next(bool mute) {
+            lock (waiterLock) {
+                pendingMute = mute;
+                pending = new TaskCompletionSource<long>(TaskCreationOptions.RunContinuationsAsynchronously);
+                return pending.Task;
+            }
+        }
+    }
+}
@@ -0,0 +1,89 @@
+using System;
+using System.Diagnostics;
+using System.IO;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Discord going away and coming back. The bridge has to notice, reconnect on
+// its own, authenticate with the token it cached instead of prompting again,
+// resubscribe, and bring the watch up to date with what changed meanwhile.
+// A second bridge started on the same config must skip the prompt as well,
+// and a revoked token has to fall back to authorizing again.
+public static class ReconnectScenario {
+    // Longer than the first few reconnect attempts, so backoff is exercised
+    private static readonly TimeSpan Downtime = TimeSpan.FromSeconds(3);
+
+    // The supervisor's backoff tops out at 30s
+    private static readonly TimeSpan ReconnectTimeout = TimeSpan.FromSeconds(45);
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var (mock, bridge, watch) = await context.StartStackAsync();
+        context.Check(mock.TokenExchanges == 1, "The first start should authorize and exchange one code");
+        context.Check(await bridge.IsHealthyAsync(), "/healthz should be ok while connected");
+
+        var tokenFile = Path.Combine(bridge.ConfigDir, "PebbleCompanion", "token.json");
+        context.Check(File.Exists(tokenFile), $"The token should be cached in {tokenFile}");
+        if (!OperatingSystem.IsWindows()) {
+            var mode = File.GetUnixFileMode(tokenFile);
+            context.Check(mode == (UnixFileMode.UserRead | UnixFileMode.UserWrite),
+                $"The token file should be private to the user, was {mode}");
+        }
+
+        // ---------------------- DISCORD RESTARTS ----------------------
+        mock.Stop();
+        await context.WaitUntilAsync(async () => !await bridge.IsHealthyAsync(), Stack.StepTimeout,
+            "/healthz to report the lost connection");
+
+        // What the user did while Discord was restarting
+        mock.SetChannel("channel-2", "Restarted",
+            [new MockUser("self", "Self"), new MockUser("a", "A"), new MockUser("b", "B")]);
+        await mock.SetVoiceSettingsAsync(mute: true, deaf: false);
+        await Task.Delay(Downtime);
+
+        mock.ResetCounts();
+        var restarted = Stopwatch.GetTimestamp();
+        mock.Start();
+        await context.WaitUntilAsync(() => mock.AuthenticatedConnections == 1, ReconnectTimeout,
+            "the bridge to reconnect");
+        context.Report("reconnect_ms", Stopwatch.GetElapsedTime(restarted).TotalMilliseconds);
+
+        context.Check(mock.Count("AUTHORIZE") == 0 && mock.TokenExchanges == 1,
+            "Reconnecting should reuse the cached token, not authorize again");
+        await context.WaitUntilAsync(() => mock.IsSubscribed("VOICE_SETTINGS_UPDATE") &&
+                                           mock.IsSubscribed("VOICE_CHANNEL_SELECT") &&
+                                           mock.IsSubscribed("VOICE_STATE_CREATE", "channel-2"),
+            Stack.StepTimeout, "the bridge to resubscribe");
+
+        await watch.WaitForDisplayAsync(display => (string?)display["VOICE_CHANNEL_NAME"] == "#Restarted" &&
+                                                   (int?)display["VOICE_USER_COUNT"] == 3 &&
+                                                   (int?)display["MUTE_STATE"] == 1,
+            Stack.StepTimeout, "the call and mute state changed while Discord was away");
+        context.Report("watch_updated_after_restart_ms", Stopwatch.GetElapsedTime(restarted).TotalMilliseconds);
+        context.Check(await bridge.IsHealthyAsync(), "/healthz should be ok again");
+
+        // ---------------------- BRIDGE RESTARTS ----------------------
+        await context.StopAsync(watch);
+        await context.StopAsync(bridge);
+        mock.ResetCounts();
+        bridge = await context.StartBridgeAsync(new BridgeOptions {
+            RpcPorts = [mock.Port], ConfigDir = bridge.ConfigDir,
+        });
+        await context.WaitUntilAsync(() => mock.AuthenticatedConnections == 1, Stack.StepTimeout,
+            "the restarted bridge to authenticate");
+        context.Check(mock.Count("AUTHORIZE") == 0 && mock.TokenExchanges == 1,
+            "A restarted bridge should authenticate with the cached token");
+
+        // ---------------------- TOKEN REVOKED ----------------------
+        await context.StopAsync(bridge);
+        mock.ResetCounts();
+        mock.RevokeTokens();
+        bridge = await context.StartBridgeAsync(new BridgeOptions {
+            RpcPorts = [mock.Port], ConfigDir = bridge.ConfigDir,
+        });
+        await context.WaitUntilAsync(() => mock.AuthenticatedConnections == 1, Stack.StepTimeout,
+            "the bridge to authenticate with a new token");
+        context.Check(mock.Count("AUTHORIZE") == 1, "A rejected token should send the bridge back to AUTHORIZE");
+        context.Check(mock.TokenExchanges == 2, "A rejected token should be replaced through one new exchange");
+    }
+}
@@ -0,0 +1,142 @@
+using System;
+using System.Net;
+using System.Net.Sockets;
+using System.Text;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// A client that asks for large participant pages and stops reading backs up
+// the bridge's broadcast queue until it drops the oldest broadcasts, among
+// them the flush of a pending channel update. Discord then exits before the
+// queue drains, so the resync that follows has no Discord state to send. The
+// watch must still learn that the call is gone, a watch connecting meanwhile
+// must not get the old channel, and once Discord is back channel updates must
+// reach the watch again.
+public static class ResyncScenario {
+    // The bridge's broadcast queue
+    private const int BroadcastCapacity = 64;
+    private const string DroppedMetric = "discord_pipeline_dropped_total{stage=\"Broadcast\"}";
+
+    // Enough participant pages with a long name in them to fill any socket buffer
+    private const int NameLength = 64 * 1024;
+    private const int PageRequests = 160;
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var (mock, bridge, watch) = await context.StartStackAsync();
+        var channel = (string?)watch.Display["VOICE_CHANNEL_NAME"];
+        await mock.AddUserAsync(new MockUser("long", new string('L', NameLength)));
+        await watch.WaitForDisplayAsync(display => (int?)display["VOICE_USER_COUNT"] == 2, Stack.StepTimeout,
+            "the user with the long name joining");
+
+        using var stalled = await StallAsync(bridge.Port);
+        await context.WaitUntilAsync(async () => (await bridge.ScrapeMetricsAsync())["pebble_connected_clients"] == 2,
+            Stack.StepTimeout, "the stalled client to be connected");
+
+        // The page replies hold the lock that sends take. Channel changes only
+        // need it for the flush, mute toggles skip the window and need it at once.
+        await Task.Delay(1000);
+        var mute = mock.Mute;
+        async Task ToggleAsync(int count) {
+            for (var i = 0; i < count; i++) {
+                mute = !mute;
+                await mock.SetVoiceSettingsAsync(mute, false);
+            }
+        }
+
+        // Opens a coalescing window, then the broadcaster is stuck on the
+        // first toggle and the flush is queued behind it
+        await mock.AddUserAsync(new MockUser("friend", "Friend"));
+        await ToggleAsync(16);
+        await Task.Delay(500);
+
+        // Everything queued so far is pushed out, the flush with it
+        var dropped = (await bridge.ScrapeMetricsAsync())[DroppedMetric];
+        var deadline = DateTime.UtcNow + Stack.StepTimeout;
+        while ((await bridge.ScrapeMetricsAsync())[DroppedMetric] < dropped + 2 * BroadcastCapacity) {
+            if (DateTime.UtcNow > deadline) {
+                throw new ScenarioFailure("Timed out waiting for the broadcast queue to drop the flush");
+            }
+
+            await ToggleAsync(16);
+        }
+
+        context.Report("broadcasts_dropped", (await bridge.ScrapeMetricsAsync())[DroppedMetric]);
+
+        mock.Stop();
+        await context.WaitUntilAsync(async () => !await bridge.IsHealthyAsync(), Stack.StepTimeout,
+            "the bridge to notice Discord is gone");
+
+        // The queue drains once the stalled client is gone, and the resync has no Discord to snapshot
+        stalled.Close(0);
+        await watch.WaitForDisplayAsync(display => (string?)display["VOICE_CHANNEL_NAME"] == "" &&
+                                                   (int?)display["VOICE_USER_COUNT"] == 0,
+            Stack.StepTimeout, "the call ending after the resync");
+
+        var late = await context.StartWatchAsync(bridge.Port);
+        await Task.Delay(500);
+        context.Check((string?)late.Display["VOICE_CHANNEL_NAME"] != channel,
+            $"A watch connecting while Discord is gone should not be shown {channel}");
+        await context.StopAsync(late);
+
+        mock.Start();
+        await watch.WaitForDisplayAsync(display => (string?)display["VOICE_CHANNEL_NAME"] == channel &&
+                                                   (int?)display["VOICE_USER_COUNT"] == 3,
+            Stack.StepTimeout, "the call after Discord restarted");
+
+        await mock.AddUserAsync(new MockUser("late", "Late"));
+        await watch.WaitForDisplayAsync(display => (int?)display["VOICE_USER_COUNT"] == 4,
+            Stack.StepTimeout, "the STATE_UPDATE for a user joining after the restart");
+    }
+
+    // Completes the WebSocket handshake and asks for participant pages, then
+    // never reads again
+    private static async Task<Socket> StallAsync(int port) {
+        var socket = new Socket(AddressFamily.InterNetwork, SocketType.Stream, ProtocolType.Tcp) {
+            ReceiveBufferSize = 1024,
+        };
+        await socket.ConnectAsync(IPAddress.Loopback, port);
+        var key = Convert.ToBase64String(Guid.NewGuid().ToByteArray());
+        await socket.SendAsync(Encoding.ASCII.GetBytes(
+            $"GET / HTTP/1.1\r\nHost: 127.0.0.1:{port}\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n" +
+            $"Sec-WebSocket-Key: {key}\r\nSec-WebSocket-Version: 13\r\n\r\n"));
+
+        var response = new StringBuilder();
+        var buffer = new byte[256];
+        while (!response.ToString().Contains("\r\n\r\n")) {
+            var read = await socket.ReceiveAsync(buffer);
+            if (read == 0) {
+                throw new ScenarioFailure("The bridge closed the stalled client's handshake");
+            }
+
+            response.Append(Encoding.ASCII.GetString(buffer, 0, read));
+        }
+
+        if (!response.ToString().StartsWith("HTTP/1.1 101")) {
+            socket.Dispose();
+            throw new ScenarioFailure($"The bridge refused the stalled client: {response}");
+        }
+
+        var request = Frame("{\"cmd\":\"getParticipants\",\"offset\":0,\"count\":8}");
+        for (var i = 0; i < PageRequests; i++) {
+            await socket.SendAsync(request);
+        }
+
+        return socket;
+    }
+
+    // A masked text frame, as clients have to send them; short payloads only
+    private static byte[] Frame(string text) {
+        var payload = Encoding.UTF8.GetBytes(text);
+        var mask = new byte[] { 0x12, 0x34, 0x56, 0x78 };
+        var frame = new byte[6 + payload.Length];
+        frame[0] = 0x81;
+        frame[1] = (byte)(0x80 | payload.Length);
+        mask.CopyTo(frame, 2);
+        for (var i = 0; i < payload.Length; i++) {
+            frame[6 + i] = (byte)(payload[i] ^ mask[i % 4]);
+        }
+
+        return frame;
+    }
+}
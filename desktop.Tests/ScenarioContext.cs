@@ -0,0 +1,161 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Linq;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// A check a scenario makes failed; the message says what was expected
+public sealed class ScenarioFailure(string message) : Exception(message);
+
+public sealed record ScenarioResult(string Scenario, bool Passed, double DurationSeconds, string? Failure,
+    SortedDictionary<string, double> Metrics, List<string> Notes);
+
+public sealed record Stack(MockDiscord Mock, BridgeProcess Bridge, WatchDriver Watch) {
+    public const string ChannelId = "channel-1";
+
+    // For any single step of a scenario, generous enough for slow CI runners
+    public static readonly TimeSpan StepTimeout = TimeSpan.FromSeconds(10);
+}
+
+// What a running scenario gets: the configuration, a scratch directory, and
+// helpers that start mocks, bridges and watches which are all torn down when
+// the scenario ends. Metrics reported here end up in the results file.
+public sealed class ScenarioContext : IAsyncDisposable {
+    private static readonly TimeSpan PollInterval = TimeSpan.FromMilliseconds(10);
+
+    private readonly List<IAsyncDisposable> resources = [];
+    private readonly Dictionary<string, string> options;
+
+    public string Name { get; }
+    public HarnessConfig Config { get; }
+
+    // Deleted afterwards unless the scenario failed, so its logs can be looked at
+    public string WorkDir { get; }
+
+    // Where the results file goes, for scenarios with more to keep than metrics
+    public string ResultsDir { get; }
+
+    public SortedDictionary<string, double> Metrics { get; } = new(StringComparer.Ordinal);
+    public List<string> Notes { get; } = [];
+
+    public ScenarioContext(string name, HarnessConfig config, Dictionary<string, string> options,
+        string resultsDir) {
+        Name = name;
+        Config = config;
+        this.options = options;
+        ResultsDir = resultsDir;
+        WorkDir = Path.Combine(Path.GetTempPath(), "pebble-companion-tests", $"{name}-{Environment.ProcessId}");
+        Directory.CreateDirectory(WorkDir);
+    }
+
+    // --name value from the command line, for overriding config in one run
+    public string? Option(string name) => options.GetValueOrDefault(name);
+
+    public TimeSpan Option(string name, TimeSpan fallback) {
+        return Option(name) is { } value ? TimeSpan.Parse(value) : fallback;
+    }
+
+    public int Option(string name, int fallback) {
+        return Option(name) is { } value ? int.Parse(value) : fallback;
+    }
+
+    public void Log(string message) {
+        Console.WriteLine($"[{Name}] {message}");
+    }
+
+    public void Report(string metric, double value) {
+        Metrics[metric] = value;
+        Log($"{metric} = {value:0.###}");
+    }
+
+    public void Report(string metric, Summary summary) {
+        Metrics[$"{metric}_p50_ms"] = summary.P50;
+        Metrics[$"{metric}_p99_ms"] = summary.P99;
+        Metrics[$"{metric}_max_ms"] = summary.Max;
+        Log($"{metric}: {summary}");
+    }
+
+    public void Note(string note) {
+        Notes.Add(note);
+        Log(note);
+    }
+
+    public void Check(bool condition, string expectation) {
+        if (!condition) {
+            throw new ScenarioFailure(expectation);
+        }
+    }
+
+    public Task WaitUntilAsync(Func<bool> condition, TimeSpan timeout, string what) {
+        return WaitUntilAsync(() => Task.FromResult(condition()), timeout, what);
+    }
+
+    public async Task WaitUntilAsync(Func<Task<bool>> condition, TimeSpan timeout, string what) {
+        var started = Stopwatch.GetTimestamp();
+        while (!await condition()) {
+            if (Stopwatch.GetElapsedTime(started) > timeout) {
+                throw new ScenarioFailure($"Timed out after {timeout.TotalSeconds}s waiting for {what}");
+            }
+
+            await Task.Delay(PollInterval);
+        }
+    }
+
+    // ---------------------- RESOURCES ----------------------
+
+    public MockDiscord StartMock(int? port = null, string? ipcPath = null) {
+        var mock = new MockDiscord(port ?? Config.RpcPort, ipcPath);
+        mock.Start();
+        resources.Add(mock);
+        return mock;
+    }
+
+    public async Task<BridgeProcess> StartBridgeAsync(BridgeOptions options) {
+        var bridge = await BridgeProcess.StartAsync(this, options);
+        resources.Add(bridge);
+        return bridge;
+    }
+
+    public async Task<WatchDriver> StartWatchAsync(int bridgePort, WatchOptions? options = null) {
+        var watch = await WatchDriver.StartAsync(this, bridgePort, options ?? new WatchOptions());
+        resources.Add(watch);
+        return watch;
+    }
+
+    // A mock with the user in a call, a bridge subscribed to it and a watch
+    // showing the call: where most scenarios start
+    public async Task<Stack> StartStackAsync(BridgeOptions? options = null) {
+        var mock = StartMock();
+        mock.SetChannel(Stack.ChannelId, "General", [new MockUser("self", "Self")]);
+        var bridge = await StartBridgeAsync(options ?? new BridgeOptions { RpcPorts = [mock.Port] });
+        await WaitUntilAsync(() => mock.IsSubscribed("VOICE_STATE_CREATE", Stack.ChannelId), Stack.StepTimeout,
+            "the bridge to subscribe to the channel");
+
+        var watch = await StartWatchAsync(bridge.Port);
+        await watch.WaitForStateAsync(Stack.StepTimeout);
+        return new Stack(mock, bridge, watch);
+    }
+
+    // Stops and forgets a resource before the scenario ends, e.g. to restart it
+    public async Task StopAsync(IAsyncDisposable resource) {
+        resources.Remove(resource);
+        await resource.DisposeAsync();
+    }
+
+    public async ValueTask DisposeAsync() {
+        // Watches first, then bridges, then mocks: the reverse of how they depend on each other
+        foreach (var resource in Enumerable.Reverse(resources)) {
+            try {
+                await resource.DisposeAsync();
+            }
+            catch (Exception ex) {
+                Log($"Cleanup failed: {ex.Message}");
+            }
+        }
+
+        resources.Clear();
+    }
+}
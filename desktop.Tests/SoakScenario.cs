@@ -0,0 +1,197 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+using System.Net.WebSockets;
+using System.Text;
+using System.Text.Json.Nodes;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Hours of a busy bridge, looking for leaks: Discord events (people joining
+// and leaving, channel switches, Discord restarting), a watch pressing mute,
+// and phones connecting and dropping off, half of them without closing. The
+// bridge's heap, LOH, handles and RSS are sampled throughout and the run fails
+// when any of them grew by more than harness.json allows. The heap is judged
+// by what survived the last GC: gen0 budgets run to tens of MB, so the total
+// mostly shows garbage. Samples go to soak-samples.csv next to the results,
+// for comparing releases.
+public static class SoakScenario {
+    private static readonly TimeSpan EventInterval = TimeSpan.FromMilliseconds(100);
+    private static readonly TimeSpan PressInterval = TimeSpan.FromSeconds(5);
+    private static readonly TimeSpan ChannelInterval = TimeSpan.FromMinutes(1);
+    private static readonly TimeSpan RestartInterval = TimeSpan.FromMinutes(10);
+    private static readonly TimeSpan ChurnInterval = TimeSpan.FromMilliseconds(500);
+    private static readonly TimeSpan ReconnectTimeout = TimeSpan.FromSeconds(45);
+    private const int MaxUsers = 30;
+
+    private sealed record Sample(double Seconds, double Heap, double Live, double Loh, double Handles, double Rss,
+        double Threads, double PebbleClients, double Collections);
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var config = context.Config.Soak;
+        var duration = context.Option("duration", TimeSpan.FromMinutes(config.DurationMinutes));
+        var sampleInterval = TimeSpan.FromSeconds(context.Option("sample-interval", config.SampleIntervalSeconds));
+        // Short runs still get samples after warmup and at least a few restarts
+        var warmup = TimeSpan.FromTicks(Math.Min(TimeSpan.FromMinutes(config.WarmupMinutes).Ticks, duration.Ticks / 4));
+        var restartInterval = TimeSpan.FromTicks(Math.Min(RestartInterval.Ticks, duration.Ticks / 3));
+
+        var (mock, bridge, watch) = await context.StartStackAsync();
+
+        using var churning = new CancellationTokenSource();
+        var churn = ChurnAsync(bridge.Port, churning.Token);
+
+        var samples = new List<Sample>();
+        var presses = new List<double>();
+        List<string> users = [];
+        var events = 0;
+        var channels = 1;
+        var restarts = 0;
+        var mute = mock.Mute;
+
+        var started = Stopwatch.GetTimestamp();
+        var nextPress = PressInterval;
+        var nextChannel = ChannelInterval;
+        var nextRestart = restartInterval;
+        var nextSample = TimeSpan.Zero;
+        while (Stopwatch.GetElapsedTime(started) is var elapsed && elapsed < duration) {
+            if (elapsed >= nextSample) {
+                nextSample += sampleInterval;
+                var metrics = await bridge.ScrapeMetricsAsync();
+                samples.Add(new Sample(elapsed.TotalSeconds, metrics["dotnet_gc_heap_bytes"],
+                    metrics["dotnet_gc_live_bytes"], metrics["dotnet_gc_loh_bytes"], metrics["process_open_handles"],
+                    metrics["process_resident_memory_bytes"], metrics["process_threads"],
+                    metrics["pebble_connected_clients"], metrics["dotnet_gc_collections_total{generation=\"0\"}"]));
+            }
+
+            if (elapsed >= nextRestart) {
+                nextRestart += restartInterval;
+                mock.Stop();
+                await Task.Delay(TimeSpan.FromSeconds(2));
+                mock.Start();
+                await context.WaitUntilAsync(() => mock.AuthenticatedConnections == 1, ReconnectTimeout,
+                    "the bridge to reconnect after Discord restarted");
+                restarts++;
+            }
+            else if (elapsed >= nextChannel) {
+                nextChannel += ChannelInterval;
+                users = [];
+                await mock.JoinChannelAsync($"channel-{++channels}", $"Channel {channels}",
+                    [new MockUser("self", "Self")]);
+            }
+            else if (elapsed >= nextPress) {
+                nextPress += PressInterval;
+                mute = !mute;
+                var pressed = Stopwatch.GetTimestamp();
+                await watch.SendAsync(new JsonObject { ["SET_MUTE"] = mute ? 1 : 0 });
+                var shown = await watch.WaitForAsync(message => message.Int("MUTE_STATE") == (mute ? 1 : 0),
+                    Stack.StepTimeout, $"MUTE_STATE {(mute ? 1 : 0)}");
+                presses.Add(Stopwatch.GetElapsedTime(pressed, shown.ReceivedAt).TotalMilliseconds);
+            }
+            else {
+                // The call fills up and empties again
+                var join = users.Count == 0 || (users.Count < MaxUsers && events / MaxUsers % 2 == 0);
+                if (join) {
+                    var id = $"user-{events}";
+                    users.Add(id);
+                    await mock.AddUserAsync(new MockUser(id, $"User {events}"));
+                }
+                else {
+                    await mock.RemoveUserAsync(users[^1]);
+                    users.RemoveAt(users.Count - 1);
+                }
+
+                events++;
+            }
+
+            await Task.Delay(EventInterval);
+        }
+
+        churning.Cancel();
+        var connections = await churn;
+        watch.Drain();
+
+        // Every churned phone is gone, only the watch is left
+        await context.WaitUntilAsync(async () => (await bridge.ScrapeMetricsAsync())["pebble_connected_clients"] == 1,
+            Stack.StepTimeout, "the churned connections to be cleaned up");
+
+        var csv = new StringBuilder(
+            "seconds,heap_bytes,live_bytes,loh_bytes,handles,rss_bytes,threads,pebble_clients,gc_collections\n");
+        foreach (var sample in samples) {
+            csv.AppendLine(string.Join(',', new[] {
+                sample.Seconds, sample.Heap, sample.Live, sample.Loh, sample.Handles, sample.Rss, sample.Threads,
+                sample.PebbleClients, sample.Collections,
+            }.Select(value => value.ToString("0.###", CultureInfo.InvariantCulture))));
+        }
+
+        var csvPath = Path.Combine(context.ResultsDir, $"{context.Name}-samples.csv");
+        await File.WriteAllTextAsync(csvPath, csv.ToString());
+        context.Note($"{samples.Count} samples in {csvPath}");
+
+        context.Report("discord_events", events);
+        context.Report("discord_restarts", restarts);
+        context.Report("channel_switches", channels - 1);
+        context.Report("pebble_connections", connections);
+        context.Report("press", Summary.Of(presses));
+
+        var measured = samples.Where(sample => sample.Seconds >= warmup.TotalSeconds).ToList();
+        context.Check(measured.Count >= 4,
+            $"Only {measured.Count} samples after warmup, run longer or sample more often");
+        context.Check(measured[^1].Collections > measured[0].Collections,
+            "No GC ran after warmup, so the heap can't be judged; run longer");
+
+        const double mb = 1024 * 1024;
+        CheckGrowth(context, measured, "live_bytes", sample => sample.Live, config.MaxHeapGrowthMb * mb);
+        CheckGrowth(context, measured, "loh_bytes", sample => sample.Loh, config.MaxLohGrowthMb * mb);
+        CheckGrowth(context, measured, "handles", sample => sample.Handles, config.MaxHandleGrowth);
+        CheckGrowth(context, measured, "rss_bytes", sample => sample.Rss, config.MaxRssGrowthMb * mb);
+    }
+
+    // Compares the lowest value of the first tenth of the samples with the
+    // lowest of the last tenth. The lows are what survived a GC, so garbage
+    // that is about to be collected doesn't count as growth.
+    private static void CheckGrowth(ScenarioContext context, List<Sample> samples, string name,
+        Func<Sample, double> value, double allowed) {
+        var window = Math.Max(2, samples.Count / 10);
+        var start = samples.Take(window).Min(value);
+        var end = samples.TakeLast(window).Min(value);
+        context.Report($"{name}_start", start);
+        context.Report($"{name}_end", end);
+        context.Report($"{name}_growth", end - start);
+        context.Check(end - start <= allowed,
+            $"{name} grew by {end - start:0} over the run, more than the {allowed:0} allowed");
+    }
+
+    // Phones opening the app and going away again: read the pushed snapshot,
+    // ask for participants, then close properly or just drop off
+    private static async Task<int> ChurnAsync(int port, CancellationToken cancellationToken) {
+        var request = Encoding.UTF8.GetBytes("{\"cmd\":\"getParticipants\",\"offset\":0,\"count\":8}");
+        var buffer = new byte[4096];
+        var connections = 0;
+        try {
+            while (!cancellationToken.IsCancellationRequested) {
+                using var socket = new ClientWebSocket();
+                await socket.ConnectAsync(new Uri($"ws://127.0.0.1:{port}/"), cancellationToken);
+                await socket.ReceiveAsync(buffer, cancellationToken);
+                await socket.SendAsync(request, WebSocketMessageType.Text, true, cancellationToken);
+                if (connections++ % 2 == 0) {
+                    await socket.CloseAsync(WebSocketCloseStatus.NormalClosure, null, cancellationToken);
+                }
+                else {
+                    socket.Abort();
+                }
+
+                await Task.Delay(ChurnInterval, cancellationToken);
+            }
+        }
+        catch (OperationCanceledException) {
+            // Done churning
+        }
+
+        return connections;
+    }
+}
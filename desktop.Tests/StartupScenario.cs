@@ -0,0 +1,57 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Linq;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Cold start of each build: process start until READY=1, until Discord has
+// accepted the cached token, and the resident set once it has settled. Run
+// with `--builds aot=<published app>` to compare the NativeAOT publish with
+// the JIT, or with an older build to see what a change did.
+public static class StartupScenario {
+    // Long enough for the first GC and tiered compilation to calm down
+    private static readonly TimeSpan Settle = TimeSpan.FromSeconds(3);
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var runs = context.Option("runs", 10);
+        var mock = context.StartMock();
+        mock.SetChannel(Stack.ChannelId, "General", [new MockUser("self", "Self")]);
+
+        // Shared by every run, so all but the very first start from a cached token
+        var configDir = Path.Combine(context.WorkDir, "config");
+
+        foreach (var build in Build.FromOptions(context)) {
+            var ready = new List<double>();
+            var connected = new List<double>();
+            var rss = new List<double>();
+            // The first run warms the page cache and caches the token
+            for (var run = 0; run <= runs; run++) {
+                var bridge = await context.StartBridgeAsync(new BridgeOptions {
+                    RpcPorts = [mock.Port], ConfigDir = configDir, Command = build.Command,
+                });
+                await context.WaitUntilAsync(() => mock.AuthenticatedConnections == 1, Stack.StepTimeout,
+                    $"{build.Name} to authenticate");
+                var connectedAt = Stopwatch.GetElapsedTime(bridge.StartedAt);
+                await Task.Delay(Settle);
+                if (run > 0) {
+                    ready.Add(bridge.StartupTime!.Value.TotalMilliseconds);
+                    connected.Add(connectedAt.TotalMilliseconds);
+                    rss.Add(bridge.RssBytes() / 1024.0 / 1024.0);
+                }
+
+                var exitCode = await bridge.StopAsync();
+                await context.StopAsync(bridge);
+                context.Check(exitCode == 0, $"{build.Name} should exit cleanly on SIGTERM, exited with {exitCode}");
+                await context.WaitUntilAsync(() => mock.Connections == 0, Stack.StepTimeout,
+                    $"{build.Name} to disconnect");
+            }
+
+            context.Report($"{build.Name}_ready", Summary.Of(ready));
+            context.Report($"{build.Name}_connected", Summary.Of(connected));
+            context.Report($"{build.Name}_rss_mb", rss.Order().ElementAt(rss.Count / 2));
+        }
+    }
+}
@@ -0,0 +1,28 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+
+namespace Pebble_Companion.Tests;
+
+// Latency samples in milliseconds, reduced to what the reports track
+public sealed record Summary(int Count, double P50, double P99, double Max, double Mean) {
+    public static Summary Of(IEnumerable<double> samples) {
+        var sorted = samples.Order().ToArray();
+        if (sorted.Length == 0) {
+            throw new ArgumentException("No samples", nameof(samples));
+        }
+
+        return new Summary(sorted.Length, Percentile(sorted, 0.50), Percentile(sorted, 0.99), sorted[^1],
+            sorted.Average());
+    }
+
+    // Nearest rank: the smallest sample with at least p of them at or below it
+    private static double Percentile(double[] sorted, double p) {
+        var rank = (int)Math.Ceiling(p * sorted.Length);
+        return sorted[Math.Clamp(rank - 1, 0, sorted.Length - 1)];
+    }
+
+    public override string ToString() {
+        return $"p50 {P50:F2}ms, p99 {P99:F2}ms, max {Max:F2}ms, mean {Mean:F2}ms over {Count}";
+    }
+}
@@ -0,0 +1,89 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Text;
+using System.Text.Json.Nodes;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Discord's two local transports side by side, the WebSocket RPC and the
+// discord-ipc socket: time from connecting until READY, and command round
+// trips once authenticated. Runs the bridge's own transport classes in
+// process against a mock serving both, so the numbers are the transports'
+// and not a process's startup or reconnect backoff.
+public static class TransportScenario {
+    private const int Warmup = 20;
+    private static readonly TimeSpan ConnectTimeout = TimeSpan.FromSeconds(2);
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var connects = context.Option("connects", 200);
+        var roundTrips = context.Option("round-trips", 2000);
+        var mock = context.StartMock(ipcPath: Path.Combine(context.WorkDir, "discord-ipc-0"));
+
+        var transports = new (string Name, Func<Task<IRpcTransport?>> Connect)[] {
+            ("websocket", () => WebSocketTransport.TryConnectAsync(mock.Port, ConnectTimeout, CancellationToken.None)),
+            ("ipc", () => IpcTransport.TryConnectAsync(mock.IpcPath!, ConnectTimeout, CancellationToken.None)),
+        };
+        foreach (var (name, connect) in transports) {
+            var connectTimes = new List<double>();
+            for (var i = 0; i < Warmup + connects; i++) {
+                var started = Stopwatch.GetTimestamp();
+                using var transport = await ConnectAsync(connect, name);
+                if (i >= Warmup) {
+                    connectTimes.Add(Stopwatch.GetElapsedTime(started).TotalMilliseconds);
+                }
+            }
+
+            var roundTripTimes = new List<double>();
+            using (var transport = await ConnectAsync(connect, name)) {
+                await RoundTripAsync(transport, "AUTHENTICATE", new JsonObject { ["access_token"] = mock.AccessToken });
+                for (var i = 0; i < Warmup + roundTrips; i++) {
+                    var started = Stopwatch.GetTimestamp();
+                    await RoundTripAsync(transport, "GET_VOICE_SETTINGS", new JsonObject());
+                    if (i >= Warmup) {
+                        roundTripTimes.Add(Stopwatch.GetElapsedTime(started).TotalMilliseconds);
+                    }
+                }
+            }
+
+            context.Report($"{name}_connect", Summary.Of(connectTimes));
+            context.Report($"{name}_round_trip", Summary.Of(roundTripTimes));
+        }
+    }
+
+    // Connected once Discord's READY has arrived, as the bridge counts it
+    private static async Task<IRpcTransport> ConnectAsync(Func<Task<IRpcTransport?>> connect, string name) {
+        var transport = await connect() ?? throw new ScenarioFailure($"Could not connect to the mock over {name}");
+        using var timeout = new CancellationTokenSource(Stack.StepTimeout);
+        var ready = JsonNode.Parse(await transport.ReceiveAsync(timeout.Token) ?? "{}");
+        if ((string?)ready?["evt"] != "READY") {
+            transport.Dispose();
+            throw new ScenarioFailure($"The mock's first message over {name} should be READY, was {ready}");
+        }
+
+        return transport;
+    }
+
+    private static async Task RoundTripAsync(IRpcTransport transport, string command, JsonObject args) {
+        var nonce = Guid.NewGuid().ToString("N");
+        var request = new JsonObject { ["cmd"] = command, ["args"] = args, ["nonce"] = nonce };
+        using var timeout = new CancellationTokenSource(Stack.StepTimeout);
+        await transport.SendAsync(Encoding.UTF8.GetBytes(request.ToJsonString()), timeout.Token);
+        while (true) {
+            var reply = JsonNode.Parse(await transport.ReceiveAsync(timeout.Token)
+                                       ?? throw new ScenarioFailure($"The mock hung up during {command}"));
+            if ((string?)reply?["nonce"] != nonce) {
+                continue;
+            }
+
+            if ((string?)reply["evt"] == "ERROR") {
+                throw new ScenarioFailure($"The mock rejected {command}: {reply["data"]}");
+            }
+
+            return;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+using System;
+using System.Linq;
+using System.Text.Json.Nodes;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// Turning a loud friend down by holding a button on the watch, then back up.
+// Holding repeats every 100ms with a growing step, and only a handful of
+// SET_USER_VOICE_SETTINGS calls may reach Discord for a whole hold. The
+// first hold sends every step, which leaves the batching to the bridge; the
+// second sends at the volume window's own interval.
+public static class VolumeScenario {
+    private const string FriendId = "loud";
+    private const string FriendName = "Loud Friend";
+
+    // The volume window's repeat and send intervals, and its steps: 1 for
+    // the first 5 repeats, 5 up to 15, then 10
+    private const int RepeatIntervalMs = 100;
+    private const int WatchSendIntervalMs = 400;
+    private const int MaxVolume = 200;
+
+    // The bridge sends the first value for a user at once, then the latest every 250ms
+    private const int BridgeSendIntervalMs = 250;
+
+    public static async Task RunAsync(ScenarioContext context) {
+        var holdMs = context.Option("hold-ms", 2000);
+        var (mock, _, watch) = await context.StartStackAsync();
+        await mock.AddUserAsync(new MockUser(FriendId, FriendName));
+        await watch.WaitForDisplayAsync(display => (int?)display["VOICE_USER_COUNT"] == 2, Stack.StepTimeout,
+            "the friend joining");
+
+        await watch.SendAsync(new JsonObject { ["PARTICIPANT_OFFSET"] = 0, ["PARTICIPANT_COUNT"] = 8 });
+        var page = await watch.WaitForAsync(message => message.Has("PARTICIPANT_NAMES") &&
+                                                       ((string)message.Payload["PARTICIPANT_NAMES"]!)
+                                                       .Split('\n').Contains(FriendName),
+            Stack.StepTimeout, "a participant page with the friend");
+        var row = Array.IndexOf(((string)page.Payload["PARTICIPANT_NAMES"]!).Split('\n'), FriendName) +
+                  page.Int("PARTICIPANT_OFFSET")!.Value;
+        var version = page.Int("PARTICIPANT_VERSION")!.Value;
+
+        foreach (var (name, sendIntervalMs, direction) in new[] {
+                     ("every_step", 0, -1), ("watch", WatchSendIntervalMs, 1),
+                 }) {
+            mock.ResetCounts();
+
+            var volume = mock.UserVolume(FriendId)!.Value;
+            var sent = 0;
+            var sentVolume = volume;
+            var lastSend = -WatchSendIntervalMs;
+
+            async Task SendAsync(int at) {
+                await watch.SendAsync(new JsonObject {
+                    ["PARTICIPANT_ROW"] = row, ["PARTICIPANT_VERSION"] = version, ["USER_VOLUME"] = volume,
+                });
+                sent++;
+                sentVolume = volume;
+                lastSend = at;
+            }
+
+            for (var repeat = 1; repeat * RepeatIntervalMs <= holdMs; repeat++) {
+                await Task.Delay(RepeatIntervalMs);
+                var step = repeat > 15 ? 10 : repeat > 5 ? 5 : 1;
+                volume = Math.Clamp(volume + direction * step, 0, MaxVolume);
+                var at = repeat * RepeatIntervalMs;
+                if (at - lastSend >= sendIntervalMs) {
+                    await SendAsync(at);
+                }
+            }
+
+            // Released: the window doesn't lose the last step
+            if (sentVolume != volume) {
+                await SendAsync(holdMs);
+            }
+
+            var final = volume;
+            await context.WaitUntilAsync(() => mock.UserVolume(FriendId) == final, Stack.StepTimeout,
+                $"Discord to get the friend's final volume of {final}");
+            // Anything the bridge still had batched would go out within an interval
+            await Task.Delay(2 * BridgeSendIntervalMs);
+
+            var calls = mock.Count("SET_USER_VOICE_SETTINGS");
+            context.Report($"{name}_watch_messages", sent);
+            context.Report($"{name}_rpc_calls", calls);
+
+            // The first value at once, one per interval during the hold, and the last one
+            var allowed = 2 + holdMs / BridgeSendIntervalMs;
+            context.Check(calls <= Math.Min(sent, allowed),
+                $"A {holdMs}ms hold sending {sent} messages should make at most " +
+                $"{Math.Min(sent, allowed)} RPC calls, made {calls}");
+            context.Check(mock.UserVolume(FriendId) == final, $"The volume should stay at {final}");
+        }
+    }
+}
@@ -0,0 +1,220 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Text.Json.Nodes;
+using System.Threading;
+using System.Threading.Channels;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion.Tests;
+
+// One AppMessage the phone sent to the watch. ReceivedAt is taken when the
+// line arrives, so a busy test loop doesn't add to measured latencies.
+public sealed record WatchMessage(long ReceivedAt, double DriverMs, JsonObject Payload) {
+    public int? Int(string key) => Payload[key] is JsonValue value ? (int)value : null;
+
+    public bool Has(string key) => Payload.ContainsKey(key);
+}
+
+public sealed record WatchOptions {
+    // WS_HOST as the settings page would save it, comma separated candidates
+    public string Host { get; init; } = "127.0.0.1";
+
+    // How long the watch takes to ack each AppMessage
+    public int AckMs { get; init; }
+
+    // Hosts whose connection attempts hang, like a network the laptop left
+    public string[] Unreachable { get; init; } = [];
+
+    // localStorage left over from earlier runs, e.g. WS_LAST_HOST
+    public Dictionary<string, string> Storage { get; init; } = [];
+}
+
+// The phone: pebble-app's index.js under Node through tools/pebble-driver,
+// connected to a bridge over a real WebSocket. Tests play the watch, sending
+// AppMessages in and reading what index.js sends back out.
+public sealed class WatchDriver : IAsyncDisposable {
+    private static readonly TimeSpan StartTimeout = TimeSpan.FromSeconds(15);
+
+    private readonly Process process;
+    private readonly Channel<WatchMessage> received = Channel.CreateUnbounded<WatchMessage>();
+    private readonly List<WatchMessage> history = [];
+    private readonly TaskCompletionSource ready = new(TaskCreationOptions.RunContinuationsAsynchronously);
+    private readonly StreamWriter log;
+    private bool logClosed;
+    private int sent;
+
+    // AppMessages index.js sent to the watch so far
+    public int Sent => Volatile.Read(ref sent);
+
+    // What the watch shows: every key of the messages read so far, latest value wins
+    public JsonObject Display { get; } = new();
+
+    private WatchDriver(Process process, string logPath) {
+        this.process = process;
+        log = new StreamWriter(logPath) { AutoFlush = true };
+    }
+
+    public static async Task<WatchDriver> StartAsync(ScenarioContext context, int bridgePort, WatchOptions options) {
+        var startInfo = new ProcessStartInfo("node") {
+            RedirectStandardInput = true,
+            RedirectStandardOutput = true,
+            RedirectStandardError = true,
+            UseShellExecute = false,
+        };
+        List<string> arguments = [
+            Path.Combine(Harness.RepoRoot, "tools", "pebble-driver", "driver.js"),
+            "--host", options.Host, "--port", bridgePort.ToString(), "--ack-ms", options.AckMs.ToString(), "--verbose",
+        ];
+        if (options.Unreachable.Length > 0) {
+            arguments.AddRange(["--unreachable", string.Join(',', options.Unreachable)]);
+        }
+
+        foreach (var (key, value) in options.Storage) {
+            arguments.AddRange(["--storage", $"{key}={value}"]);
+        }
+
+        foreach (var argument in arguments) {
+            startInfo.ArgumentList.Add(argument);
+        }
+
+        var process = Process.Start(startInfo) ?? throw new ScenarioFailure("Could not start node");
+        var watch = new WatchDriver(process, Path.Combine(context.WorkDir, $"watch-{process.Id}.log"));
+        process.OutputDataReceived += (_, e) => watch.OnLine(e.Data);
+        // index.js logging, only kept for looking into failures
+        process.ErrorDataReceived += (_, e) => {
+            lock (watch.log) {
+                if (e.Data != null && !watch.logClosed) {
+                    watch.log.WriteLine(e.Data);
+                }
+            }
+        };
+        process.BeginOutputReadLine();
+        process.BeginErrorReadLine();
+
+        if (await Task.WhenAny(watch.ready.Task, Task.Delay(StartTimeout)) != watch.ready.Task) {
+            await watch.DisposeAsync();
+            throw new ScenarioFailure("The Pebble driver did not start, is Node 20.10 or later installed?");
+        }
+
+        return watch;
+    }
+
+    private void OnLine(string? line) {
+        if (line == null) {
+            received.Writer.TryComplete();
+            return;
+        }
+
+        var receivedAt = Stopwatch.GetTimestamp();
+        if (JsonNode.Parse(line) is not JsonObject message) {
+            return;
+        }
+
+        switch ((string?)message["type"]) {
+            case "ready":
+                ready.TrySetResult();
+                break;
+            case "send":
+                Interlocked.Increment(ref sent);
+                var sentToWatch = new WatchMessage(receivedAt, (double)message["t"]!,
+                    (JsonObject)message["payload"]!.DeepClone());
+                lock (history) {
+                    history.Add(sentToWatch);
+                }
+
+                received.Writer.TryWrite(sentToWatch);
+                break;
+        }
+    }
+
+    // An AppMessage from the watch, e.g. { "SET_MUTE": 1 }
+    public Task SendAsync(JsonObject payload) {
+        return WriteAsync(new JsonObject { ["type"] = "appmessage", ["payload"] = payload });
+    }
+
+    // The next sends to the watch fail, like a watch out of range
+    public Task NackAsync(int count) {
+        return WriteAsync(new JsonObject { ["type"] = "nack", ["count"] = count });
+    }
+
+    private async Task WriteAsync(JsonObject message) {
+        await process.StandardInput.WriteLineAsync(message.ToJsonString());
+        await process.StandardInput.FlushAsync();
+    }
+
+    // Reads messages until one matches; the ones before it are skipped
+    public async Task<WatchMessage> WaitForAsync(Func<WatchMessage, bool> match, TimeSpan timeout, string what) {
+        using var cancel = new CancellationTokenSource(timeout);
+        try {
+            while (true) {
+                var message = await received.Reader.ReadAsync(cancel.Token);
+                Show(message);
+                if (match(message)) {
+                    return message;
+                }
+            }
+        }
+        catch (OperationCanceledException) {
+            throw new ScenarioFailure($"The watch got no {what} within {timeout.TotalSeconds}s");
+        }
+        catch (ChannelClosedException) {
+            throw new ScenarioFailure($"The Pebble driver exited while waiting for {what}");
+        }
+    }
+
+    // Reads messages until the display matches, however many it took to get there
+    public Task WaitForDisplayAsync(Func<JsonObject, bool> match, TimeSpan timeout, string what) {
+        return match(Display) ? Task.CompletedTask : WaitForAsync(_ => match(Display), timeout, what);
+    }
+
+    private void Show(WatchMessage message) {
+        foreach (var (key, value) in message.Payload) {
+            Display[key] = value?.DeepClone();
+        }
+    }
+
+    // The full state index.js sends once the bridge has pushed its snapshot
+    public Task<WatchMessage> WaitForStateAsync(TimeSpan timeout) {
+        return WaitForAsync(message => message.Has("MUTE_STATE") && message.Has("VOICE_CHANNEL_NAME"), timeout,
+            "state snapshot");
+    }
+
+    // Every message since the start, read or not
+    public List<WatchMessage> History() {
+        lock (history) {
+            return [..history];
+        }
+    }
+
+    // Everything received but not read yet
+    public List<WatchMessage> Drain() {
+        var messages = new List<WatchMessage>();
+        while (received.Reader.TryRead(out var message)) {
+            Show(message);
+            messages.Add(message);
+        }
+
+        return messages;
+    }
+
+    public async ValueTask DisposeAsync() {
+        if (!process.HasExited) {
+            // Closing stdin makes the driver unload index.js and exit
+            process.StandardInput.Close();
+            await Task.WhenAny(process.WaitForExitAsync(), Task.Delay(TimeSpan.FromSeconds(5)));
+            if (!process.HasExited) {
+                process.Kill(entireProcessTree: true);
+            }
+
+            await process.WaitForExitAsync();
+        }
+
+        process.Dispose();
+        lock (log) {
+            logClosed = true;
+            log.Dispose();
+        }
+    }
+}
@@ -5,9 +5,6 @@ using Avalonia.Markup.Xaml;
 using Avalonia.Platform;
 using System.Collections.Generic;
 using System.Linq;
-using System.Net;
-using System.Net.NetworkInformation;
-using System.Net.Sockets;
 using Avalonia.Controls;
 using Avalonia.Data.Core;
 
@@ -19,10 +16,10 @@ public partial class App : Application {
     private NativeMenuItem? _exitMenuItem;
     public override void Initialize() {
         AvaloniaXamlLoader.Load(this);
-        Rpc.Connect();
+        _ = Rpc.RunAsync();
         
         // Use default port 5983 from PebbleWSServer
-        int port = 5983;
+        int port = PebbleWSServer.DefaultPort;
         var server = new PebbleWSServer(port);
         _ = server.Start();
     }
@@ -30,7 +27,7 @@ public partial class App : Application {
     public override void OnFrameworkInitializationCompleted() {
         if (ApplicationLifetime is IClassicDesktopStyleApplicationLifetime desktop) {
             // Create main window
-            _mainWindow = new MainWindow(GetLocalIPAddresses(), 5983);
+            _mainWindow = new MainWindow(PebbleWSServer.GetLocalIPAddresses(), PebbleWSServer.DefaultPort);
             desktop.MainWindow = _mainWindow;
 
             // Set up tray icon menu with ViewModel
@@ -71,27 +68,4 @@ public partial class App : Application {
             desktop.Shutdown();
         }
     }
-
-    private static List<string> GetLocalIPAddresses() {
-        var addresses = new List<string>();
-        
-        // Get all network interfaces
-        var networkInterfaces = NetworkInterface.GetAllNetworkInterfaces()
-            .Where(ni => ni.OperationalStatus == OperationalStatus.Up && 
-                  (ni.NetworkInterfaceType == NetworkInterfaceType.Wireless80211 || 
-                   ni.NetworkInterfaceType == NetworkInterfaceType.Ethernet));
-                   
-        foreach (var networkInterface in networkInterfaces) {
-            var properties = networkInterface.GetIPProperties();
-            
-            // Get IPv4 addresses
-            foreach (var address in properties.UnicastAddresses) {
-                if (address.Address.AddressFamily == AddressFamily.InterNetwork) {
-                    addresses.Add(address.Address.ToString());
-                }
-            }
-        }
-        
-        return addresses;
-    }
 }
\ No newline at end of file
@@ -0,0 +1,299 @@
+using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.Compression;
+using System.Linq;
+using System.Text;
+using System.Text.Json;
+using System.Text.Json.Nodes;
+using System.Threading;
+using System.Threading.Channels;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion;
+
+public enum CaptureSource : byte {
+    Discord,
+    Pebble,
+}
+
+public enum CaptureDirection : byte {
+    Inbound,
+    Outbound,
+}
+
+public readonly record struct CaptureFrame(
+    DateTime Timestamp, CaptureSource Source, CaptureDirection Direction, byte[] Payload);
+
+// Optional capture of all Discord RPC and Pebble traffic, so a bug report can
+// be replayed later. Captures are append-only files that rotate at a size limit:
+//
+//   header: "PBLCAP" | version (1 byte) | compression (1 byte, 0 = none, 1 = gzip)
+//   frame:  UTC ticks (int64 LE) | source (1 byte) | direction (1 byte)
+//           | payload length (int32 LE) | payload (UTF-8 JSON or text command)
+//
+// With compression the frames after the header form one gzip stream.
+//
+// Captures get attached to bug reports, so OAuth secrets never reach the file:
+// the AUTHORIZE reply's code, the access token we AUTHENTICATE with (which
+// Discord echoes back) and refresh tokens are replaced before writing.
+public static class Capture {
+    public const string FileExtension = ".pblcap";
+    internal static readonly byte[] Magic = "PBLCAP"u8.ToArray();
+    internal const byte FormatVersion = 1;
+    // Nothing we record is bigger than what the IPC transport accepts, so a
+    // longer frame means the file is corrupt rather than a frame worth allocating
+    internal const int MaxFrameLength = IpcTransport.MaxPayload;
+    internal const string Redacted = "[redacted]";
+
+    private static readonly string[] SecretProperties = ["access_token", "code", "refresh_token"];
+
+    private static CaptureWriter? _writer;
+
+    public static bool Enabled => _writer != null;
+
+    // --capture <dir> [--capture-compress] [--capture-max-mb N] [--capture-files N]
+    public static void Configure(string[] args) {
+        var directory = GetOption(args, "--capture");
+        if (directory == null) {
+            return;
+        }
+
+        var maxMegabytes = int.TryParse(GetOption(args, "--capture-max-mb"), out var mb) && mb > 0 ? mb : 16;
+        var maxFiles = int.TryParse(GetOption(args, "--capture-files"), out var files) && files > 0 ? files : 4;
+        Start(directory, Array.IndexOf(args, "--capture-compress") >= 0, maxMegabytes * 1024L * 1024L, maxFiles);
+    }
+
+    public static void Start(string directory, bool compress, long maxFileBytes, int maxFiles) {
+        Directory.CreateDirectory(directory);
+        _writer = new CaptureWriter(directory, compress, maxFileBytes, maxFiles);
+        AppDomain.CurrentDomain.ProcessExit += (_, _) => Stop();
+        Console.WriteLine($"INFO: Capturing traffic to {directory}");
+    }
+
+    public static void Stop() {
+        Interlocked.Exchange(ref _writer, null)?.Dispose();
+    }
+
+    public static void Record(CaptureSource source, CaptureDirection direction, string payload) {
+        _writer?.Write(new CaptureFrame(DateTime.UtcNow, source, direction, Redact(Encoding.UTF8.GetBytes(payload))));
+    }
+
+    public static void Record(CaptureSource source, CaptureDirection direction, byte[] payload) {
+        _writer?.Write(new CaptureFrame(DateTime.UtcNow, source, direction, Redact(payload)));
+    }
+
+    // Copies only while capturing, the caller's buffer may be reused after we return
+    public static void Record(CaptureSource source, CaptureDirection direction, ReadOnlyMemory<byte> payload) {
+        _writer?.Write(new CaptureFrame(DateTime.UtcNow, source, direction, Redact(payload.ToArray())));
+    }
+
+    // Returns the payload itself unless it carries a secret. Only the few auth
+    // messages do, everything else is passed through without parsing.
+    internal static byte[] Redact(byte[] payload) {
+        var span = payload.AsSpan();
+        if (span.IndexOf("\"access_token\""u8) < 0 && span.IndexOf("\"code\""u8) < 0 &&
+            span.IndexOf("\"refresh_token\""u8) < 0) {
+            return payload;
+        }
+
+        JsonNode? root;
+        try {
+            root = JsonNode.Parse(payload);
+        }
+        catch (JsonException) {
+            // Can't tell where the secret is, so keep none of it
+            return Encoding.UTF8.GetBytes(Redacted);
+        }
+
+        if (root == null || !RedactSecrets(root)) {
+            return payload;
+        }
+
+        using var output = new MemoryStream(payload.Length);
+        using (var writer = new Utf8JsonWriter(output)) {
+            root.WriteTo(writer);
+        }
+
+        return output.ToArray();
+    }
+
+    // Only string values are secrets: Discord's error replies carry a numeric code worth keeping
+    private static bool RedactSecrets(JsonNode node) {
+        var redacted = false;
+        switch (node) {
+            case JsonObject obj:
+                foreach (var name in obj.Select(property => property.Key).ToList()) {
+                    var value = obj[name];
+                    if (SecretProperties.Contains(name) && value is JsonValue secret &&
+                        secret.GetValueKind() == JsonValueKind.String) {
+                        obj[name] = Redacted;
+                        redacted = true;
+                    }
+                    else if (value != null) {
+                        redacted |= RedactSecrets(value);
+                    }
+                }
+
+                break;
+            case JsonArray array:
+                foreach (var item in array) {
+                    if (item != null) {
+                        redacted |= RedactSecrets(item);
+                    }
+                }
+
+                break;
+        }
+
+        return redacted;
+    }
+
+    public static IEnumerable<CaptureFrame> Read(string path) {
+        using var file = File.OpenRead(path);
+        var header = new byte[Magic.Length + 2];
+        file.ReadExactly(header);
+        if (!header.AsSpan(0, Magic.Length).SequenceEqual(Magic) || header[Magic.Length] != FormatVersion) {
+            throw new InvalidDataException($"{path} is not a capture file");
+        }
+
+        using Stream stream = header[Magic.Length + 1] == 1 ? new GZipStream(file, CompressionMode.Decompress) : file;
+        var frameHeader = new byte[14];
+        while (true) {
+            // A capture cut off mid-frame (crash, power loss) just ends early
+            try {
+                stream.ReadExactly(frameHeader);
+            }
+            catch (EndOfStreamException) {
+                yield break;
+            }
+
+            var length = BinaryPrimitives.ReadInt32LittleEndian(frameHeader.AsSpan(10));
+            if (length < 0 || length > MaxFrameLength) {
+                throw new InvalidDataException($"{path} is corrupt: frame of {length} bytes");
+            }
+
+            var payload = new byte[length];
+            try {
+                stream.ReadExactly(payload);
+            }
+            catch (EndOfStreamException) {
+                yield break;
+            }
+
+            yield return new CaptureFrame(
+                new DateTime(BinaryPrimitives.ReadInt64LittleEndian(frameHeader), DateTimeKind.Utc),
+                (CaptureSource)frameHeader[8], (CaptureDirection)frameHeader[9], payload);
+        }
+    }
+
+    private static string? GetOption(string[] args, string name) {
+        var index = Array.IndexOf(args, name);
+        return index >= 0 && index + 1 < args.Length ? args[index + 1] : null;
+    }
+}
+
+// Frames are handed to a background writer so capturing never blocks the
+// Discord or Pebble paths. If the disk can't keep up frames are dropped and counted.
+internal sealed class CaptureWriter : IDisposable {
+    private readonly string directory;
+    private readonly bool compress;
+    private readonly long maxFileBytes;
+    private readonly int maxFiles;
+    private readonly Channel<CaptureFrame> frames =
+        Channel.CreateBounded<CaptureFrame>(new BoundedChannelOptions(4096) {
+            FullMode = BoundedChannelFullMode.DropWrite,
+            SingleReader = true,
+        });
+    private readonly Task writeLoop;
+    private FileStream? file;
+    private Stream? stream;
+    private long dropped;
+    private int fileIndex;
+
+    public CaptureWriter(string directory, bool compress, long maxFileBytes, int maxFiles) {
+        this.directory = directory;
+        this.compress = compress;
+        this.maxFileBytes = maxFileBytes;
+        this.maxFiles = maxFiles;
+        writeLoop = Task.Run(WriteLoopAsync);
+    }
+
+    public void Write(CaptureFrame frame) {
+        if (!frames.Writer.TryWrite(frame)) {
+            Interlocked.Increment(ref dropped);
+        }
+    }
+
+    public void Dispose() {
+        frames.Writer.TryComplete();
+        writeLoop.Wait(TimeSpan.FromSeconds(2));
+    }
+
+    private async Task WriteLoopAsync() {
+        var frameHeader = new byte[14];
+        try {
+            while (await frames.Reader.WaitToReadAsync()) {
+                while (frames.Reader.TryRead(out var frame)) {
+                    if (stream == null || file!.Length >= maxFileBytes) {
+                        Rotate();
+                    }
+
+                    BinaryPrimitives.WriteInt64LittleEndian(frameHeader, frame.Timestamp.Ticks);
+                    frameHeader[8] = (byte)frame.Source;
+                    frameHeader[9] = (byte)frame.Direction;
+                    BinaryPrimitives.WriteInt32LittleEndian(frameHeader.AsSpan(10), frame.Payload.Length);
+                    stream!.Write(frameHeader);
+                    stream.Write(frame.Payload);
+                }
+
+                // Flush whenever we catch up so a crash loses as little as possible
+                stream?.Flush();
+
+                var droppedFrames = Interlocked.Exchange(ref dropped, 0);
+                if (droppedFrames > 0) {
+                    Console.WriteLine($"ERROR: Capture fell behind, dropped {droppedFrames} frame(s)");
+                }
+            }
+        }
+        catch (Exception ex) {
+            Console.WriteLine($"ERROR: Capture stopped: {ex.Message}");
+        }
+        finally {
+            stream?.Dispose();
+            file?.Dispose();
+        }
+    }
+
+    private void Rotate() {
+        stream?.Dispose();
+        file?.Dispose();
+
+        var path = Path.Combine(directory, $"capture-{DateTime.UtcNow:yyyyMMdd-HHmmss}-{fileIndex++:D4}{Capture.FileExtension}");
+        // Owner-only: even redacted, a capture shows who the user talks to
+        var options = new FileStreamOptions { Mode = FileMode.CreateNew, Access = FileAccess.Write, Share = FileShare.Read };
+        if (!OperatingSystem.IsWindows()) {
+            options.UnixCreateMode = UnixFileMode.UserRead | UnixFileMode.UserWrite;
+        }
+
+        file = new FileStream(path, options);
+        file.Write(Capture.Magic);
+        file.WriteByte(Capture.FormatVersion);
+        file.WriteByte(compress ? (byte)1 : (byte)0);
+        stream = compress ? new GZipStream(file, CompressionLevel.Fastest, leaveOpen: true) : file;
+
+        // Keep only the newest captures
+        var oldFiles = Directory.GetFiles(directory, "capture-*" + Capture.FileExtension)
+            .OrderByDescending(name => name, StringComparer.Ordinal)
+            .Skip(maxFiles);
+        foreach (var oldFile in oldFiles) {
+            try {
+                File.Delete(oldFile);
+            }
+            catch (IOException ex) {
+                Console.WriteLine($"ERROR: Failed to delete old capture {oldFile}: {ex.Message}");
+            }
+        }
+    }
+}
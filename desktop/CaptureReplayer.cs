@@ -0,0 +1,42 @@
+using System;
+using System.Diagnostics;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion;
+
+// Feeds the Discord side of a capture back through Rpc's message handling, so
+// connected Pebble clients see exactly what they saw when it was recorded.
+// Commands sent to Discord during a replay go nowhere since Rpc isn't connected.
+public static class CaptureReplayer {
+    // speed 1 replays in real time, 10 ten times faster, 0 as fast as possible
+    public static async Task RunAsync(string path, double speed, CancellationToken cancellationToken) {
+        Console.WriteLine($"INFO: Replaying {path} at {(speed > 0 ? $"{speed}x" : "full speed")}");
+
+        var clock = Stopwatch.StartNew();
+        DateTime? firstTimestamp = null;
+        var replayed = 0;
+
+        foreach (var frame in Capture.Read(path)) {
+            if (frame.Source != CaptureSource.Discord || frame.Direction != CaptureDirection.Inbound) {
+                continue;
+            }
+
+            firstTimestamp ??= frame.Timestamp;
+            if (speed > 0) {
+                var due = (frame.Timestamp - firstTimestamp.Value) / speed;
+                var wait = due - clock.Elapsed;
+                if (wait > TimeSpan.Zero) {
+                    await Task.Delay(wait, cancellationToken);
+                }
+            }
+
+            cancellationToken.ThrowIfCancellationRequested();
+            Rpc.HandleMessage(Encoding.UTF8.GetString(frame.Payload));
+            replayed++;
+        }
+
+        Console.WriteLine($"INFO: Replay finished, {replayed} Discord message(s) in {clock.Elapsed.TotalSeconds:F1}s");
+    }
+}
@@ -0,0 +1,134 @@
+using System;
+using System.Net.Sockets;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion;
+
+// Runs only the Discord RPC bridge and the Pebble WebSocket server, without
+// Avalonia, the tray icon or any window. Meant for always-on machines,
+// typically as a systemd service (Type=notify).
+public static class HeadlessHost {
+    public static async Task<int> RunAsync(string[] args) {
+        var port = ParsePort(args);
+        using var shutdown = new CancellationTokenSource();
+
+        // Graceful shutdown on SIGTERM (systemctl stop) and SIGINT (Ctrl+C)
+        using var sigterm = PosixSignalRegistration.Create(PosixSignal.SIGTERM, context => {
+            context.Cancel = true;
+            shutdown.Cancel();
+        });
+        using var sigint = PosixSignalRegistration.Create(PosixSignal.SIGINT, context => {
+            context.Cancel = true;
+            shutdown.Cancel();
+        });
+
+        var server = new PebbleWSServer(port);
+        await server.Start();
+        if (!server.IsRunning) {
+            Console.WriteLine($"ERROR: Could not start the WebSocket server on port {port}");
+            return 1;
+        }
+
+        // --replay <capture> [--speed N] drives the state logic from a capture instead of Discord
+        var replayPath = GetOption(args, "--replay");
+        var rpc = ObserveAsync(replayPath != null
+                ? CaptureReplayer.RunAsync(replayPath, ParseSpeed(args), shutdown.Token)
+                : Rpc.RunAsync(shutdown.Token),
+            replayPath != null ? "Replay" : "Discord RPC", shutdown);
+
+        // A replay of a missing or unreadable capture fails before its first
+        // await; systemd has to see that as a failed start, not a ready service
+        if (rpc.IsCompleted && !rpc.Result) {
+            server.Stop();
+            return 1;
+        }
+
+        Notify("READY=1");
+        var watchdog = ObserveAsync(RunWatchdogAsync(shutdown.Token), "Watchdog", shutdown);
+
+        try {
+            await Task.Delay(Timeout.Infinite, shutdown.Token);
+        }
+        catch (OperationCanceledException) {
+            // Signalled, or one of the loops above failed
+        }
+
+        Notify("STOPPING=1");
+        Console.WriteLine("INFO: Shutting down");
+        server.Stop();
+        Capture.Stop();
+
+        // Non-zero so systemd's Restart=on-failure brings the bridge back
+        return await rpc & await watchdog ? 0 : 1;
+    }
+
+    // Completes with true when the loop ended on the shutdown token (or a
+    // replay simply finished), false when it failed. A failure is logged and
+    // shuts the host down right away instead of surfacing only at exit.
+    private static async Task<bool> ObserveAsync(Task loop, string name, CancellationTokenSource shutdown) {
+        try {
+            await loop;
+            return true;
+        }
+        catch (OperationCanceledException) when (shutdown.IsCancellationRequested) {
+            return true;
+        }
+        catch (Exception ex) {
+            Console.WriteLine($"ERROR: {name} failed: {ex.Message}");
+            shutdown.Cancel();
+            return false;
+        }
+    }
+
+    private static int ParsePort(string[] args) {
+        return int.TryParse(GetOption(args, "--port"), out var port) ? port : PebbleWSServer.DefaultPort;
+    }
+
+    private static double ParseSpeed(string[] args) {
+        return double.TryParse(GetOption(args, "--speed"), System.Globalization.NumberStyles.Float,
+            System.Globalization.CultureInfo.InvariantCulture, out var speed) ? speed : 1;
+    }
+
+    private static string? GetOption(string[] args, string name) {
+        var index = Array.IndexOf(args, name);
+        return index >= 0 && index + 1 < args.Length ? args[index + 1] : null;
+    }
+
+    // Keep systemd's watchdog happy when WatchdogSec= is set on the unit
+    private static async Task RunWatchdogAsync(CancellationToken cancellationToken) {
+        var usec = Environment.GetEnvironmentVariable("WATCHDOG_USEC");
+        if (!long.TryParse(usec, out var watchdogUsec) || watchdogUsec <= 0) {
+            return;
+        }
+
+        var interval = TimeSpan.FromMicroseconds(watchdogUsec / 2.0);
+        while (!cancellationToken.IsCancellationRequested) {
+            Notify("WATCHDOG=1");
+            await Task.Delay(interval, cancellationToken);
+        }
+    }
+
+    // sd_notify(3) without linking libsystemd: a datagram to $NOTIFY_SOCKET
+    private static void Notify(string state) {
+        var socketPath = Environment.GetEnvironmentVariable("NOTIFY_SOCKET");
+        if (string.IsNullOrEmpty(socketPath)) {
+            return;
+        }
+
+        // A leading '@' denotes a socket in the abstract namespace
+        if (socketPath[0] == '@') {
+            socketPath = "\0" + socketPath[1..];
+        }
+
+        try {
+            using var socket = new Socket(AddressFamily.Unix, SocketType.Dgram, ProtocolType.Unspecified);
+            socket.SendTo(Encoding.UTF8.GetBytes(state), new UnixDomainSocketEndPoint(socketPath));
+        }
+        catch (Exception ex) {
+            Console.WriteLine($"ERROR: Failed to notify systemd: {ex.Message}");
+        }
+    }
+}
@@ -0,0 +1,205 @@
+using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.Pipes;
+using System.Linq;
+using System.Net.Sockets;
+using System.Text;
+using System.Text.Json;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion;
+
+// Discord's native IPC: a Unix domain socket (a named pipe on Windows) called
+// discord-ipc-N, one per running client. No HTTP upgrade or origin check, and
+// each message is an 8 byte header (opcode, payload length, both little endian
+// int32) followed by the JSON payload. The payloads are the same RPC messages
+// the WebSocket carries.
+public sealed class IpcTransport : IRpcTransport {
+    private enum Opcode {
+        Handshake = 0,
+        Frame = 1,
+        Close = 2,
+        Ping = 3,
+        Pong = 4,
+    }
+
+    private const int HeaderSize = 8;
+    // Far above anything Discord sends, only here to stop a corrupt header from allocating gigabytes
+    internal const int MaxPayload = 4 * 1024 * 1024;
+    private const int MaxPipes = 10;
+
+    // Where Discord creates the socket: the runtime dir, or a sandbox's view of it
+    private static readonly string[] SandboxDirectories = ["", "app/com.discordapp.Discord", "snap.discord"];
+
+    private readonly Stream stream;
+    private readonly byte[] header = new byte[HeaderSize];
+    // Pongs are written by the reader, frames by the send queue
+    private readonly SemaphoreSlim writeLock = new(1, 1);
+
+    private IpcTransport(string path, Stream stream) {
+        Endpoint = path;
+        this.stream = stream;
+    }
+
+    public RpcTransportKind Kind => RpcTransportKind.Ipc;
+
+    public string Endpoint { get; }
+
+    // Sockets that exist right now, in discord-ipc-N order. Stale sockets of a
+    // crashed client are listed too, connecting to them just fails.
+    // PEBBLE_COMPANION_IPC_DIR points the bridge at a stand-in instead.
+    public static List<string> FindSockets() {
+        if (OperatingSystem.IsWindows()) {
+            return Enumerable.Range(0, MaxPipes)
+                .Select(n => $@"\\.\pipe\discord-ipc-{n}")
+                .Where(File.Exists)
+                .ToList();
+        }
+
+        var overridden = Environment.GetEnvironmentVariable("PEBBLE_COMPANION_IPC_DIR");
+        string[] roots = overridden != null
+            ? [overridden]
+            : new[] { "XDG_RUNTIME_DIR", "TMPDIR", "TMP", "TEMP" }
+                .Select(Environment.GetEnvironmentVariable)
+                .Append("/tmp")
+                .OfType<string>()
+                .Where(root => root.Length > 0)
+                .Distinct()
+                .ToArray();
+
+        string[] sandboxes = overridden != null ? [""] : SandboxDirectories;
+        var sockets = new List<string>();
+        for (var n = 0; n < MaxPipes; n++) {
+            foreach (var root in roots) {
+                foreach (var sandbox in sandboxes) {
+                    var path = Path.Combine(root, sandbox, $"discord-ipc-{n}");
+                    if (File.Exists(path) && !sockets.Contains(path)) {
+                        sockets.Add(path);
+                    }
+                }
+            }
+        }
+
+        return sockets;
+    }
+
+    // Connects and sends the handshake. Discord's READY dispatch then arrives
+    // as the first frame, just like right after a WebSocket connect.
+    public static async Task<IRpcTransport?> TryConnectAsync(string path, TimeSpan timeout,
+        CancellationToken cancellationToken) {
+        using var connectTimeout = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
+        connectTimeout.CancelAfter(timeout);
+        IDisposable? connection = null;
+        try {
+            Stream stream;
+            if (OperatingSystem.IsWindows()) {
+                var pipe = new NamedPipeClientStream(".", Path.GetFileName(path), PipeDirection.InOut,
+                    PipeOptions.Asynchronous);
+                connection = pipe;
+                await pipe.ConnectAsync(connectTimeout.Token);
+                stream = pipe;
+            }
+            else {
+                var socket = new Socket(AddressFamily.Unix, SocketType.Stream, ProtocolType.Unspecified);
+                connection = socket;
+                await socket.ConnectAsync(new UnixDomainSocketEndPoint(path), connectTimeout.Token);
+                stream = new NetworkStream(socket, ownsSocket: true);
+                connection = stream;
+            }
+
+            var transport = new IpcTransport(path, stream);
+            await transport.WriteAsync(Opcode.Handshake,
+                JsonSerializer.SerializeToUtf8Bytes(new IpcHandshake(1, Rpc.ClientId),
+                    DiscordJsonContext.Default.IpcHandshake),
+                connectTimeout.Token);
+            return transport;
+        }
+        catch (Exception) when (!cancellationToken.IsCancellationRequested) {
+            connection?.Dispose();
+            return null;
+        }
+    }
+
+    public async Task<string?> ReceiveAsync(CancellationToken cancellationToken) {
+        while (true) {
+            if (!await ReadExactlyAsync(header, cancellationToken)) {
+                return null;
+            }
+
+            var opcode = (Opcode)BinaryPrimitives.ReadInt32LittleEndian(header);
+            var length = BinaryPrimitives.ReadInt32LittleEndian(header.AsSpan(4));
+            if (length < 0 || length > MaxPayload) {
+                throw new InvalidDataException($"IPC frame of {length} bytes");
+            }
+
+            var payload = new byte[length];
+            if (!await ReadExactlyAsync(payload, cancellationToken)) {
+                return null;
+            }
+
+            switch (opcode) {
+                case Opcode.Frame:
+                    return Encoding.UTF8.GetString(payload);
+                case Opcode.Ping:
+                    await WriteAsync(Opcode.Pong, payload, cancellationToken);
+                    break;
+                case Opcode.Pong:
+                    break;
+                case Opcode.Close:
+                    // Carries {code, message}, e.g. an invalid client id
+                    Console.WriteLine("Close reason: " + Encoding.UTF8.GetString(payload));
+                    return null;
+                default:
+                    Console.WriteLine($"Unknown IPC opcode {(int)opcode}");
+                    break;
+            }
+        }
+    }
+
+    public Task SendAsync(byte[] payload, CancellationToken cancellationToken) {
+        return WriteAsync(Opcode.Frame, payload, cancellationToken);
+    }
+
+    // Discord already hung up, there is no close reply in this protocol
+    public Task CloseAsync() {
+        return Task.CompletedTask;
+    }
+
+    public void Dispose() {
+        stream.Dispose();
+    }
+
+    // Header and payload in one write, so a frame is never split by another writer
+    private async Task WriteAsync(Opcode opcode, byte[] payload, CancellationToken cancellationToken) {
+        var frame = new byte[HeaderSize + payload.Length];
+        BinaryPrimitives.WriteInt32LittleEndian(frame, (int)opcode);
+        BinaryPrimitives.WriteInt32LittleEndian(frame.AsSpan(4), payload.Length);
+        payload.CopyTo(frame, HeaderSize);
+
+        await writeLock.WaitAsync(cancellationToken);
+        try {
+            await stream.WriteAsync(frame, cancellationToken);
+        }
+        finally {
+            writeLock.Release();
+        }
+    }
+
+    // False when the stream ended, which is how Discord going away looks here
+    private async Task<bool> ReadExactlyAsync(byte[] buffer, CancellationToken cancellationToken) {
+        var read = 0;
+        while (read < buffer.Length) {
+            var count = await stream.ReadAsync(buffer.AsMemory(read), cancellationToken);
+            if (count == 0) {
+                return false;
+            }
+
+            read += count;
+        }
+
+        return true;
+    }
+}
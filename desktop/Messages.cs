@@ -0,0 +1,99 @@
+using System.Collections.Generic;
+using System.Text.Json.Serialization;
+
+namespace Pebble_Companion;
+
+// ---------------------- PEBBLE CLIENT MESSAGES ----------------------
+
+// Channel fields changed during one coalescing window, merged last-writer-wins.
+// Only the fields that changed are sent.
+public record StateUpdateMessage {
+    [JsonPropertyOrder(-1)] public string Cmd => "STATE_UPDATE";
+
+    [JsonIgnore(Condition = JsonIgnoreCondition.WhenWritingNull)]
+    public string? ChannelName { get; init; }
+
+    [JsonIgnore(Condition = JsonIgnoreCondition.WhenWritingNull)]
+    public int? Users { get; init; }
+
+    [JsonIgnore(Condition = JsonIgnoreCondition.WhenWritingNull)]
+    public string? ServerName { get; init; }
+}
+
+public record UserVoiceStateUpdateMessage(bool Mute, bool Deaf) {
+    [JsonPropertyOrder(-1)] public string Cmd => "USER_VOICE_STATE_UPDATE";
+
+    // Echoes the trace id of the mute press that caused this update
+    [JsonIgnore(Condition = JsonIgnoreCondition.WhenWritingNull)]
+    public long? Trace { get; init; }
+}
+
+// Addresses this server can be reached on, so the phone can fall back to
+// another interface when the configured one goes away
+public record ServerAddressesMessage(List<string> Addresses, int Port) {
+    [JsonPropertyOrder(-1)] public string Cmd => "SERVER_ADDRESSES";
+}
+
+// One page of the participant list, sent only to the client that asked
+public record ParticipantsMessage(int Offset, int Total, int Version, List<string> Names, List<int> Volumes) {
+    [JsonPropertyOrder(-1)] public string Cmd => "PARTICIPANTS";
+}
+
+public record InitialStateMessage(bool Mute, bool Deaf, string? ChannelName, int Users, string? ServerName) {
+    [JsonPropertyOrder(-1)] public string Cmd => "GET_INITIAL_STATE";
+}
+
+[JsonSourceGenerationOptions(PropertyNamingPolicy = JsonKnownNamingPolicy.CamelCase)]
+[JsonSerializable(typeof(StateUpdateMessage))]
+[JsonSerializable(typeof(UserVoiceStateUpdateMessage))]
+[JsonSerializable(typeof(ServerAddressesMessage))]
+[JsonSerializable(typeof(ParticipantsMessage))]
+[JsonSerializable(typeof(InitialStateMessage))]
+internal partial class PebbleJsonContext : JsonSerializerContext;
+
+// ---------------------- DISCORD RPC PAYLOADS ----------------------
+
+public record RpcRequest(string Cmd, object? Args, string Nonce) {
+    [JsonIgnore(Condition = JsonIgnoreCondition.WhenWritingNull)]
+    public string? Evt { get; init; }
+}
+
+public record AuthorizeArgs(string ClientId, string[] Scopes, string Prompt);
+
+public record AuthenticateArgs(string? AccessToken);
+
+public record VoiceSettingsArgs {
+    [JsonIgnore(Condition = JsonIgnoreCondition.WhenWritingNull)]
+    public bool? Mute { get; init; }
+
+    [JsonIgnore(Condition = JsonIgnoreCondition.WhenWritingNull)]
+    public bool? Deaf { get; init; }
+}
+
+public record SelectVoiceChannelArgs(string? ChannelId, bool Force);
+
+public record ChannelArgs(string? ChannelId);
+
+public record UserVoiceSettingsArgs(string UserId, int Volume);
+
+public record GuildArgs(string? GuildId);
+
+public record TokenExchangeRequest(string Code);
+
+// First frame on the IPC socket, Discord answers with the READY dispatch
+public record IpcHandshake(int V, string ClientId);
+
+// Everything that can end up in RpcRequest.Args has to be listed here
+[JsonSourceGenerationOptions(PropertyNamingPolicy = JsonKnownNamingPolicy.SnakeCaseLower)]
+[JsonSerializable(typeof(RpcRequest))]
+[JsonSerializable(typeof(AuthorizeArgs))]
+[JsonSerializable(typeof(AuthenticateArgs))]
+[JsonSerializable(typeof(VoiceSettingsArgs))]
+[JsonSerializable(typeof(SelectVoiceChannelArgs))]
+[JsonSerializable(typeof(ChannelArgs))]
+[JsonSerializable(typeof(UserVoiceSettingsArgs))]
+[JsonSerializable(typeof(GuildArgs))]
+[JsonSerializable(typeof(TokenExchangeRequest))]
+[JsonSerializable(typeof(StoredTokens))]
+[JsonSerializable(typeof(IpcHandshake))]
+internal partial class DiscordJsonContext : JsonSerializerContext;
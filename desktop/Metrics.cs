@@ -0,0 +1,263 @@
+using System;
+using System.Collections.Concurrent;
+using System.Diagnostics;
+using System.Globalization;
+using System.Text;
+using System.Threading;
+
+namespace Pebble_Companion;
+
+// Lock-free latency histogram with fixed buckets, cheap enough to leave on
+public sealed class Histogram {
+    private static readonly double[] BucketBounds =
+        [0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10];
+
+    // One extra slot for +Inf
+    private readonly long[] buckets = new long[BucketBounds.Length + 1];
+    private long count;
+    private long sumTicks;
+
+    public void Observe(TimeSpan duration) {
+        var seconds = duration.TotalSeconds;
+        var bucket = 0;
+        while (bucket < BucketBounds.Length && seconds > BucketBounds[bucket]) {
+            bucket++;
+        }
+
+        Interlocked.Increment(ref buckets[bucket]);
+        Interlocked.Increment(ref count);
+        Interlocked.Add(ref sumTicks, duration.Ticks);
+    }
+
+    public void ObserveSince(long startTimestamp) {
+        Observe(Stopwatch.GetElapsedTime(startTimestamp));
+    }
+
+    // Estimate from the buckets, interpolating linearly inside the bucket the
+    // quantile falls in. Good enough to tell which hop dominates.
+    public TimeSpan Quantile(double quantile) {
+        var total = Interlocked.Read(ref count);
+        if (total == 0) {
+            return TimeSpan.Zero;
+        }
+
+        var rank = quantile * total;
+        long cumulative = 0;
+        for (var i = 0; i < BucketBounds.Length; i++) {
+            var inBucket = Interlocked.Read(ref buckets[i]);
+            if (cumulative + inBucket >= rank && inBucket > 0) {
+                var lower = i == 0 ? 0 : BucketBounds[i - 1];
+                var fraction = (rank - cumulative) / inBucket;
+                return TimeSpan.FromSeconds(lower + (BucketBounds[i] - lower) * fraction);
+            }
+
+            cumulative += inBucket;
+        }
+
+        return TimeSpan.FromSeconds(BucketBounds[^1]);
+    }
+
+    // Prometheus buckets are cumulative
+    internal void Write(StringBuilder output, string name, string labels) {
+        var separator = labels.Length > 0 ? "," : "";
+        long cumulative = 0;
+        for (var i = 0; i < BucketBounds.Length; i++) {
+            cumulative += Interlocked.Read(ref buckets[i]);
+            output.Append(CultureInfo.InvariantCulture,
+                $"{name}_bucket{{{labels}{separator}le=\"{BucketBounds[i]}\"}} {cumulative}\n");
+        }
+
+        cumulative += Interlocked.Read(ref buckets[BucketBounds.Length]);
+        output.Append(CultureInfo.InvariantCulture, $"{name}_bucket{{{labels}{separator}le=\"+Inf\"}} {cumulative}\n");
+        var braces = labels.Length > 0 ? $"{{{labels}}}" : "";
+        output.Append(CultureInfo.InvariantCulture,
+            $"{name}_sum{braces} {TimeSpan.FromTicks(Interlocked.Read(ref sumTicks)).TotalSeconds}\n");
+        output.Append(CultureInfo.InvariantCulture, $"{name}_count{braces} {Interlocked.Read(ref count)}\n");
+    }
+}
+
+// Process-wide counters, exported in Prometheus text format on /metrics
+public static class Metrics {
+    private static long _broadcasts;
+    private static long _droppedSends;
+    private static long _coalescedUpdates;
+    private static long _suppressedUpdates;
+    private static long _throttledCoalesced;
+    private static long _throttledDropped;
+    private static long _rpcReconnects;
+
+    private static readonly int StageCount = Enum.GetValues<PipelineStage>().Length;
+    private static readonly long[] StageDepth = new long[StageCount];
+    private static readonly long[] StageBlocked = new long[StageCount];
+    private static readonly long[] StageDropped = new long[StageCount];
+
+    private static readonly ConcurrentDictionary<string, Histogram> CommandLatency = new();
+    private static readonly Histogram RpcRoundTrip = new();
+    private static readonly Histogram[] RpcSendLatency =
+        Array.ConvertAll(Enum.GetValues<RpcPriority>(), _ => new Histogram());
+
+    public static void Broadcast() => Interlocked.Increment(ref _broadcasts);
+    public static void DroppedSend() => Interlocked.Increment(ref _droppedSends);
+    public static void CoalescedUpdate() => Interlocked.Increment(ref _coalescedUpdates);
+    public static void SuppressedUpdate() => Interlocked.Increment(ref _suppressedUpdates);
+
+    public static void ThrottledCommand(bool coalesced) {
+        Interlocked.Increment(ref coalesced ? ref _throttledCoalesced : ref _throttledDropped);
+    }
+    public static void RpcReconnect() => Interlocked.Increment(ref _rpcReconnects);
+
+    public static void PipelineQueued(PipelineStage stage) => Interlocked.Increment(ref StageDepth[(int)stage]);
+    public static void PipelineDequeued(PipelineStage stage) => Interlocked.Decrement(ref StageDepth[(int)stage]);
+    public static void PipelineBlocked(PipelineStage stage) => Interlocked.Increment(ref StageBlocked[(int)stage]);
+
+    // The dropped item leaves the queue too
+    public static void PipelineDropped(PipelineStage stage) {
+        Interlocked.Increment(ref StageDropped[(int)stage]);
+        Interlocked.Decrement(ref StageDepth[(int)stage]);
+    }
+
+    // Callers only pass known command names so the label set stays bounded
+    public static Histogram Command(string command) => CommandLatency.GetOrAdd(command, _ => new Histogram());
+
+    public static Histogram RpcRoundTripTime => RpcRoundTrip;
+
+    public static Histogram RpcSendQueueLatency(RpcPriority priority) => RpcSendLatency[(int)priority];
+
+    private static readonly double[] TraceQuantiles = [0.5, 0.95, 0.99];
+    private static readonly Histogram[] TraceHops = Array.ConvertAll(Trace.Hops, _ => new Histogram());
+
+    public static Histogram TraceHop(int hop) => TraceHops[hop];
+
+    public static string Render(int connectedClients) {
+        var output = new StringBuilder();
+
+        Gauge(output, "pebble_connected_clients", "Connected Pebble WebSocket clients", connectedClients);
+        Counter(output, "pebble_broadcasts_total", "Messages broadcast to Pebble clients", Interlocked.Read(ref _broadcasts));
+        Counter(output, "pebble_dropped_sends_total", "Sends to Pebble clients that failed or hit a dead socket",
+            Interlocked.Read(ref _droppedSends));
+
+        Counter(output, "pebble_coalesced_updates_total", "State changes merged into an already pending broadcast",
+            Interlocked.Read(ref _coalescedUpdates));
+        Counter(output, "pebble_suppressed_updates_total", "State changes dropped because nothing changed",
+            Interlocked.Read(ref _suppressedUpdates));
+
+        output.Append("# HELP pebble_throttled_commands_total Commands held back by the rate limits\n");
+        output.Append("# TYPE pebble_throttled_commands_total counter\n");
+        output.Append(CultureInfo.InvariantCulture,
+            $"pebble_throttled_commands_total{{action=\"coalesced\"}} {Interlocked.Read(ref _throttledCoalesced)}\n");
+        output.Append(CultureInfo.InvariantCulture,
+            $"pebble_throttled_commands_total{{action=\"dropped\"}} {Interlocked.Read(ref _throttledDropped)}\n");
+
+        output.Append("# HELP pebble_command_duration_seconds Time to process a command from a Pebble client\n");
+        output.Append("# TYPE pebble_command_duration_seconds histogram\n");
+        foreach (var (command, histogram) in CommandLatency) {
+            histogram.Write(output, "pebble_command_duration_seconds", $"command=\"{command}\"");
+        }
+
+        output.Append("# HELP pebble_trace_hop_seconds Per-hop latency of traced mute presses\n");
+        output.Append("# TYPE pebble_trace_hop_seconds histogram\n");
+        for (var i = 0; i < Trace.Hops.Length; i++) {
+            TraceHops[i].Write(output, "pebble_trace_hop_seconds", $"hop=\"{Trace.Hops[i]}\"");
+        }
+
+        output.Append("# HELP pebble_trace_hop_quantile_seconds Estimated per-hop latency percentiles\n");
+        output.Append("# TYPE pebble_trace_hop_quantile_seconds gauge\n");
+        for (var i = 0; i < Trace.Hops.Length; i++) {
+            foreach (var quantile in TraceQuantiles) {
+                output.Append(CultureInfo.InvariantCulture,
+                    $"pebble_trace_hop_quantile_seconds{{hop=\"{Trace.Hops[i]}\",quantile=\"{quantile}\"}} " +
+                    $"{TraceHops[i].Quantile(quantile).TotalSeconds}\n");
+            }
+        }
+
+        Gauge(output, "discord_rpc_authenticated", "1 while authenticated with the Discord client",
+            Rpc.IsAuthenticated ? 1 : 0);
+        Gauge(output, "discord_rpc_clients", "Discord clients the bridge holds a connection to", Rpc.ClientCount);
+        Counter(output, "discord_rpc_reconnects_total", "Reconnect attempts to the Discord client",
+            Interlocked.Read(ref _rpcReconnects));
+
+        output.Append("# HELP discord_rpc_roundtrip_seconds Time from sending an RPC command to Discord's response\n");
+        output.Append("# TYPE discord_rpc_roundtrip_seconds histogram\n");
+        RpcRoundTrip.Write(output, "discord_rpc_roundtrip_seconds", "");
+
+        output.Append("# HELP discord_rpc_send_queue_depth Frames waiting for the RPC socket writer\n");
+        output.Append("# TYPE discord_rpc_send_queue_depth gauge\n");
+        foreach (var lane in Enum.GetValues<RpcPriority>()) {
+            output.Append(CultureInfo.InvariantCulture,
+                $"discord_rpc_send_queue_depth{{lane=\"{lane}\"}} {RpcSendQueue.GetStats(lane).Depth}\n");
+        }
+
+        output.Append("# HELP discord_rpc_frames_sent_total Frames written to the Discord RPC socket\n");
+        output.Append("# TYPE discord_rpc_frames_sent_total counter\n");
+        foreach (var lane in Enum.GetValues<RpcPriority>()) {
+            output.Append(CultureInfo.InvariantCulture,
+                $"discord_rpc_frames_sent_total{{lane=\"{lane}\"}} {RpcSendQueue.GetStats(lane).Sent}\n");
+        }
+
+        output.Append("# HELP discord_rpc_send_queue_seconds Time a frame waited before it was written to Discord\n");
+        output.Append("# TYPE discord_rpc_send_queue_seconds histogram\n");
+        foreach (var lane in Enum.GetValues<RpcPriority>()) {
+            RpcSendLatency[(int)lane].Write(output, "discord_rpc_send_queue_seconds", $"lane=\"{lane}\"");
+        }
+
+        output.Append("# HELP discord_pipeline_queue_depth Items waiting for each stage of the Discord event pipeline\n");
+        output.Append("# TYPE discord_pipeline_queue_depth gauge\n");
+        foreach (var stage in Enum.GetValues<PipelineStage>()) {
+            output.Append(CultureInfo.InvariantCulture,
+                $"discord_pipeline_queue_depth{{stage=\"{stage}\"}} {Interlocked.Read(ref StageDepth[(int)stage])}\n");
+        }
+
+        output.Append("# HELP discord_pipeline_blocked_total Writes that had to wait for a full pipeline stage\n");
+        output.Append("# TYPE discord_pipeline_blocked_total counter\n");
+        foreach (var stage in Enum.GetValues<PipelineStage>()) {
+            output.Append(CultureInfo.InvariantCulture,
+                $"discord_pipeline_blocked_total{{stage=\"{stage}\"}} {Interlocked.Read(ref StageBlocked[(int)stage])}\n");
+        }
+
+        output.Append("# HELP discord_pipeline_dropped_total Items dropped by a full pipeline stage\n");
+        output.Append("# TYPE discord_pipeline_dropped_total counter\n");
+        foreach (var stage in Enum.GetValues<PipelineStage>()) {
+            output.Append(CultureInfo.InvariantCulture,
+                $"discord_pipeline_dropped_total{{stage=\"{stage}\"}} {Interlocked.Read(ref StageDropped[(int)stage])}\n");
+        }
+
+        output.Append("# HELP dotnet_gc_collections_total Garbage collections per generation\n");
+        output.Append("# TYPE dotnet_gc_collections_total counter\n");
+        for (var generation = 0; generation <= GC.MaxGeneration; generation++) {
+            output.Append(CultureInfo.InvariantCulture,
+                $"dotnet_gc_collections_total{{generation=\"{generation}\"}} {GC.CollectionCount(generation)}\n");
+        }
+
+        Counter(output, "dotnet_allocated_bytes_total", "Bytes allocated on the managed heap",
+            GC.GetTotalAllocatedBytes());
+        Gauge(output, "dotnet_gc_heap_bytes", "Managed heap size", GC.GetTotalMemory(false));
+        // As of the last GC. A leak of buffers or documents shows here first,
+        // the LOH is only compacted on request.
+        var gcInfo = GC.GetGCMemoryInfo();
+        Gauge(output, "dotnet_gc_loh_bytes", "Large object heap size after the last GC",
+            gcInfo.GenerationInfo.Length > 3 ? gcInfo.GenerationInfo[3].SizeAfterBytes : 0);
+        Gauge(output, "dotnet_gc_fragmented_bytes", "Free space inside the managed heap after the last GC",
+            gcInfo.FragmentedBytes);
+        // What dotnet_gc_heap_bytes would be without the garbage, for telling leaks from a big gen0 budget
+        Gauge(output, "dotnet_gc_live_bytes", "Managed heap in use after the last GC",
+            gcInfo.HeapSizeBytes - gcInfo.FragmentedBytes);
+        using (var process = Process.GetCurrentProcess()) {
+            Gauge(output, "process_resident_memory_bytes", "Resident set size", process.WorkingSet64);
+            Gauge(output, "process_open_handles", "OS handles (file descriptors on Linux) held by the process",
+                process.HandleCount);
+            Gauge(output, "process_threads", "OS threads in the process", process.Threads.Count);
+            Counter(output, "process_cpu_seconds_total", "CPU time used by the process",
+                process.TotalProcessorTime.TotalSeconds);
+        }
+
+        return output.ToString();
+    }
+
+    private static void Counter(StringBuilder output, string name, string help, double value) {
+        output.Append(CultureInfo.InvariantCulture, $"# HELP {name} {help}\n# TYPE {name} counter\n{name} {value}\n");
+    }
+
+    private static void Gauge(StringBuilder output, string name, string help, double value) {
+        output.Append(CultureInfo.InvariantCulture, $"# HELP {name} {help}\n# TYPE {name} gauge\n{name} {value}\n");
+    }
+}
@@ -0,0 +1,61 @@
+using System;
+using System.Threading;
+using System.Threading.Channels;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion;
+
+// Last stage of the Discord pipeline: the only place that awaits Pebble
+// WebSocket sends. Every Discord client posts here, so broadcasts leave in the
+// order the reducers produced them, and a slow watch only ever backs up this
+// queue. When it is full the oldest broadcast is dropped; once the queue
+// drains the full state snapshot is sent instead, which covers anything lost.
+public static class PebbleBroadcaster {
+    private const int Capacity = 64;
+
+    private static readonly Channel<Func<Task>> Queue = Channel.CreateBounded<Func<Task>>(
+        new BoundedChannelOptions(Capacity) {
+            FullMode = BoundedChannelFullMode.DropOldest,
+            SingleReader = true,
+        },
+        _ => {
+            Metrics.PipelineDropped(PipelineStage.Broadcast);
+            Interlocked.Exchange(ref _resync, 1);
+        });
+
+    private static int _resync;
+
+    static PebbleBroadcaster() {
+        _ = Task.Run(RunAsync);
+    }
+
+    public static void Post(Func<Task> broadcast) {
+        Metrics.PipelineQueued(PipelineStage.Broadcast);
+        Queue.Writer.TryWrite(broadcast);
+    }
+
+    private static async Task RunAsync() {
+        var reader = Queue.Reader;
+        while (await reader.WaitToReadAsync()) {
+            while (reader.TryRead(out var broadcast)) {
+                Metrics.PipelineDequeued(PipelineStage.Broadcast);
+                try {
+                    await broadcast();
+                }
+                catch (Exception ex) {
+                    Console.WriteLine($"ERROR: Broadcast to Pebble clients failed: {ex.Message}");
+                }
+            }
+
+            if (Interlocked.Exchange(ref _resync, 0) == 1) {
+                Console.WriteLine("INFO: Pebble broadcasts fell behind, resending the full state");
+                try {
+                    await PebbleWSServer.StateSnapshot();
+                }
+                catch (Exception ex) {
+                    Console.WriteLine($"ERROR: State resync failed: {ex.Message}");
+                }
+            }
+        }
+    }
+}
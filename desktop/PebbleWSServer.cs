@@ -1,7 +1,10 @@
 using System;
 using System.Collections.Generic;
+using System.Diagnostics;
 using System.Linq;
 using System.Net;
+using System.Net.NetworkInformation;
+using System.Net.Sockets;
 using System.Net.WebSockets;
 using System.Text;
 using System.Text.Json;
@@ -30,41 +33,145 @@ public class PebbleWSServer {
         }
     }
 
-    // Static method to notify about user number changes
-    public static async Task UserNumberChange(int userNumber) {
-        var message = JsonSerializer.Serialize(new { cmd = "USER_NUMBER_CHANGE", userNumber });
-        await Instance.SendToAllAsync(message);
+    // Channel changes arrive in bursts (30 VOICE_STATE_CREATEs when a meeting
+    // starts), so they are merged into one STATE_UPDATE per window. Mute/deaf
+    // skip the window, see UserVoiceStateUpdate.
+    public static Task UserNumberChange(int userNumber) {
+        return Instance.PublishAsync(state => state with { Users = userNumber },
+            update => update with { Users = userNumber });
     }
 
-    public static async Task LeftChannel() {
-        var message = JsonSerializer.Serialize(new { cmd = "LEFT_CHANNEL" });
-        await Instance.SendToAllAsync(message);
+    public static Task LeftChannel() {
+        return Instance.PublishAsync(state => state with { ChannelName = "", Users = 0 },
+            update => update with { ChannelName = "", Users = 0 });
     }
 
-    public static async Task JoinedChannel(string? channelName, int userNumber) {
-        var message = JsonSerializer.Serialize(new { cmd = "JOINED_CHANNEL", channelName, userNumber });
-        await Instance.SendToAllAsync(message);
+    public static Task JoinedChannel(string? channelName, int userNumber) {
+        return Instance.PublishAsync(state => state with { ChannelName = channelName, Users = userNumber },
+            update => update with { ChannelName = channelName ?? "", Users = userNumber });
     }
 
-    public static async Task UserVoiceStateUpdate(bool mute, bool deaf) {
-        var message = JsonSerializer.Serialize(new { cmd = "USER_VOICE_STATE_UPDATE", mute, deaf });
-        await Instance.SendToAllAsync(message);
+    public static Task ServerNameUpdate(string? serverName) {
+        return Instance.PublishAsync(state => state with { ServerName = serverName },
+            update => update with { ServerName = serverName ?? "" });
     }
-    
-    public static async Task ServerNameUpdate(string? serverName) {
-        var message = JsonSerializer.Serialize(new { cmd = "SERVER_NAME_UPDATE", serverName });
+
+    // Latency critical, sent right away
+    public static async Task UserVoiceStateUpdate(bool mute, bool deaf, long? trace = null) {
+        // A traced press always gets its reply, even if nothing changed
+        if (!Instance.UpdateSnapshot(state => state with { Mute = mute, Deaf = deaf }) && trace == null) {
+            Metrics.SuppressedUpdate();
+            return;
+        }
+
+        var message = JsonSerializer.Serialize(new UserVoiceStateUpdateMessage(mute, deaf) { Trace = trace },
+            PebbleJsonContext.Default.UserVoiceStateUpdateMessage);
         await Instance.SendToAllAsync(message);
+        if (trace != null) {
+            Trace.MarkBroadcast(trace.Value);
+        }
+    }
+
+    // Full state, sent to every client after (re)connecting to Discord and when
+    // the broadcaster has dropped updates. Without a Discord client to follow
+    // there is no state to send, only that the watch isn't in a channel.
+    public static async Task StateSnapshot() {
+        var state = await Rpc.GetInitialState();
+        var encoded = Instance.SetSnapshot(state);
+        // The snapshot already carries anything still waiting in the window. A
+        // window whose flush was dropped must not stay open either, or every
+        // later change would be merged into it and never sent.
+        lock (Instance.coalesceLock) {
+            Instance.pendingUpdate = null;
+        }
+
+        if (encoded == null) {
+            await Instance.SendToAllAsync(JsonSerializer.Serialize(new StateUpdateMessage { ChannelName = "", Users = 0 },
+                PebbleJsonContext.Default.StateUpdateMessage));
+            return;
+        }
+
+        await Instance.SendToAllAsync(encoded);
     }
 
+    // Lost Discord, the cached state no longer reflects reality
+    public static void InvalidateSnapshot() {
+        Instance.SetSnapshot(null);
+    }
+
+    public const int DefaultPort = 5983;
+
     // Rest of your existing code
     private HttpListener httpListener;
     private readonly string prefix;
     private readonly int port;
     private bool isRunning;
     private CancellationTokenSource cancellationTokenSource;
+    // Touched by connection handlers, broadcasts and /metrics at once, so only
+    // under clientsLock. Taken after snapshotLock when both are needed.
+    private readonly Lock clientsLock = new();
     private readonly List<WebSocket> connectedClients = new();
 
-    public PebbleWSServer(int port = 5983, bool localOnly = false) {
+    // Push-to-talk lane: only the latest edge matters, and it is applied by a
+    // dedicated pump so it never waits behind other commands from a client
+    private readonly Lock pttLock = new();
+    private bool pttTalking;
+    private bool pttPumpRunning;
+
+    // Last known full state, kept pre-encoded so a new client gets it the
+    // moment it connects instead of asking for it and waiting a round trip.
+    // Null until Discord has reported voice settings.
+    private readonly Lock snapshotLock = new();
+    private InitialStateMessage? snapshotState;
+    private byte[]? snapshot;
+    private long snapshotVersion;
+
+    // Coalescing window for channel updates, PEBBLE_COMPANION_COALESCE_MS=0 disables it
+    private static readonly TimeSpan CoalesceWindow = TimeSpan.FromMilliseconds(
+        int.TryParse(Environment.GetEnvironmentVariable("PEBBLE_COMPANION_COALESCE_MS"), out var coalesceMs)
+            ? Math.Max(0, coalesceMs)
+            : 100);
+
+    private readonly Lock coalesceLock = new();
+    private readonly SemaphoreSlim broadcastLock = new(1, 1);
+    private StateUpdateMessage? pendingUpdate;
+
+    // Per-connection state
+    private sealed class ClientSession {
+        public long LastPttSeq = -1;
+
+        public readonly TokenBucket Commands = new(ClientCommandBurst, ClientCommandsPerSecond);
+
+        // Latest throttled command of each kind, run once tokens are available again.
+        // Kinds run in the order they were first deferred; a newer command of the
+        // same kind replaces the waiting one but keeps its place.
+        public readonly Lock DeferredLock = new();
+        public readonly Dictionary<string, DeferredCommand> Deferred = new();
+        public readonly Queue<string> DeferredOrder = new();
+        public bool DeferredFlushRunning;
+
+        // Set when the last command was over the limit, so the loop stops reading for a while
+        public bool Throttled;
+    }
+
+    // Desired is the state a set command asks for, so a toggle can flip it while it waits
+    private sealed record DeferredCommand(Func<Task> Run, bool? Desired);
+
+    // Flood protection in front of Discord. A client sending commands in a tight
+    // loop would get the whole RPC client rate limited by Discord and freeze
+    // everyone's controls, so commands that reach Discord need a token from the
+    // client's bucket and from a shared one.
+    private const int ClientCommandBurst = 10;
+    private const int ClientCommandsPerSecond = 5;
+    private static readonly TokenBucket GlobalCommands = new(20, 10);
+    private static readonly TimeSpan ThrottleRetryInterval = TimeSpan.FromMilliseconds(100);
+
+    // The watch asks for a handful of rows at a time; cap what a client can request
+    private const int MaxParticipantsPage = 20;
+
+    public bool IsRunning => isRunning;
+
+    public PebbleWSServer(int port = DefaultPort, bool localOnly = false) {
         this.port = port;
 
         // Choose between localhost only or all interfaces
@@ -112,10 +219,10 @@ public class PebbleWSServer {
         LogMessage("Stopping WebSocket server...");
         cancellationTokenSource?.Cancel();
 
-        int clientCount = connectedClients.Count;
-        LogMessage($"Closing {clientCount} client connection(s)");
+        var clients = GetClients();
+        LogMessage($"Closing {clients.Length} client connection(s)");
 
-        foreach (var client in connectedClients.ToArray()) {
+        foreach (var client in clients) {
             try {
                 LogMessage($"Closing client connection with state: {client.State}");
                 client.CloseAsync(WebSocketCloseStatus.NormalClosure,
@@ -126,7 +233,9 @@ public class PebbleWSServer {
             }
         }
 
-        connectedClients.Clear();
+        lock (clientsLock) {
+            connectedClients.Clear();
+        }
 
         try {
             LogMessage("Stopping HTTP listener");
@@ -147,20 +256,75 @@ public class PebbleWSServer {
             return;
         }
 
+        await SendToAllAsync(Encoding.UTF8.GetBytes(message));
+    }
+
+    // Already encoded messages, such as the cached snapshot, go out without a round trip through string
+    public async Task SendToAllAsync(ReadOnlyMemory<byte> buffer) {
+        if (buffer.IsEmpty) {
+            LogError("Cannot send null or empty message");
+            return;
+        }
+
+        var clients = GetClients();
         // Log first to diagnose if we're reaching this point
+        var preview = Encoding.UTF8.GetString(buffer.Span[..Math.Min(50, buffer.Length)]);
         LogMessage(
-            $"Attempting to send message to {connectedClients.Count} clients: {message.Substring(0, Math.Min(50, message.Length))}{(message.Length > 50 ? "..." : "")}");
+            $"Attempting to send message to {clients.Length} clients: {preview}{(buffer.Length > 50 ? "..." : "")}");
 
-        if (connectedClients.Count == 0) {
+        if (clients.Length == 0) {
             LogMessage("No clients connected, message will not be sent");
             return;
         }
 
-        var buffer = Encoding.UTF8.GetBytes(message);
+        Capture.Record(CaptureSource.Pebble, CaptureDirection.Outbound, buffer);
+        Metrics.Broadcast();
         var deadConnections = new List<WebSocket>();
 
-        // Use ToList() to create a copy of the collection for thread safety
-        foreach (var client in connectedClients.ToList()) {
+        // Coalesced flushes run off the Discord receive loop, so broadcasts can
+        // overlap; a WebSocket only allows one send at a time
+        await broadcastLock.WaitAsync();
+        try {
+            await SendToClientsAsync(clients, buffer, deadConnections);
+        }
+        finally {
+            broadcastLock.Release();
+        }
+
+        // Clean up dead connections
+        if (deadConnections.Count > 0) {
+            LogMessage($"Removing {deadConnections.Count} dead connections");
+            for (var i = 0; i < deadConnections.Count; i++) {
+                Metrics.DroppedSend();
+            }
+
+            // Aborting ends the client's receive loop, whose handler then disposes
+            // the socket. Without it a half-open connection would sit there forever.
+            foreach (var deadClient in deadConnections.Where(c => c != null)) {
+                RemoveClient(deadClient);
+                deadClient.Abort();
+            }
+
+            LogMessage($"Remaining active connections: {GetClients().Length}");
+        }
+    }
+
+    // Replies to one client share the broadcast lock, a WebSocket allows only one send at a time
+    private async Task SendToClientAsync(WebSocket webSocket, byte[] buffer) {
+        Capture.Record(CaptureSource.Pebble, CaptureDirection.Outbound, buffer);
+        await broadcastLock.WaitAsync();
+        try {
+            await webSocket.SendAsync(new ArraySegment<byte>(buffer), WebSocketMessageType.Text, true,
+                CancellationToken.None);
+        }
+        finally {
+            broadcastLock.Release();
+        }
+    }
+
+    private async Task SendToClientsAsync(WebSocket[] clients, ReadOnlyMemory<byte> buffer,
+        List<WebSocket> deadConnections) {
+        foreach (var client in clients) {
             if (client == null) {
                 deadConnections.Add(client);
                 continue;
@@ -169,7 +333,7 @@ public class PebbleWSServer {
             try {
                 if (client.State == WebSocketState.Open) {
                     await client.SendAsync(
-                        new ArraySegment<byte>(buffer),
+                        buffer,
                         WebSocketMessageType.Text,
                         true,
                         CancellationToken.None);
@@ -187,18 +351,167 @@ public class PebbleWSServer {
                 deadConnections.Add(client);
             }
         }
+    }
 
-        // Clean up dead connections
-        if (deadConnections.Count > 0) {
-            LogMessage($"Removing {deadConnections.Count} dead connections");
-            foreach (var deadClient in deadConnections.Where(c => c != null)) {
-                connectedClients.Remove(deadClient);
+    private byte[]? SetSnapshot(InitialStateMessage? state) {
+        var encoded = state == null
+            ? null
+            : JsonSerializer.SerializeToUtf8Bytes(state, PebbleJsonContext.Default.InitialStateMessage);
+        lock (snapshotLock) {
+            snapshotState = state;
+            snapshot = encoded;
+            snapshotVersion++;
+        }
+
+        return encoded;
+    }
+
+    // Applies a change to the snapshot. Returns false when it was a no-op, so
+    // the caller can skip the broadcast; without a snapshot we can't tell and
+    // always publish.
+    private bool UpdateSnapshot(Func<InitialStateMessage, InitialStateMessage> change) {
+        lock (snapshotLock) {
+            if (snapshotState == null) {
+                return true;
+            }
+
+            var updated = change(snapshotState);
+            if (updated == snapshotState) {
+                return false;
             }
 
-            LogMessage($"Remaining active connections: {connectedClients.Count}");
+            snapshotState = updated;
+            snapshot = JsonSerializer.SerializeToUtf8Bytes(snapshotState, PebbleJsonContext.Default.InitialStateMessage);
+            snapshotVersion++;
+            return true;
         }
     }
 
+    // Channel fields: update the snapshot, and publish the diff through the
+    // coalescing window only if something actually changed
+    private Task PublishAsync(Func<InitialStateMessage, InitialStateMessage> change,
+        Func<StateUpdateMessage, StateUpdateMessage> diff) {
+        if (!UpdateSnapshot(change)) {
+            Metrics.SuppressedUpdate();
+            return Task.CompletedTask;
+        }
+
+        return CoalesceAsync(diff);
+    }
+
+    // Merges a change into the pending STATE_UPDATE. The first change of a
+    // window schedules the flush; later ones just overwrite fields. Never
+    // waits for the window, so the Discord receive loop keeps draining events.
+    private Task CoalesceAsync(Func<StateUpdateMessage, StateUpdateMessage> change) {
+        bool startWindow;
+        lock (coalesceLock) {
+            startWindow = pendingUpdate == null;
+            if (!startWindow) {
+                Metrics.CoalescedUpdate();
+            }
+
+            pendingUpdate = change(pendingUpdate ?? new StateUpdateMessage());
+        }
+
+        if (!startWindow) {
+            return Task.CompletedTask;
+        }
+
+        if (CoalesceWindow == TimeSpan.Zero) {
+            return FlushCoalescedAsync();
+        }
+
+        // The flush goes through the broadcaster like any other send, so it keeps
+        // its place among the broadcasts and never writes to a socket alongside them.
+        // If it is dropped there, the resync that follows closes the window.
+        _ = Task.Delay(CoalesceWindow).ContinueWith(_ => PebbleBroadcaster.Post(FlushCoalescedAsync),
+            TaskScheduler.Default);
+        return Task.CompletedTask;
+    }
+
+    private async Task FlushCoalescedAsync() {
+        StateUpdateMessage? update;
+        lock (coalesceLock) {
+            update = pendingUpdate;
+            pendingUpdate = null;
+        }
+
+        if (update == null) {
+            return;
+        }
+
+        try {
+            await SendToAllAsync(JsonSerializer.Serialize(update, PebbleJsonContext.Default.StateUpdateMessage));
+        }
+        catch (Exception ex) {
+            LogError($"Error sending coalesced state update: {ex.Message}", ex);
+        }
+    }
+
+    // Sends the current snapshot before the client joins the broadcast list, so
+    // the two never write to the socket at the same time. If the state changed
+    // while sending, the newer snapshot is sent before joining. The address list
+    // follows the first snapshot; it is not latency critical.
+    private async Task AddClientWithSnapshotAsync(WebSocket webSocket) {
+        var addressesSent = false;
+        while (true) {
+            byte[]? current;
+            long version;
+            lock (snapshotLock) {
+                current = snapshot;
+                version = snapshotVersion;
+            }
+
+            if (current != null) {
+                Capture.Record(CaptureSource.Pebble, CaptureDirection.Outbound, current);
+                await webSocket.SendAsync(new ArraySegment<byte>(current), WebSocketMessageType.Text, true,
+                    cancellationTokenSource.Token);
+            }
+
+            if (!addressesSent) {
+                addressesSent = true;
+                var addresses = JsonSerializer.SerializeToUtf8Bytes(
+                    new ServerAddressesMessage(GetLocalIPAddresses(), port),
+                    PebbleJsonContext.Default.ServerAddressesMessage);
+                await webSocket.SendAsync(new ArraySegment<byte>(addresses), WebSocketMessageType.Text, true,
+                    cancellationTokenSource.Token);
+            }
+
+            lock (snapshotLock) {
+                if (version == snapshotVersion) {
+                    lock (clientsLock) {
+                        connectedClients.Add(webSocket);
+                    }
+                    return;
+                }
+            }
+        }
+    }
+
+    // LAN addresses shown in the window and advertised to the phone
+    public static List<string> GetLocalIPAddresses() {
+        var addresses = new List<string>();
+        
+        // Get all network interfaces
+        var networkInterfaces = NetworkInterface.GetAllNetworkInterfaces()
+            .Where(ni => ni.OperationalStatus == OperationalStatus.Up && 
+                  (ni.NetworkInterfaceType == NetworkInterfaceType.Wireless80211 || 
+                   ni.NetworkInterfaceType == NetworkInterfaceType.Ethernet));
+                   
+        foreach (var networkInterface in networkInterfaces) {
+            var properties = networkInterface.GetIPProperties();
+            
+            // Get IPv4 addresses
+            foreach (var address in properties.UnicastAddresses) {
+                if (address.Address.AddressFamily == AddressFamily.InterNetwork) {
+                    addresses.Add(address.Address.ToString());
+                }
+            }
+        }
+        
+        return addresses;
+    }
+
     private async Task AcceptConnectionsLoopAsync() {
         LogMessage("Started connection acceptance loop");
         while (isRunning && !cancellationTokenSource.Token.IsCancellationRequested) {
@@ -211,13 +524,8 @@ public class PebbleWSServer {
                     _ = HandleWebSocketConnectionAsync(context);
                 }
                 else {
-                    LogMessage("Received non-WebSocket HTTP request");
-                    await using var writer = new System.IO.StreamWriter(context.Response.OutputStream);
-                    context.Response.StatusCode = 200;
-                    context.Response.ContentType = "text/plain";
-                    await writer.WriteAsync(
-                        "Pebble WebSocket server is running. Use a WebSocket connection to connect.");
-                    context.Response.Close();
+                    LogMessage($"Received non-WebSocket HTTP request for {context.Request.Url?.AbsolutePath}");
+                    await RespondToHttpRequestAsync(context);
                     LogMessage("Responded to HTTP request");
                 }
             }
@@ -237,6 +545,35 @@ public class PebbleWSServer {
         LogMessage("Exiting connection acceptance loop");
     }
 
+    // Plain HTTP requests get the Prometheus metrics, a health check, or a hint to use WebSockets
+    private async Task RespondToHttpRequestAsync(HttpListenerContext context) {
+        string body;
+        switch (context.Request.Url?.AbsolutePath) {
+            case "/metrics":
+                context.Response.StatusCode = 200;
+                context.Response.ContentType = "text/plain; version=0.0.4";
+                body = Metrics.Render(GetClients().Length);
+                break;
+            case "/healthz":
+                // Healthy means the bridge can actually reach Discord
+                context.Response.StatusCode = Rpc.IsAuthenticated ? 200 : 503;
+                context.Response.ContentType = "text/plain";
+                body = Rpc.IsAuthenticated ? "ok\n" : "discord rpc not authenticated\n";
+                break;
+            default:
+                context.Response.StatusCode = 200;
+                context.Response.ContentType = "text/plain";
+                body = "Pebble WebSocket server is running. Use a WebSocket connection to connect.";
+                break;
+        }
+
+        await using (var writer = new System.IO.StreamWriter(context.Response.OutputStream)) {
+            await writer.WriteAsync(body);
+        }
+
+        context.Response.Close();
+    }
+
     private async Task HandleWebSocketConnectionAsync(HttpListenerContext context) {
         WebSocket webSocket = null;
 
@@ -245,9 +582,9 @@ public class PebbleWSServer {
             WebSocketContext webSocketContext = await context.AcceptWebSocketAsync(subProtocol: null);
             webSocket = webSocketContext.WebSocket;
 
-            connectedClients.Add(webSocket);
+            await AddClientWithSnapshotAsync(webSocket);
             LogMessage(
-                $"WebSocket client connected successfully from {context.Request.RemoteEndPoint}, total clients: {connectedClients.Count}");
+                $"WebSocket client connected successfully from {context.Request.RemoteEndPoint}, total clients: {GetClients().Length}");
 
             await HandleClientMessagesAsync(webSocket, context.Request.RemoteEndPoint);
         }
@@ -257,17 +594,36 @@ public class PebbleWSServer {
             context.Response.Close();
         }
         finally {
-            if (webSocket != null && connectedClients.Contains(webSocket)) {
-                connectedClients.Remove(webSocket);
-                LogMessage(
-                    $"WebSocket client {context.Request.RemoteEndPoint} disconnected, remaining clients: {connectedClients.Count}");
+            if (webSocket != null) {
+                if (RemoveClient(webSocket)) {
+                    LogMessage(
+                        $"WebSocket client {context.Request.RemoteEndPoint} disconnected, remaining clients: {GetClients().Length}");
+                }
+
+                // Frees the socket's buffers; nothing else holds it once it's out of the list
+                webSocket.Dispose();
             }
+
+            context.Response.Abort();
+        }
+    }
+
+    private WebSocket[] GetClients() {
+        lock (clientsLock) {
+            return connectedClients.ToArray();
+        }
+    }
+
+    private bool RemoveClient(WebSocket webSocket) {
+        lock (clientsLock) {
+            return connectedClients.Remove(webSocket);
         }
     }
 
     private async Task HandleClientMessagesAsync(WebSocket webSocket, IPEndPoint clientEndpoint) {
         var buffer = new byte[4096];
         var receiveBuffer = new ArraySegment<byte>(buffer);
+        var session = new ClientSession();
 
         try {
             LogMessage($"Starting message loop for client {clientEndpoint}");
@@ -279,34 +635,46 @@ public class PebbleWSServer {
                 if (result.MessageType == WebSocketMessageType.Text) {
                     string message = Encoding.UTF8.GetString(buffer, 0, result.Count);
                     LogMessage($"Received message from {clientEndpoint}: {message}");
+                    Capture.Record(CaptureSource.Pebble, CaptureDirection.Inbound, message);
 
+                    var started = Stopwatch.GetTimestamp();
+                    var command = message;
                     try {
                         switch (message) {
                             case "mute":
                                 LogMessage("Processing mute command");
-                                await Rpc.ToggleMute();
+                                await RunToggleAsync(session, "mute", Rpc.ToggleMute, mute => Rpc.SetMute(mute));
                                 break;
                             case "deafen":
                                 LogMessage("Processing deafen command");
-                                await Rpc.ToggleDeafen();
+                                await RunToggleAsync(session, "deafen", Rpc.ToggleDeafen, Rpc.SetDeafen);
                                 break;
                             case "getInitialState":
+                                // The snapshot is pushed on connect; this is for older phone apps that still ask
                                 LogMessage("Processing getInitialState command");
-                                var state = await Rpc.GetInitialState();
-                                // Convert to JSON string
-                                var json = JsonSerializer.Serialize(state);
-                                var bfr = Encoding.UTF8.GetBytes(json);
-                                await webSocket.SendAsync(
-                                    new ArraySegment<byte>(bfr),
-                                    WebSocketMessageType.Text,
-                                    true,
-                                    CancellationToken.None);
+                                byte[]? bfr;
+                                lock (snapshotLock) {
+                                    bfr = snapshot;
+                                }
+
+                                // No snapshot until Discord has answered: build what we have, and
+                                // without a Discord client answer with an empty state rather than nothing
+                                bfr ??= JsonSerializer.SerializeToUtf8Bytes(
+                                    await Rpc.GetInitialState() ?? new InitialStateMessage(false, false, null, 0, null),
+                                    PebbleJsonContext.Default.InitialStateMessage);
+                                await SendToClientAsync(webSocket, bfr);
                                 break;
                             case "leaveChannel":
                                 LogMessage("Processing leaveChannel command");
-                                await Rpc.LeaveChannel();
+                                await RunLimitedAsync(session, "leaveChannel", Rpc.LeaveChannel, coalesce: true);
                                 break;
                             default:
+                                command = "unknown";
+                                if (message.StartsWith('{')) {
+                                    command = await HandleJsonCommandAsync(message, webSocket, session);
+                                    break;
+                                }
+
                                 LogMessage($"Unknown command: {message}");
                                 break;
                         }
@@ -314,6 +682,17 @@ public class PebbleWSServer {
                     catch (Exception ex) {
                         LogError($"Error processing command '{message}': {ex.Message}", ex);
                     }
+
+                    Metrics.Command(command).ObserveSince(started);
+
+                    // A client over its limit is read no faster than its tokens come back. Throttled
+                    // commands finish synchronously, so a flooding client would otherwise keep this
+                    // loop spinning on a pool thread, and on a one or two core box starve every
+                    // other client; pausing lets the socket push back on the flooder instead.
+                    if (session.Throttled) {
+                        session.Throttled = false;
+                        await Task.Delay(ThrottleRetryInterval, cancellationTokenSource.Token);
+                    }
                 }
                 else if (result.MessageType == WebSocketMessageType.Close) {
                     LogMessage($"Received close message from {clientEndpoint}");
@@ -335,6 +714,12 @@ public class PebbleWSServer {
             LogError($"Error handling WebSocket messages from {clientEndpoint}: {ex.Message}", ex);
         }
         finally {
+            // Commands still deferred for this client go with it
+            lock (session.DeferredLock) {
+                session.Deferred.Clear();
+                session.DeferredOrder.Clear();
+            }
+
             try {
                 if (webSocket.State != WebSocketState.Closed) {
                     LogMessage($"Closing WebSocket connection to {clientEndpoint}, current state: {webSocket.State}");
@@ -350,6 +735,218 @@ public class PebbleWSServer {
         }
     }
 
+    // Commands that carry arguments are sent as JSON objects: { "cmd": "...", ... }
+    // Returns the command name for metrics
+    private async Task<string> HandleJsonCommandAsync(string message, WebSocket webSocket, ClientSession session) {
+        using var document = JsonDocument.Parse(message);
+        var root = document.RootElement;
+        var cmd = root.GetProperty("cmd").GetString();
+
+        switch (cmd) {
+            case "setMute":
+                var mute = root.GetProperty("value").GetBoolean();
+                long? trace = root.TryGetProperty("trace", out var traceElement) ? traceElement.GetInt64() : null;
+                if (trace != null) {
+                    Trace.Begin(trace.Value);
+                }
+
+                LogMessage($"Processing setMute command: {mute}");
+                await RunLimitedAsync(session, "mute", () => Rpc.SetMute(mute, trace), coalesce: true, desired: mute);
+                break;
+            case "setDeafen":
+                var deaf = root.GetProperty("value").GetBoolean();
+                LogMessage($"Processing setDeafen command: {deaf}");
+                await RunLimitedAsync(session, "deafen", () => Rpc.SetDeafen(deaf), coalesce: true, desired: deaf);
+                break;
+            case "ptt":
+                QueuePttEdge(session, root.GetProperty("talking").GetBoolean(), root.GetProperty("seq").GetInt64());
+                break;
+            case "getParticipants":
+                // Answered from the local roster, Discord isn't involved
+                var offset = root.GetProperty("offset").GetInt32();
+                var count = Math.Min(root.GetProperty("count").GetInt32(), MaxParticipantsPage);
+                var (total, version, page) = Rpc.Participants.GetPage(offset, count);
+                await SendToClientAsync(webSocket, JsonSerializer.SerializeToUtf8Bytes(
+                    new ParticipantsMessage(offset, total, version,
+                        page.Select(p => p.Name).ToList(),
+                        page.Select(p => p.Volume).ToList()),
+                    PebbleJsonContext.Default.ParticipantsMessage));
+                break;
+            case "setUserVolume":
+                var userId = Rpc.Participants.GetUserId(root.GetProperty("row").GetInt32(),
+                    root.GetProperty("version").GetInt32());
+                if (userId == null) {
+                    // Someone joined or left since the watch fetched its rows
+                    LogMessage("Ignoring setUserVolume for a stale participant row");
+                    break;
+                }
+
+                var volume = Math.Clamp(root.GetProperty("volume").GetInt32(), 0, 200);
+                await RunLimitedAsync(session, "volume:" + userId, () => Rpc.SetUserVolume(userId, volume),
+                    coalesce: true);
+                break;
+            case "traceReport":
+                Trace.Complete(root.GetProperty("trace").GetInt64(),
+                    root.GetProperty("watchDebounceMs").GetDouble(),
+                    root.GetProperty("watchRttMs").GetDouble(),
+                    root.GetProperty("phoneMs").GetDouble(),
+                    root.GetProperty("wsRttMs").GetDouble());
+                break;
+            default:
+                LogMessage($"Unknown command: {cmd}");
+                return "unknown";
+        }
+
+        return cmd;
+    }
+
+    private static bool TryAdmitCommand(ClientSession session) {
+        if (!session.Commands.TryTake()) {
+            return false;
+        }
+
+        if (!GlobalCommands.TryTake()) {
+            session.Commands.Refund();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Runs a command that reaches Discord if the rate limits allow it. Otherwise
+    // idempotent commands (set state, leave) are deferred, keeping only the
+    // latest of each kind, so a flood collapses into the final desired state.
+    // Toggles can't be collapsed that way and are dropped.
+    private async Task RunLimitedAsync(ClientSession session, string kind, Func<Task> command, bool coalesce,
+        bool? desired = null) {
+        bool admitted;
+        var startFlush = false;
+        lock (session.DeferredLock) {
+            // Once something of this kind is waiting, newer ones queue behind it to keep their order
+            admitted = !session.Deferred.ContainsKey(kind) && TryAdmitCommand(session);
+            if (!admitted) {
+                session.Throttled = true;
+                Metrics.ThrottledCommand(coalesce);
+                if (coalesce) {
+                    if (!session.Deferred.ContainsKey(kind)) {
+                        session.DeferredOrder.Enqueue(kind);
+                    }
+
+                    session.Deferred[kind] = new DeferredCommand(command, desired);
+                    startFlush = !session.DeferredFlushRunning;
+                    session.DeferredFlushRunning = true;
+                }
+            }
+        }
+
+        if (admitted) {
+            await command();
+        }
+        else if (!coalesce) {
+            LogMessage($"Rate limit hit, dropping {kind} command");
+        }
+        else if (startFlush) {
+            LogMessage($"Rate limit hit, deferring {kind} command");
+            _ = Task.Run(() => FlushDeferredAsync(session));
+        }
+    }
+
+    // Toggles read the current state when they run, so they can't wait in line.
+    // But while a set of the same setting is deferred, running the toggle first
+    // would be undone by the set; flip the waiting set's target instead.
+    private async Task RunToggleAsync(ClientSession session, string kind, Func<Task> toggle, Func<bool, Task> set) {
+        lock (session.DeferredLock) {
+            if (session.Deferred.TryGetValue(kind, out var waiting) && waiting.Desired is { } desired) {
+                session.Throttled = true;
+                Metrics.ThrottledCommand(true);
+                session.Deferred[kind] = new DeferredCommand(() => set(!desired), !desired);
+                LogMessage($"Rate limit hit, folding {kind} toggle into the deferred command");
+                return;
+            }
+        }
+
+        await RunLimitedAsync(session, kind, toggle, coalesce: false);
+    }
+
+    private async Task FlushDeferredAsync(ClientSession session) {
+        while (true) {
+            await Task.Delay(ThrottleRetryInterval);
+
+            DeferredCommand next;
+            lock (session.DeferredLock) {
+                if (session.Deferred.Count == 0) {
+                    session.DeferredFlushRunning = false;
+                    return;
+                }
+
+                if (!TryAdmitCommand(session)) {
+                    continue;
+                }
+
+                var kind = session.DeferredOrder.Dequeue();
+                next = session.Deferred[kind];
+                session.Deferred.Remove(kind);
+            }
+
+            try {
+                await next.Run();
+            }
+            catch (Exception ex) {
+                LogError($"Error running deferred command: {ex.Message}", ex);
+            }
+        }
+    }
+
+    private void QueuePttEdge(ClientSession session, bool talking, long seq) {
+        lock (pttLock) {
+            if (seq <= session.LastPttSeq) {
+                LogMessage($"Dropping stale push-to-talk edge {seq}");
+                return;
+            }
+
+            session.LastPttSeq = seq;
+            pttTalking = talking;
+            if (pttPumpRunning) {
+                return;
+            }
+
+            pttPumpRunning = true;
+        }
+
+        _ = Task.Run(PumpPttAsync);
+    }
+
+    private async Task PumpPttAsync() {
+        bool? applied = null;
+        while (true) {
+            bool talking;
+            lock (pttLock) {
+                if (applied == pttTalking) {
+                    pttPumpRunning = false;
+                    return;
+                }
+
+                talking = pttTalking;
+            }
+
+            // Throttled: wait, then apply whatever the latest edge is by then
+            if (!GlobalCommands.TryTake()) {
+                Metrics.ThrottledCommand(coalesced: true);
+                await Task.Delay(ThrottleRetryInterval);
+                continue;
+            }
+
+            try {
+                await Rpc.SetMute(!talking);
+            }
+            catch (Exception ex) {
+                LogError($"Failed to apply push-to-talk edge: {ex.Message}", ex);
+            }
+
+            applied = talking;
+        }
+    }
+
     private void LogMessage(string message) {
         string timestamp = DateTime.Now.ToString("yyyy-MM-dd HH:mm:ss.fff");
         Console.WriteLine($"[{timestamp}] [PebbleWS] {message}");
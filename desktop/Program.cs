@@ -1,5 +1,6 @@
 ﻿using Avalonia;
 using System;
+using System.Runtime.CompilerServices;
 
 namespace Pebble_Companion;
 
@@ -8,7 +9,20 @@ class Program {
     // SynchronizationContext-reliant code before AppMain is called: things aren't initialized
     // yet and stuff might break.
     [STAThread]
-    public static void Main(string[] args) => BuildAvaloniaApp()
+    public static int Main(string[] args) {
+        Capture.Configure(args);
+
+        // --headless runs just the RPC bridge and WebSocket server, no UI stack
+        if (Array.IndexOf(args, "--headless") >= 0) {
+            return HeadlessHost.RunAsync(args).GetAwaiter().GetResult();
+        }
+
+        return RunDesktop(args);
+    }
+
+    // Kept out of Main so the headless path never has to load Avalonia
+    [MethodImpl(MethodImplOptions.NoInlining)]
+    private static int RunDesktop(string[] args) => BuildAvaloniaApp()
         .StartWithClassicDesktopLifetime(args);
 
     // Avalonia configuration, don't remove; also used by visual designer.
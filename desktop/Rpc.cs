@@ -1,7 +1,6 @@
 using System;
 using System.Collections.Generic;
 using System.Linq;
-using System.Net.WebSockets;
 using System.Text;
 using System.Text.Json;
 using System.Threading;
@@ -9,193 +8,315 @@ using System.Threading.Tasks;
 
 namespace Pebble_Companion;
 
+// Entry point for everything Discord. Stable, PTB and Canary can run side by
+// side, each with its own RPC port and IPC socket, so this holds a connection
+// to every client it finds and follows the one that is in a call. Watch commands go to that
+// client, and when it exits the next best one takes over right away.
 public class Rpc {
-    private static ClientWebSocket? _ws;
+    internal const string ClientId = "207646673902501888";
+    // Discord listens on the first free port in this range. The range and the
+    // token endpoint can be overridden to point the bridge at local stand-ins
+    // for Discord, e.g. PEBBLE_COMPANION_RPC_PORTS=7463-7465
+    private static readonly (int First, int Last) RpcPorts = ParsePortRange(
+        Environment.GetEnvironmentVariable("PEBBLE_COMPANION_RPC_PORTS"), 6463, 6472);
+    private static readonly int FirstRpcPort = RpcPorts.First;
+    private static readonly int LastRpcPort = RpcPorts.Last;
+    // auto (the default) uses the IPC socket when Discord has one and falls
+    // back to the WebSocket; ipc or websocket forces one of them
+    private static readonly RpcTransportKind? Transport =
+        ParseTransport(Environment.GetEnvironmentVariable("PEBBLE_COMPANION_RPC_TRANSPORT"));
+    private static readonly string TokenUrl =
+        Environment.GetEnvironmentVariable("PEBBLE_COMPANION_TOKEN_URL") ?? "https://streamkit.discord.com/overlay/token";
+    private static readonly TimeSpan ConnectTimeout = TimeSpan.FromSeconds(2);
+    private static readonly TimeSpan InitialBackoff = TimeSpan.FromSeconds(1);
+    private static readonly TimeSpan MaxBackoff = TimeSpan.FromSeconds(30);
+    // While connected, how often to look for clients started since
+    private static readonly TimeSpan ProbeInterval = TimeSpan.FromSeconds(15);
+    private static readonly System.Net.Http.HttpClient HttpClient = new();
+
+    private static readonly Lock ClientsLock = new();
+    private static readonly List<RpcClient> Clients = [];
+    private static readonly Lock ElectionLock = new();
+    private static readonly SemaphoreSlim ClientExited = new(0);
+    private static readonly VoiceRoster EmptyRoster = new();
+    private static RpcClient? _active;
+    private static RpcClient? _replayClient;
+
     private static string? _accessToken;
-    private static JsonElement _voiceSettings;
-    private static JsonElement _voiceChannel;
-    private static string? _currentVoiceChannelId;
-    private static int _voiceChannelUserCount;
-    private static string? _currentServerName;
-    private static bool _dmChannel;
-
-    public static async Task Connect() {
-        _ws = new ClientWebSocket();
-        _ws.Options.SetRequestHeader("Origin", "http://localhost:3000");
-        await _ws.ConnectAsync(new Uri("ws://127.0.0.1:6463/?v=1&encoding=json&client_id=207646673902501888"),
-            CancellationToken.None);
-
-        // Start receiving messages after connection
-        _ = ReceiveMessagesAsync();
-    }
 
-    private static async Task GetAccessTokenStage1() {
-        var payload = new {
-            cmd = "AUTHORIZE",
-            args = new {
-                client_id = "207646673902501888",
-                scopes = new[] { "rpc" },
-                prompt = "none"
-            },
-            nonce = Guid.NewGuid().ToString("N"),
-        };
-        var buffer = Encoding.UTF8.GetBytes(JsonSerializer.Serialize(payload));
-        await _ws?.SendAsync(new ArraySegment<byte>(buffer), WebSocketMessageType.Text, true, CancellationToken.None)!;
-    }
+    internal static string? AccessToken => _accessToken;
 
-    private static async Task GetAccessTokenStage2(string code) {
-        const string url = "https://streamkit.discord.com/overlay/token";
-        var payload = new { code };
-        var request = new System.Net.Http.HttpRequestMessage(System.Net.Http.HttpMethod.Post, url);
-        request.Content = new System.Net.Http.StringContent(JsonSerializer.Serialize(payload),
-            Encoding.UTF8, "application/json");
-        var response = await new System.Net.Http.HttpClient().SendAsync(request);
-        var responseContent = await response.Content.ReadAsStringAsync();
-        var responseJson = JsonDocument.Parse(responseContent).RootElement;
-        _accessToken = responseJson.GetProperty("access_token").GetString();
-        if (_accessToken == null) {
-            Console.WriteLine("Failed to get access token");
-            return;
+    public static bool IsAuthenticated {
+        get {
+            lock (ClientsLock) {
+                return Clients.Any(client => client.IsAuthenticated);
+            }
         }
-
-        await Authenticate();
     }
 
-    private static async Task Authenticate() {
-        var payload = new {
-            cmd = "AUTHENTICATE",
-            args = new {
-                access_token = _accessToken,
-            },
-            nonce = Guid.NewGuid().ToString("N"),
-        };
-        var buffer = Encoding.UTF8.GetBytes(JsonSerializer.Serialize(payload));
-        await _ws!.SendAsync(new ArraySegment<byte>(buffer), WebSocketMessageType.Text, true, CancellationToken.None);
+    public static int ClientCount {
+        get {
+            lock (ClientsLock) {
+                return Clients.Count;
+            }
+        }
     }
 
-    private static async Task SubscribeToEvents() {
-        await SendSubscription("VOICE_CHANNEL_SELECT");
-        await SendSubscription("VOICE_SETTINGS_UPDATE");
+    // Participants of the followed client's channel
+    public static VoiceRoster Participants => _active?.Participants ?? EmptyRoster;
+
+    internal static bool IsActive(RpcClient client) {
+        return _active == client;
     }
 
-    public static async Task ToggleMute() {
-        if (_voiceSettings.ValueKind == JsonValueKind.Undefined) {
-            Console.WriteLine("Voice settings not available yet");
-            return;
+    // Connection supervisor: probes the whole port range until cancelled, backing
+    // off exponentially while no Discord client is reachable
+    public static async Task RunAsync(CancellationToken cancellationToken = default) {
+        var cachedTokens = TokenStore.Load();
+        if (cachedTokens != null) {
+            LogMessage("Using cached access token");
+            _accessToken = cachedTokens.AccessToken;
         }
 
-        //set to opposite of current mute state
-        await SendCommand("SET_VOICE_SETTINGS", new {
-            mute = !_voiceSettings.GetProperty("mute").GetBoolean(),
-        });
+        var backoff = InitialBackoff;
+        while (!cancellationToken.IsCancellationRequested) {
+            try {
+                await ProbeAsync(cancellationToken);
+            }
+            catch (Exception ex) when (ex is not OperationCanceledException) {
+                LogError($"RPC connection failed: {ex.Message}", ex);
+            }
+
+            int connected;
+            lock (ClientsLock) {
+                connected = Clients.Count;
+            }
+
+            if (connected > 0) {
+                backoff = InitialBackoff;
+                // Woken early when a client exits, so the range is probed again soon
+                await ClientExited.WaitAsync(ProbeInterval, cancellationToken);
+                continue;
+            }
+
+            Metrics.RpcReconnect();
+            LogMessage($"Reconnecting to Discord in {backoff.TotalSeconds}s");
+            await Task.Delay(backoff, cancellationToken);
+            backoff = TimeSpan.FromTicks(Math.Min(backoff.Ticks * 2, MaxBackoff.Ticks));
+        }
     }
 
-    public static async Task ToggleDeafen() {
-        if (_voiceSettings.ValueKind == JsonValueKind.Undefined) {
-            Console.WriteLine("Voice settings not available yet");
-            return;
+    // Tries every socket or port without a connection at once, so finding the
+    // clients takes one connect timeout instead of one per endpoint. Each
+    // Discord client serves both transports, so once connected the bridge
+    // sticks to that transport to never hold the same client twice.
+    private static async Task ProbeAsync(CancellationToken cancellationToken) {
+        HashSet<string> held;
+        RpcTransportKind? inUse;
+        lock (ClientsLock) {
+            held = Clients.Select(client => client.Endpoint).ToHashSet();
+            inUse = Clients.Select(client => client.Kind).FirstOrDefault(kind => kind != null);
         }
 
-        //set to opposite of current mute state
-        await SendCommand("SET_VOICE_SETTINGS", new {
-            deaf = !_voiceSettings.GetProperty("deaf").GetBoolean(),
-        });
+        List<RpcClient> found = [];
+        if (inUse != RpcTransportKind.WebSocket && Transport != RpcTransportKind.WebSocket) {
+            found = await ConnectAllAsync(IpcTransport.FindSockets()
+                .Where(path => !held.Contains(path))
+                .Select(path => IpcTransport.TryConnectAsync(path, ConnectTimeout, cancellationToken)));
+        }
+
+        if (found.Count == 0 && inUse != RpcTransportKind.Ipc && Transport != RpcTransportKind.Ipc) {
+            found = await ConnectAllAsync(Enumerable.Range(FirstRpcPort, LastRpcPort - FirstRpcPort + 1)
+                .Where(port => !held.Contains($"port {port}"))
+                .Select(port => WebSocketTransport.TryConnectAsync(port, ConnectTimeout, cancellationToken)));
+        }
+
+        if (found.Count == 0 && held.Count == 0) {
+            LogMessage($"No Discord client found on an IPC socket or on ports {FirstRpcPort}-{LastRpcPort}");
+        }
+
+        foreach (var client in found) {
+            LogMessage($"Connected to Discord RPC on {client.Endpoint}");
+            lock (ClientsLock) {
+                Clients.Add(client);
+            }
+
+            _ = RunClientAsync(client, cancellationToken);
+        }
     }
 
-    public static async Task LeaveChannel() {
-        await SendCommand("SELECT_VOICE_CHANNEL", new { channel_id = (string)null!, force = true });
+    private static async Task<List<RpcClient>> ConnectAllAsync(IEnumerable<Task<IRpcTransport?>> attempts) {
+        var transports = await Task.WhenAll(attempts);
+        return transports.OfType<IRpcTransport>().Select(transport => new RpcClient(transport)).ToList();
     }
 
+    private static async Task RunClientAsync(RpcClient client, CancellationToken cancellationToken) {
+        try {
+            await client.RunAsync(cancellationToken);
+        }
+        finally {
+            client.Close();
+            lock (ClientsLock) {
+                Clients.Remove(client);
+            }
 
-    public static async Task<JsonElement> GetInitialState() {
-        if (_voiceSettings.ValueKind == JsonValueKind.Undefined) {
-            Console.WriteLine("Voice settings not available yet");
-            return new JsonElement();
+            LogMessage($"Discord client on {client.Endpoint} went away");
+            Elect();
+            ClientExited.Release();
         }
+    }
 
-        // Get mute and deafen state from voice settings
-        var muteSetting = _voiceSettings.GetProperty("mute").GetBoolean();
-        var deafSetting = _voiceSettings.GetProperty("deaf").GetBoolean();
+    // Picks the client the watch follows: the one in a call (the most recent
+    // call if several are), else the current one while it's still around, else
+    // any ready client. On a change the watch gets the new client's full state,
+    // queued behind whatever the previous client already posted.
+    // Returns true if the followed client changed.
+    internal static bool Elect() {
+        lock (ElectionLock) {
+            List<RpcClient> ready;
+            lock (ClientsLock) {
+                ready = Clients.Where(client => client.IsReady).ToList();
+            }
 
-        // Default values for channel properties
-        var channelName = "";
-        object users = "";
-        var serverName = "";
+            var previous = _active;
+            var inVoice = ready.Where(client => client.InVoiceChannel).ToList();
+            RpcClient? next;
+            if (inVoice.Count > 0) {
+                next = inVoice.MaxBy(client => client.JoinedVoiceAt);
+            }
+            else if (previous != null && ready.Contains(previous)) {
+                next = previous;
+            }
+            else {
+                next = ready.FirstOrDefault();
+            }
 
-        // Update channel properties if voice channel is available
-        if (_voiceChannel.ValueKind != JsonValueKind.Undefined) {
-            channelName = _voiceChannel.GetProperty("name").GetString();
-            users = _voiceChannelUserCount;
-            serverName = _currentServerName;
-        }
+            if (next == previous) {
+                return false;
+            }
 
-        // Create a single state object with all properties
-        var state = new {
-            cmd = "GET_INITIAL_STATE",
-            mute = muteSetting,
-            deaf = deafSetting,
-            channelName,
-            users,
-            serverName
-        };
-
-        // Convert to JsonElement and return
-        var jsonString = JsonSerializer.Serialize(state);
-        return JsonDocument.Parse(jsonString).RootElement;
+            _active = next;
+            if (next != null) {
+                LogMessage($"Following the Discord client on {next.Endpoint}");
+                PebbleBroadcaster.Post(PebbleWSServer.StateSnapshot);
+            }
+            else {
+                // Discord is gone. The cache goes right away, the broadcaster may
+                // drop what is posted to it; the watch should stop showing the
+                // old channel.
+                PebbleWSServer.InvalidateSnapshot();
+                if (previous?.InVoiceChannel == true) {
+                    PebbleBroadcaster.Post(PebbleWSServer.LeftChannel);
+                }
+            }
+
+            return true;
+        }
     }
 
-    private static async Task SendSubscription(string evt, object? args = null) {
-        var payload = new {
-            cmd = "SUBSCRIBE",
-            evt,
-            args,
-            nonce = Guid.NewGuid().ToString("N"),
-        };
+    private static (int First, int Last) ParsePortRange(string? value, int defaultFirst, int defaultLast) {
+        if (string.IsNullOrEmpty(value)) {
+            return (defaultFirst, defaultLast);
+        }
+
+        var parts = value.Split('-', 2);
+        if (int.TryParse(parts[0], out var first)) {
+            var last = first;
+            if (parts.Length == 1 || int.TryParse(parts[1], out last)) {
+                if (first <= last) {
+                    return (first, last);
+                }
+            }
+        }
 
-        var buffer = Encoding.UTF8.GetBytes(JsonSerializer.Serialize(payload));
-        await _ws!.SendAsync(new ArraySegment<byte>(buffer), WebSocketMessageType.Text, true, CancellationToken.None);
+        Console.WriteLine($"ERROR: Invalid RPC port range '{value}', using {defaultFirst}-{defaultLast}");
+        return (defaultFirst, defaultLast);
     }
 
-    private static async Task SendCommand(string cmd, object? args = null) {
-        var payload = new {
-            cmd,
-            args,
-            nonce = Guid.NewGuid().ToString("N"),
-        };
+    private static RpcTransportKind? ParseTransport(string? value) {
+        switch (value?.ToLowerInvariant()) {
+            case null or "" or "auto":
+                return null;
+            case "ipc":
+                return RpcTransportKind.Ipc;
+            case "websocket":
+                return RpcTransportKind.WebSocket;
+            default:
+                Console.WriteLine($"ERROR: Invalid RPC transport '{value}', using auto");
+                return null;
+        }
+    }
+
+    // The token belongs to the user, not to a Discord client, so all connections share it
+    internal static async Task<string?> ExchangeCodeAsync(string code) {
+        var url = TokenUrl;
+        var payload = new TokenExchangeRequest(code);
+        using var request = new System.Net.Http.HttpRequestMessage(System.Net.Http.HttpMethod.Post, url);
+        request.Content = new System.Net.Http.StringContent(
+            JsonSerializer.Serialize(payload, DiscordJsonContext.Default.TokenExchangeRequest),
+            Encoding.UTF8, "application/json");
+        using var response = await HttpClient.SendAsync(request);
+        var responseContent = await response.Content.ReadAsStringAsync();
+        using var responseJson = JsonDocument.Parse(responseContent);
+        var root = responseJson.RootElement;
+        var accessToken = root.TryGetProperty("access_token", out var token) ? token.GetString() : null;
+        if (accessToken == null) {
+            return null;
+        }
 
-        var buffer = Encoding.UTF8.GetBytes(JsonSerializer.Serialize(payload));
-        await _ws!.SendAsync(new ArraySegment<byte>(buffer), WebSocketMessageType.Text, true, CancellationToken.None);
+        var refreshToken = root.TryGetProperty("refresh_token", out var refresh) ? refresh.GetString() : null;
+        TokenStore.Save(new StoredTokens(accessToken, refreshToken));
+        _accessToken = accessToken;
+        return accessToken;
     }
 
-    private static async Task SubscribeToVoiceStateEvents(string channelId) {
-        await SendSubscription("VOICE_STATE_CREATE", new { channel_id = channelId });
-        await SendSubscription("VOICE_STATE_DELETE", new { channel_id = channelId });
-        Console.WriteLine($"Subscribed to voice state events for channel {channelId}");
+    internal static void ClearAccessToken() {
+        _accessToken = null;
+        TokenStore.Clear();
     }
 
-    private static async Task SendUnsubscription(string evt, object? args = null) {
-        var payload = new {
-            cmd = "UNSUBSCRIBE",
-            evt,
-            args,
-            nonce = Guid.NewGuid().ToString("N"),
-        };
+    // ---------------------- COMMANDS ----------------------
+    // Everything the watch asks for goes to the followed client
 
-        var buffer = Encoding.UTF8.GetBytes(JsonSerializer.Serialize(payload));
-        await _ws!.SendAsync(new ArraySegment<byte>(buffer), WebSocketMessageType.Text, true, CancellationToken.None);
+    private static Task Route(Func<RpcClient, Task> command) {
+        var client = _active;
+        if (client == null) {
+            LogMessage("No Discord client connected, dropping command");
+            return Task.CompletedTask;
+        }
+
+        return command(client);
     }
 
-    private static async Task UnsubscribeFromVoiceStateEvents(string? channelId) {
-        await SendUnsubscription("VOICE_STATE_CREATE", new { channel_id = channelId });
-        await SendUnsubscription("VOICE_STATE_DELETE", new { channel_id = channelId });
-        Console.WriteLine($"Unsubscribed from voice state events for channel {channelId}");
+    public static Task ToggleMute() => Route(client => client.ToggleMute());
+
+    public static Task ToggleDeafen() => Route(client => client.ToggleDeafen());
+
+    public static Task SetMute(bool mute, long? trace = null) => Route(client => client.SetMute(mute, trace));
+
+    public static Task SetDeafen(bool deaf) => Route(client => client.SetDeafen(deaf));
+
+    public static Task SetUserVolume(string userId, int volume) => Route(client => client.SetUserVolume(userId, volume));
+
+    public static Task LeaveChannel() => Route(client => client.LeaveChannel());
+
+    public static Task<InitialStateMessage?> GetInitialState() {
+        return Task.FromResult(_active?.GetInitialState());
     }
 
-    private static async Task GetCurrentVoiceChannel() {
-        await SendCommand("GET_SELECTED_VOICE_CHANNEL");
+    // Recorded traffic is fed through a client without a socket, which takes
+    // part in the election like a live one
+    internal static void HandleMessage(string message) {
+        if (_replayClient == null) {
+            _replayClient = RpcClient.CreateDetached();
+            lock (ClientsLock) {
+                Clients.Add(_replayClient);
+            }
+        }
+
+        _replayClient.HandleMessage(message);
     }
-    
-    
+
     private static void LogError(string message, Exception? ex = null) {
         Console.WriteLine($"ERROR: {message}");
         if (ex == null) return;
@@ -207,265 +328,4 @@ public class Rpc {
     private static void LogMessage(string message) {
         Console.WriteLine($"INFO: {message}");
     }
-
-
-    private static async Task ReceiveMessagesAsync() {
-        var buffer = new byte[4096];
-        try {
-            while (_ws!.State == WebSocketState.Open) {
-                var result = await _ws.ReceiveAsync(new ArraySegment<byte>(buffer), CancellationToken.None);
-
-                switch (result.MessageType) {
-                    case WebSocketMessageType.Text: {
-                        var message = Encoding.UTF8.GetString(buffer, 0, result.Count);
-                        // Trim any whitespace or invisible characters
-                        message = message.Trim();
-
-                        if (string.IsNullOrEmpty(message)) {
-                            Console.WriteLine("Received empty message, skipping");
-                            continue;
-                        }
-
-                        if (message.StartsWith("<")) {
-                            Console.WriteLine(
-                                $"Received HTML instead of JSON: {message.Substring(0, Math.Min(100, message.Length))}");
-                            continue;
-                        }
-
-                        try {
-                            var json = JsonDocument.Parse(message).RootElement;
-                            if (json.TryGetProperty("cmd", out var cmdElement)) {
-                                var cmd = cmdElement.GetString() ?? string.Empty;
-                                json.TryGetProperty("evt", out var evtElement);
-                                Console.WriteLine(message);
-                                switch (cmd) {
-                                    case "DISPATCH":
-                                        // Handle dispatch events
-                                        var eventType = evtElement.GetString();
-                                        switch (eventType) {
-                                            case "READY":
-                                                await GetAccessTokenStage1();
-                                                break;
-
-                                            case "VOICE_STATE_CREATE":
-                                                var voiceChannelFormerUserCount = _voiceChannelUserCount;
-                                                _voiceChannelUserCount++;
-                                                Console.WriteLine($"User joined voice channel. Total users: {_voiceChannelUserCount}");
-                                                await PebbleWSServer.UserNumberChange(_voiceChannelUserCount);
-                                                if (_dmChannel) {
-                                                    if (_voiceChannelUserCount != 1 && voiceChannelFormerUserCount == 1) {
-                                                        var userName =
-                                                            json.GetProperty("data").GetProperty("nick").GetString() ??
-                                                            string.Empty;
-                                                        await PebbleWSServer.JoinedChannel(userName,
-                                                            _voiceChannelUserCount);
-                                                    }
-                                                }
-                                                break;
-
-                                            case "VOICE_STATE_DELETE":
-                                                if (_voiceChannelUserCount > 0) _voiceChannelUserCount--;
-                                                Console.WriteLine(
-                                                    $"User left voice channel. Total users: {_voiceChannelUserCount}");
-                                                await PebbleWSServer.UserNumberChange(_voiceChannelUserCount);
-                                                break;
-
-                                            case "VOICE_CHANNEL_SELECT":
-                                                var channelId = json.GetProperty("data").GetProperty("channel_id")
-                                                    .GetString();
-                                                if (json.GetProperty("data").TryGetProperty("guild_id", out var guildIdElement)) {
-                                                    var guildId = guildIdElement.GetString();
-                                                    LogMessage($"Found guild_id: {guildId ?? "null"}");
-                                                } else {
-                                                    LogMessage("No guild_id property found - might be a DM or group chat");
-                                                }
-
-                                                // Handle unsubscribing from previous channel if we were in one
-                                                if (_currentVoiceChannelId != null &&
-                                                    (channelId == null || channelId != _currentVoiceChannelId)) {
-                                                    await UnsubscribeFromVoiceStateEvents(_currentVoiceChannelId);
-                                                }
-
-                                                if (channelId == null) {
-                                                    _currentVoiceChannelId = null;
-                                                    _voiceChannel = new JsonElement();
-                                                    await PebbleWSServer.LeftChannel();
-                                                }
-                                                else {
-                                                    // Subscribe to the new channel
-                                                    _currentVoiceChannelId = channelId;
-                                                    await SubscribeToVoiceStateEvents(channelId);
-                                                    await SendCommand("GET_CHANNEL", new { channel_id = channelId });
-                                                }
-
-                                                break;
-
-                                            case "VOICE_SETTINGS_UPDATE":
-                                                _voiceSettings = json.GetProperty("data");
-                                                await PebbleWSServer.UserVoiceStateUpdate(
-                                                    _voiceSettings.GetProperty("mute").GetBoolean(),
-                                                    _voiceSettings.GetProperty("deaf").GetBoolean());
-                                                break;
-
-                                            default:
-                                                Console.WriteLine("Unhandled event: " + eventType);
-                                                break;
-                                        }
-
-                                        break;
-                                    case "GET_CHANNEL":
-                                        _voiceChannel = json.GetProperty("data");
-                                        if (_voiceChannel.TryGetProperty("voice_states", out var voiceStates)) {
-                                            _voiceChannelUserCount = voiceStates.GetArrayLength();
-                                            Console.WriteLine(
-                                                $"Updated voice channel user count: {_voiceChannelUserCount}");
-                                        }
-                                        else {
-                                            //voice channel user count is at least 1, because we are in the channel
-                                            _voiceChannelUserCount = 1;
-                                        }
-
-                                        switch (_voiceChannel.GetProperty("type").GetInt16()) {
-                                            case 0:
-                                                Console.WriteLine("Text channel");
-                                                break;
-                                            case 2:
-                                                _dmChannel = false;
-                                                await SendCommand("GET_GUILD", new { guild_id = _voiceChannel.GetProperty("guild_id").GetString() });
-                                                await PebbleWSServer.JoinedChannel(
-                                                    "#" + _voiceChannel.GetProperty("name").GetString(),
-                                                    _voiceChannelUserCount);
-                                                break;
-                                            case 1:
-                                                _dmChannel = true;
-                                                //if there is a user in the channel, we can get their name
-                                                await PebbleWSServer.JoinedChannel(
-                                                    _voiceChannel.GetProperty("voice_states").GetArrayLength() >= 1
-                                                        ? _voiceChannel.GetProperty("voice_states")[0]
-                                                            .GetProperty("nick").GetString()
-                                                        : "Calling...", //Temporary String, because we can only get the other user once they join
-                                                    _voiceChannelUserCount);
-
-
-                                                await PebbleWSServer.ServerNameUpdate("Private Call");
-                                                break;
-                                            case 3:
-                                                _dmChannel = false; //Even though it is technically a DM channel, we dont need special handling
-                                                Console.WriteLine("Group DM channel");
-                                                await PebbleWSServer.JoinedChannel(
-                                                    _voiceChannel.GetProperty("name").GetString(),
-                                                    _voiceChannelUserCount);
-                                                await PebbleWSServer.ServerNameUpdate("Group Call");
-                                                break;
-                                            default:
-                                                Console.WriteLine("Some new channel type?");
-                                                break;
-                                        }
-                                        break;
-                                    
-                                    case "GET_GUILD":
-                                        _currentServerName = json.GetProperty("data").GetProperty("name").GetString(); 
-                                        await PebbleWSServer.ServerNameUpdate(_currentServerName);
-                                        break;
-
-                                    case "GET_SELECTED_VOICE_CHANNEL":
-                                        if (json.TryGetProperty("data", out var channelData)) {
-                                            // Check if data is null
-                                            if (channelData.ValueKind == JsonValueKind.Null) {
-                                                Console.WriteLine("User is not in a voice channel");
-                                                _currentVoiceChannelId = null;
-                                                _voiceChannelUserCount = 0;
-                                                await PebbleWSServer.LeftChannel();
-                                            }
-                                            else if (channelData.TryGetProperty("id", out var idElement)) {
-                                                var channelId = idElement.GetString();
-                                                if (!string.IsNullOrEmpty(channelId)) {
-                                                    _currentVoiceChannelId = channelId;
-                                                    await SubscribeToVoiceStateEvents(channelId);
-                                                    await SendCommand("GET_CHANNEL", new { channel_id = channelId });
-                                                }
-                                            }
-                                        }
-
-                                        break;
-
-                                    case "AUTHORIZE":
-                                        // Handle authorization response
-                                        if (json.TryGetProperty("data", out var dataElement) &&
-                                            dataElement.TryGetProperty("code", out var codeElement)) {
-                                            var code = codeElement.GetString() ?? string.Empty;
-                                            if (!string.IsNullOrEmpty(code)) {
-                                                await GetAccessTokenStage2(code);
-                                            }
-                                        }
-
-                                        break;
-
-                                    case "AUTHENTICATE":
-                                        if (evtElement.GetString() == "ERROR") {
-                                            _accessToken = null;
-                                            await GetAccessTokenStage1();
-                                            Console.WriteLine("Authentication error, re-authenticating");
-                                        }
-                                        else {
-                                            await SubscribeToEvents();
-                                            await GetCurrentVoiceChannel();
-                                        }
-
-                                        break;
-                                    default:
-                                        Console.WriteLine("Unhandled command: " + cmd);
-                                        break;
-                                }
-                            }
-                        }
-                        catch (JsonException ex) {
-                            Console.WriteLine($"Invalid JSON received: {ex.Message}");
-
-                            // Log byte-by-byte representation to identify any invisible characters
-                            var bytes = Encoding.UTF8.GetBytes(message);
-                            Console.WriteLine($"First 20 bytes: {BitConverter.ToString(bytes.Take(20).ToArray())}");
-                            Console.WriteLine(
-                                $"Message content: {message.Substring(0, Math.Min(200, message.Length))}");
-                        }
-
-                        break;
-                    }
-                    case WebSocketMessageType.Close:
-                        await _ws.CloseAsync(WebSocketCloseStatus.NormalClosure, "Connection closed by server",
-                            CancellationToken.None);
-                        Console.WriteLine("WebSocket connection closed");
-                        //Log reason by using result.CloseStatus and result.CloseStatusDescription
-                        Console.WriteLine("Close status: " + result.CloseStatus);
-                        Console.WriteLine("Close status description: " + result.CloseStatusDescription);
-
-                        break;
-                    case WebSocketMessageType.Binary:
-                        Console.WriteLine("Received binary message, how did we get here?");
-                        break;
-                    default:
-                        Console.WriteLine("Unknown message type");
-                        break;
-                }
-            }
-        } catch (KeyNotFoundException? ex) {
-            LogError($"Dictionary key not found: {ex.Message}", ex);
-        } catch (JsonException? ex) {
-            LogError($"JSON parsing error: {ex.Message}", ex);
-        } catch (Exception ex) {
-            Console.WriteLine($"WebSocket error: {ex.Message}");
-
-            // Try to reconnect after a short delay
-            await Task.Delay(5000);
-            try {
-                if (_ws!.State != WebSocketState.Open) {
-                    Console.WriteLine("Attempting to reconnect...");
-                    await Connect();
-                }
-            }
-            catch (Exception reconnectEx) {
-                Console.WriteLine($"Reconnection failed: {reconnectEx.Message}");
-            }
-        }
-    }
-}
\ No newline at end of file
+}
@@ -0,0 +1,697 @@
+using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Text;
+using System.Text.Json;
+using System.Threading;
+using System.Threading.Channels;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion;
+
+// Stages of the Discord event pipeline, in the order a message passes them
+public enum PipelineStage {
+    Parse,
+    Reduce,
+    Broadcast,
+}
+
+// One connection to a running Discord client (Stable, PTB, Canary each listen
+// on their own port and IPC socket). It keeps that client's voice state; Rpc decides which
+// client the watch follows and only that one's changes reach the Pebble clients.
+//
+// Messages flow through bounded stages: the socket reader hands complete
+// frames to the parser, the parser hands documents to a single-threaded
+// reducer that owns all of this client's state, and the reducer posts what the
+// watch should see to PebbleBroadcaster. Only the reader touches the socket and
+// only the broadcaster waits on Pebble sends; requests to Discord go to the send
+// queue without waiting for the write. So parse and reduce never block on I/O,
+// and they may safely make the stage before them wait: Discord events can't be
+// dropped without corrupting the state.
+public sealed class RpcClient {
+    private static readonly TimeSpan VolumeSendInterval = TimeSpan.FromMilliseconds(250);
+    // A request Discord never answered would otherwise stay in pendingRequests
+    // for as long as the connection lives, which can be weeks
+    private const int MaxPendingRequests = 256;
+    private static readonly TimeSpan PendingRequestTimeout = TimeSpan.FromMinutes(1);
+    private const int FrameQueueCapacity = 1024;
+    private const int DocumentQueueCapacity = 256;
+
+    private readonly IRpcTransport? transport;
+    private RpcSendQueue? sendQueue;
+    private bool authenticated;
+
+    // Nonce -> send timestamp, for measuring how long Discord takes to answer
+    private readonly ConcurrentDictionary<string, long> pendingRequests = new();
+
+    // The last traced SetMute while Discord hasn't applied it yet
+    private sealed record PendingMuteTrace(long Id, bool Mute);
+    private PendingMuteTrace? pendingMuteTrace;
+    private VoiceSettings? voiceSettings;
+    private VoiceChannel? voiceChannel;
+    private Guild? guild;
+    private string? currentVoiceChannelId;
+    private int voiceChannelUserCount;
+    private bool dmChannel;
+
+    private readonly Channel<string> frames = Channel.CreateBounded<string>(
+        new BoundedChannelOptions(FrameQueueCapacity) { SingleReader = true, SingleWriter = true });
+    private readonly Channel<JsonDocument> documents = Channel.CreateBounded<JsonDocument>(
+        new BoundedChannelOptions(DocumentQueueCapacity) { SingleReader = true, SingleWriter = true });
+
+    private readonly Lock volumeLock = new();
+    private readonly Dictionary<string, int> pendingVolumes = new();
+    private readonly HashSet<string> volumeFlushing = new();
+
+    // The port or socket this client is reached on
+    public string Endpoint { get; }
+
+    public RpcTransportKind? Kind => transport?.Kind;
+
+    public bool IsAuthenticated => authenticated;
+
+    // Ready once authenticated and the first voice settings are in
+    public bool IsReady => authenticated && voiceSettings != null;
+
+    public bool InVoiceChannel => voiceChannel != null;
+
+    // When this client last joined a channel, to prefer the most recent one
+    public long JoinedVoiceAt { get; private set; }
+
+    // Participants of the current channel, paged to the watch on request
+    public VoiceRoster Participants { get; } = new();
+
+    private bool IsActive => Rpc.IsActive(this);
+
+    public RpcClient(IRpcTransport transport) : this(transport.Endpoint, transport) {
+    }
+
+    private RpcClient(string endpoint, IRpcTransport? transport) {
+        Endpoint = endpoint;
+        this.transport = transport;
+        if (transport != null) {
+            sendQueue = new RpcSendQueue(transport);
+        }
+    }
+
+    // Without a socket, for feeding recorded traffic through the same handling
+    internal static RpcClient CreateDetached() {
+        return new RpcClient("replay", null);
+    }
+
+    public void Close() {
+        sendQueue?.Stop();
+        sendQueue = null;
+        transport?.Dispose();
+        authenticated = false;
+        pendingRequests.Clear();
+    }
+
+    private async Task GetAccessTokenStage1() {
+        await SendCommand("AUTHORIZE", new AuthorizeArgs(Rpc.ClientId, ["rpc"], "none"), RpcPriority.UserCommand);
+    }
+
+    private async Task GetAccessTokenStage2(string code) {
+        var accessToken = await Rpc.ExchangeCodeAsync(code);
+        if (accessToken == null) {
+            Console.WriteLine("Failed to get access token");
+            return;
+        }
+
+        await Authenticate();
+    }
+
+    private async Task Authenticate() {
+        await SendCommand("AUTHENTICATE", new AuthenticateArgs(Rpc.AccessToken), RpcPriority.UserCommand);
+    }
+
+    private void SubscribeToEvents() {
+        Post(SendSubscription("VOICE_CHANNEL_SELECT"));
+        Post(SendSubscription("VOICE_SETTINGS_UPDATE"));
+    }
+
+    public async Task ToggleMute() {
+        var settings = voiceSettings;
+        if (settings == null) {
+            Console.WriteLine("Voice settings not available yet");
+            return;
+        }
+
+        //set to opposite of current mute state
+        await SetMute(!settings.Mute);
+    }
+
+    public async Task ToggleDeafen() {
+        var settings = voiceSettings;
+        if (settings == null) {
+            Console.WriteLine("Voice settings not available yet");
+            return;
+        }
+
+        //set to opposite of current deafen state
+        await SetDeafen(!settings.Deaf);
+    }
+
+    // Unlike the toggles these don't depend on the cached voice settings,
+    // so repeating the same command always converges on the same state
+    public async Task SetMute(bool mute, long? trace = null) {
+        if (trace != null) {
+            // Echoed on the VOICE_SETTINGS_UPDATE this command causes
+            Interlocked.Exchange(ref pendingMuteTrace, new PendingMuteTrace(trace.Value, mute));
+        }
+
+        await SendCommand("SET_VOICE_SETTINGS", new VoiceSettingsArgs { Mute = mute }, RpcPriority.UserCommand, trace);
+    }
+
+    public async Task SetDeafen(bool deaf) {
+        await SendCommand("SET_VOICE_SETTINGS", new VoiceSettingsArgs { Deaf = deaf }, RpcPriority.UserCommand);
+    }
+
+    // Holding a button on the watch produces a stream of volume steps. The
+    // first goes to Discord right away, after that only the latest value per
+    // user, once per interval.
+    public Task SetUserVolume(string userId, int volume) {
+        lock (volumeLock) {
+            pendingVolumes[userId] = volume;
+            if (!volumeFlushing.Add(userId)) {
+                return Task.CompletedTask;
+            }
+        }
+
+        _ = FlushUserVolumeAsync(userId);
+        return Task.CompletedTask;
+    }
+
+    private async Task FlushUserVolumeAsync(string userId) {
+        try {
+            while (true) {
+                int volume;
+                lock (volumeLock) {
+                    if (!pendingVolumes.Remove(userId, out volume)) {
+                        volumeFlushing.Remove(userId);
+                        return;
+                    }
+                }
+
+                await SendCommand("SET_USER_VOICE_SETTINGS", new UserVoiceSettingsArgs(userId, volume),
+                    RpcPriority.UserCommand);
+                await Task.Delay(VolumeSendInterval);
+            }
+        }
+        catch (Exception ex) {
+            lock (volumeLock) {
+                volumeFlushing.Remove(userId);
+            }
+            LogError($"Failed to set volume for {userId}: {ex.Message}", ex);
+        }
+    }
+
+    public async Task LeaveChannel() {
+        await SendCommand("SELECT_VOICE_CHANNEL", new SelectVoiceChannelArgs(null, true), RpcPriority.UserCommand);
+    }
+
+    public InitialStateMessage? GetInitialState() {
+        var settings = voiceSettings;
+        if (settings == null) {
+            Console.WriteLine("Voice settings not available yet");
+            return null;
+        }
+
+        // Default values for channel properties
+        string? channelName = "";
+        var users = 0;
+        string? serverName = "";
+
+        // Update channel properties if voice channel is available
+        var channel = voiceChannel;
+        if (channel != null) {
+            // Named the way joining names it, so a snapshot (e.g. on failover) doesn't rename the call
+            channelName = channel.Type == 2 ? "#" + channel.Name : channel.Name;
+            users = voiceChannelUserCount;
+            serverName = guild?.Name;
+        }
+
+        return new InitialStateMessage(settings.Mute, settings.Deaf, channelName, users, serverName);
+    }
+
+    private async Task SendSubscription(string evt, object? args = null) {
+        var payload = new RpcRequest("SUBSCRIBE", args, Guid.NewGuid().ToString("N")) { Evt = evt };
+        await Send(payload, RpcPriority.Subscription);
+    }
+
+    private async Task SendCommand(string cmd, object? args = null,
+        RpcPriority priority = RpcPriority.StateFetch, long? trace = null) {
+        var payload = new RpcRequest(cmd, args, Guid.NewGuid().ToString("N"));
+        // Marked before queueing: Discord's reply can beat the continuation after the write
+        if (trace != null) {
+            Trace.MarkDiscordSent(trace.Value);
+        }
+
+        await Send(payload, priority);
+    }
+
+    // All writes to the RPC socket go through the send queue. The payload is
+    // serialized here, on the caller, so the writer task only moves bytes.
+    private async Task Send(RpcRequest payload, RpcPriority priority) {
+        var queue = sendQueue;
+        if (queue == null) {
+            LogMessage("Not connected to Discord, dropping RPC message");
+            return;
+        }
+
+        var bytes = JsonSerializer.SerializeToUtf8Bytes(payload, DiscordJsonContext.Default.RpcRequest);
+        Capture.Record(CaptureSource.Discord, CaptureDirection.Outbound, bytes);
+        if (pendingRequests.Count >= MaxPendingRequests) {
+            PrunePendingRequests();
+        }
+
+        pendingRequests[payload.Nonce] = Stopwatch.GetTimestamp();
+        await queue.Enqueue(bytes, priority);
+    }
+
+    private void SubscribeToVoiceStateEvents(string channelId) {
+        Post(SendSubscription("VOICE_STATE_CREATE", new ChannelArgs(channelId)));
+        Post(SendSubscription("VOICE_STATE_DELETE", new ChannelArgs(channelId)));
+        Console.WriteLine($"Subscribed to voice state events for channel {channelId}");
+    }
+
+    private async Task SendUnsubscription(string evt, object? args = null) {
+        var payload = new RpcRequest("UNSUBSCRIBE", args, Guid.NewGuid().ToString("N")) { Evt = evt };
+        await Send(payload, RpcPriority.Subscription);
+    }
+
+    private void UnsubscribeFromVoiceStateEvents(string? channelId) {
+        Post(SendUnsubscription("VOICE_STATE_CREATE", new ChannelArgs(channelId)));
+        Post(SendUnsubscription("VOICE_STATE_DELETE", new ChannelArgs(channelId)));
+        Console.WriteLine($"Unsubscribed from voice state events for channel {channelId}");
+    }
+
+    private void GetCurrentVoiceChannel() {
+        Post(SendCommand("GET_SELECTED_VOICE_CHANNEL"));
+    }
+
+    private void GetVoiceSettings() {
+        Post(SendCommand("GET_VOICE_SETTINGS"));
+    }
+
+    // For the stages that must not wait on I/O. The send queue keeps frames in
+    // order, so all that's left to do is report a failed send.
+    private void Post(Task send) {
+        send.ContinueWith(task => LogError($"RPC send failed: {task.Exception!.GetBaseException().Message}"),
+            TaskContinuationOptions.OnlyOnFaulted);
+    }
+
+    // Only the followed client's changes reach the watch
+    private void Broadcast(Func<Task> broadcast) {
+        if (IsActive) {
+            PebbleBroadcaster.Post(broadcast);
+        }
+    }
+
+    private void PrunePendingRequests() {
+        foreach (var (nonce, sentAt) in pendingRequests) {
+            if (Stopwatch.GetElapsedTime(sentAt) > PendingRequestTimeout) {
+                pendingRequests.TryRemove(nonce, out _);
+            }
+        }
+    }
+
+    private void LogError(string message, Exception? ex = null) {
+        Console.WriteLine($"ERROR: [{Endpoint}] {message}");
+        if (ex == null) return;
+        Console.WriteLine($"Exception: {ex.GetType().Name}");
+        Console.WriteLine($"Message: {ex.Message}");
+        Console.WriteLine($"Stack Trace: {ex.StackTrace}");
+    }
+
+    private void LogMessage(string message) {
+        Console.WriteLine($"INFO: [{Endpoint}] {message}");
+    }
+
+    private void LeftVoiceChannel() {
+        currentVoiceChannelId = null;
+        voiceChannel = null;
+        voiceChannelUserCount = 0;
+        Participants.Clear();
+    }
+
+
+    // Runs the pipeline until the socket closes. Returns once everything the
+    // reader got has been reduced.
+    public async Task RunAsync(CancellationToken cancellationToken) {
+        var parser = Task.Run(ParseLoopAsync);
+        var reducer = Task.Run(ReduceLoopAsync);
+        try {
+            await ReceiveMessagesAsync(cancellationToken);
+        }
+        finally {
+            frames.Writer.TryComplete();
+        }
+
+        await Task.WhenAll(parser, reducer);
+    }
+
+    // Feeds one recorded message through parse and reduce inline, for CaptureReplayer
+    internal void HandleMessage(string message) {
+        var document = Parse(message);
+        if (document != null) {
+            Reduce(document);
+        }
+    }
+
+    // ---------------------- READER ----------------------
+
+    private async Task ReceiveMessagesAsync(CancellationToken cancellationToken) {
+        try {
+            while (true) {
+                var text = await transport!.ReceiveAsync(cancellationToken);
+                if (text == null) {
+                    // The close handshake is a send too, keep the writer out of its way
+                    sendQueue?.Stop();
+                    await transport.CloseAsync();
+                    LogMessage("Connection closed by Discord");
+                    break;
+                }
+
+                Capture.Record(CaptureSource.Discord, CaptureDirection.Inbound, text);
+                Metrics.PipelineQueued(PipelineStage.Parse);
+                if (!frames.Writer.TryWrite(text)) {
+                    Metrics.PipelineBlocked(PipelineStage.Parse);
+                    await frames.Writer.WriteAsync(text, cancellationToken);
+                }
+            }
+        } catch (OperationCanceledException) {
+            Console.WriteLine("Disconnecting from Discord");
+        } catch (Exception ex) {
+            // Rpc drops this client and fails over to another one
+            LogMessage($"Connection error: {ex.Message}");
+        }
+    }
+
+    // ---------------------- PARSER ----------------------
+
+    private async Task ParseLoopAsync() {
+        await foreach (var text in frames.Reader.ReadAllAsync()) {
+            Metrics.PipelineDequeued(PipelineStage.Parse);
+            var document = Parse(text);
+            if (document == null) {
+                continue;
+            }
+
+            Metrics.PipelineQueued(PipelineStage.Reduce);
+            if (!documents.Writer.TryWrite(document)) {
+                Metrics.PipelineBlocked(PipelineStage.Reduce);
+                await documents.Writer.WriteAsync(document);
+            }
+        }
+
+        documents.Writer.TryComplete();
+    }
+
+    // Turns one complete message from Discord into a document for the reducer,
+    // null if there is nothing to reduce
+    private JsonDocument? Parse(string message) {
+        // Trim any whitespace or invisible characters
+        message = message.Trim();
+
+        if (string.IsNullOrEmpty(message)) {
+            Console.WriteLine("Received empty message, skipping");
+            return null;
+        }
+
+        if (message.StartsWith("<")) {
+            Console.WriteLine(
+                $"Received HTML instead of JSON: {message.Substring(0, Math.Min(100, message.Length))}");
+            return null;
+        }
+
+        JsonDocument document;
+        try {
+            document = JsonDocument.Parse(message);
+        }
+        catch (JsonException ex) {
+            Console.WriteLine($"Invalid JSON received: {ex.Message}");
+
+            // Log byte-by-byte representation to identify any invisible characters
+            var bytes = Encoding.UTF8.GetBytes(message);
+            Console.WriteLine($"First 20 bytes: {BitConverter.ToString(bytes.Take(20).ToArray())}");
+            Console.WriteLine(
+                $"Message content: {message.Substring(0, Math.Min(200, message.Length))}");
+            return null;
+        }
+
+        var json = document.RootElement;
+        if (json.ValueKind != JsonValueKind.Object || !json.TryGetProperty("cmd", out var cmdElement)) {
+            document.Dispose();
+            return null;
+        }
+
+        Console.WriteLine(message);
+        // Measured here rather than in the reducer so a backed up queue doesn't count as Discord's time
+        if (cmdElement.GetString() != "DISPATCH" && json.TryGetProperty("nonce", out var nonceElement) &&
+            nonceElement.ValueKind == JsonValueKind.String &&
+            pendingRequests.TryRemove(nonceElement.GetString()!, out var sentAt)) {
+            Metrics.RpcRoundTripTime.ObserveSince(sentAt);
+        }
+
+        return document;
+    }
+
+    // ---------------------- REDUCER ----------------------
+
+    private async Task ReduceLoopAsync() {
+        await foreach (var document in documents.Reader.ReadAllAsync()) {
+            Metrics.PipelineDequeued(PipelineStage.Reduce);
+            Reduce(document);
+        }
+    }
+
+    // Applies one message to this client's state. Runs on one task at a time and
+    // never waits: requests to Discord are queued, broadcasts are posted.
+    private void Reduce(JsonDocument document) {
+        var json = document.RootElement;
+        try {
+            var cmd = json.GetProperty("cmd").GetString() ?? string.Empty;
+            json.TryGetProperty("evt", out var evtElement);
+            switch (cmd) {
+                case "DISPATCH":
+                    // Handle dispatch events
+                    var eventType = evtElement.GetString();
+                    switch (eventType) {
+                        case "READY":
+                            // Reuse a cached token to skip the AUTHORIZE prompt
+                            Post(Rpc.AccessToken != null ? Authenticate() : GetAccessTokenStage1());
+                            break;
+
+                        case "VOICE_STATE_CREATE":
+                            var voiceChannelFormerUserCount = voiceChannelUserCount;
+                            var userCount = ++voiceChannelUserCount;
+                            Participants.Add(Participant.Parse(json.GetProperty("data")));
+                            Console.WriteLine($"User joined voice channel. Total users: {userCount}");
+                            Broadcast(() => PebbleWSServer.UserNumberChange(userCount));
+                            if (dmChannel && userCount != 1 && voiceChannelFormerUserCount == 1) {
+                                var userName =
+                                    json.GetProperty("data").GetProperty("nick").GetString() ??
+                                    string.Empty;
+                                Broadcast(() => PebbleWSServer.JoinedChannel(userName, userCount));
+                            }
+                            break;
+
+                        case "VOICE_STATE_DELETE":
+                            if (voiceChannelUserCount > 0) voiceChannelUserCount--;
+                            var remaining = voiceChannelUserCount;
+                            Participants.Remove(Participant.Parse(json.GetProperty("data")).UserId);
+                            Console.WriteLine(
+                                $"User left voice channel. Total users: {remaining}");
+                            Broadcast(() => PebbleWSServer.UserNumberChange(remaining));
+                            break;
+
+                        case "VOICE_CHANNEL_SELECT":
+                            var channelId = json.GetProperty("data").GetProperty("channel_id")
+                                .GetString();
+                            if (json.GetProperty("data").TryGetProperty("guild_id", out var guildIdElement)) {
+                                var guildId = guildIdElement.GetString();
+                                LogMessage($"Found guild_id: {guildId ?? "null"}");
+                            } else {
+                                LogMessage("No guild_id property found - might be a DM or group chat");
+                            }
+
+                            // Handle unsubscribing from previous channel if we were in one
+                            if (currentVoiceChannelId != null &&
+                                (channelId == null || channelId != currentVoiceChannelId)) {
+                                UnsubscribeFromVoiceStateEvents(currentVoiceChannelId);
+                            }
+
+                            if (channelId == null) {
+                                LeftVoiceChannel();
+                                // Another client that is still in a call takes over, if there is one
+                                Rpc.Elect();
+                                Broadcast(PebbleWSServer.LeftChannel);
+                            }
+                            else {
+                                // Subscribe to the new channel
+                                currentVoiceChannelId = channelId;
+                                SubscribeToVoiceStateEvents(channelId);
+                                Post(SendCommand("GET_CHANNEL", new ChannelArgs(channelId)));
+                            }
+
+                            break;
+
+                        case "VOICE_SETTINGS_UPDATE":
+                            var settings = VoiceSettings.Parse(json.GetProperty("data"));
+                            // Only the update that applies the traced mute completes it, not one
+                            // for a volume change or an older command that was still in flight
+                            long trace = 0;
+                            var pending = Volatile.Read(ref pendingMuteTrace);
+                            if (pending != null && pending.Mute == settings.Mute &&
+                                Interlocked.CompareExchange(ref pendingMuteTrace, null, pending) == pending) {
+                                trace = pending.Id;
+                                Trace.MarkDiscordResponded(trace);
+                            }
+
+                            // Discord sends this for every voice setting (volume, input mode, ...);
+                            // the server drops the ones that leave mute/deaf unchanged
+                            voiceSettings = settings;
+                            Broadcast(() => PebbleWSServer.UserVoiceStateUpdate(settings.Mute, settings.Deaf,
+                                trace != 0 ? trace : null));
+                            break;
+
+                        default:
+                            Console.WriteLine("Unhandled event: " + eventType);
+                            break;
+                    }
+
+                    break;
+                case "GET_CHANNEL":
+                    var channel = VoiceChannel.Parse(json.GetProperty("data"));
+                    if (voiceChannel == null) {
+                        JoinedVoiceAt = Stopwatch.GetTimestamp();
+                    }
+                    voiceChannel = channel;
+                    var users = voiceChannelUserCount = channel.UserCount;
+                    dmChannel = channel.Type == 1;
+                    Participants.Reset(Participant.ParseAll(json.GetProperty("data")));
+                    Console.WriteLine($"Updated voice channel user count: {users}");
+
+                    // Joining a call makes this the client the watch follows
+                    Rpc.Elect();
+                    switch (channel.Type) {
+                        case 0:
+                            Console.WriteLine("Text channel");
+                            break;
+                        case 2:
+                            // Fetched even when not followed, so the snapshot is complete on failover
+                            Post(SendCommand("GET_GUILD", new GuildArgs(channel.GuildId)));
+                            Broadcast(() => PebbleWSServer.JoinedChannel("#" + channel.Name, users));
+                            break;
+                        case 1:
+                            //if there is a user in the channel, we can get their name
+                            Broadcast(() => PebbleWSServer.JoinedChannel(
+                                channel.UserCount >= 1
+                                    ? channel.FirstUserNick
+                                    : "Calling...", //Temporary String, because we can only get the other user once they join
+                                users));
+                            Broadcast(() => PebbleWSServer.ServerNameUpdate("Private Call"));
+                            break;
+                        case 3:
+                            //Even though it is technically a DM channel, we dont need special handling
+                            Console.WriteLine("Group DM channel");
+                            Broadcast(() => PebbleWSServer.JoinedChannel(channel.Name, users));
+                            Broadcast(() => PebbleWSServer.ServerNameUpdate("Group Call"));
+                            break;
+                        default:
+                            Console.WriteLine("Some new channel type?");
+                            break;
+                    }
+                    break;
+
+                case "GET_VOICE_SETTINGS":
+                    voiceSettings = VoiceSettings.Parse(json.GetProperty("data"));
+                    // First state after (re)connecting, bring all Pebble clients up to date.
+                    // If this client just became the one to follow, the election already did.
+                    if (!Rpc.Elect()) {
+                        Broadcast(PebbleWSServer.StateSnapshot);
+                    }
+                    break;
+
+                case "SET_USER_VOICE_SETTINGS":
+                    var userSettings = json.GetProperty("data");
+                    if (userSettings.TryGetProperty("volume", out var volumeElement)) {
+                        Participants.SetVolume(userSettings.GetProperty("user_id").GetString(),
+                            (int)Math.Round(volumeElement.GetDouble()));
+                    }
+                    break;
+
+                case "GET_GUILD":
+                    var guildInfo = guild = Guild.Parse(json.GetProperty("data"));
+                    Broadcast(() => PebbleWSServer.ServerNameUpdate(guildInfo.Name));
+                    break;
+
+                case "GET_SELECTED_VOICE_CHANNEL":
+                    if (json.TryGetProperty("data", out var channelData)) {
+                        // Check if data is null
+                        if (channelData.ValueKind == JsonValueKind.Null) {
+                            Console.WriteLine("User is not in a voice channel");
+                            LeftVoiceChannel();
+                            Rpc.Elect();
+                            Broadcast(PebbleWSServer.LeftChannel);
+                        }
+                        else if (channelData.TryGetProperty("id", out var idElement)) {
+                            var channelId = idElement.GetString();
+                            if (!string.IsNullOrEmpty(channelId)) {
+                                currentVoiceChannelId = channelId;
+                                SubscribeToVoiceStateEvents(channelId);
+                                Post(SendCommand("GET_CHANNEL", new ChannelArgs(channelId)));
+                            }
+                        }
+                    }
+
+                    break;
+
+                case "AUTHORIZE":
+                    // Handle authorization response
+                    if (json.TryGetProperty("data", out var dataElement) &&
+                        dataElement.TryGetProperty("code", out var codeElement)) {
+                        var code = codeElement.GetString() ?? string.Empty;
+                        if (!string.IsNullOrEmpty(code)) {
+                            // The token exchange is an HTTP round trip, keep it off the reducer
+                            Post(GetAccessTokenStage2(code));
+                        }
+                    }
+
+                    break;
+
+                case "AUTHENTICATE":
+                    if (evtElement.GetString() == "ERROR") {
+                        // The cached token was revoked or expired
+                        Rpc.ClearAccessToken();
+                        Post(GetAccessTokenStage1());
+                        Console.WriteLine("Authentication error, re-authenticating");
+                    }
+                    else {
+                        authenticated = true;
+                        SubscribeToEvents();
+                        GetVoiceSettings();
+                        GetCurrentVoiceChannel();
+                    }
+
+                    break;
+                default:
+                    Console.WriteLine("Unhandled command: " + cmd);
+                    break;
+            }
+        }
+        catch (Exception ex) {
+            // A message missing a field we rely on or holding a value we can't parse;
+            // skip it rather than stop reducing. Letting it escape would fault the
+            // reducer, and with nothing draining the document queue the pipeline stalls.
+            LogError($"Unexpected message shape: {ex.Message}", ex);
+        }
+        finally {
+            // Nothing above keeps a JsonElement past this message, state is copied into records
+            document.Dispose();
+        }
+    }
+}
@@ -0,0 +1,145 @@
+using System;
+using System.Diagnostics;
+using System.Threading;
+using System.Threading.Channels;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion;
+
+// Lanes are drained in declaration order
+public enum RpcPriority {
+    UserCommand,
+    StateFetch,
+    Subscription,
+}
+
+public readonly record struct RpcLaneStats(long Depth, long Sent, TimeSpan AverageLatency, TimeSpan MaxLatency);
+
+// Single writer for the Discord RPC socket. Neither transport allows more than
+// one send in flight, so every frame is queued here and written by one task, always
+// taking the highest priority lane first. Payloads arrive already serialized,
+// the writer only copies bytes onto the socket.
+public sealed class RpcSendQueue {
+    private sealed record PendingFrame(byte[] Payload, long EnqueuedAt, TaskCompletionSource Sent);
+
+    private static readonly int LaneCount = Enum.GetValues<RpcPriority>().Length;
+    private static readonly TimeSpan SlowSendThreshold = TimeSpan.FromMilliseconds(250);
+
+    // Metrics are process-wide so they survive reconnects
+    private static readonly long[] LaneDepth = new long[LaneCount];
+    private static readonly long[] LaneSent = new long[LaneCount];
+    private static readonly long[] LaneLatencyTicks = new long[LaneCount];
+    private static readonly long[] LaneMaxLatencyTicks = new long[LaneCount];
+
+    private readonly IRpcTransport transport;
+    private readonly Channel<PendingFrame>[] lanes;
+    private readonly SemaphoreSlim available = new(0);
+    private readonly CancellationTokenSource stop = new();
+
+    public RpcSendQueue(IRpcTransport transport) {
+        this.transport = transport;
+        lanes = new Channel<PendingFrame>[LaneCount];
+        for (var i = 0; i < LaneCount; i++) {
+            lanes[i] = Channel.CreateUnbounded<PendingFrame>(new UnboundedChannelOptions { SingleReader = true });
+        }
+
+        _ = Task.Run(WriteLoopAsync);
+    }
+
+    public static RpcLaneStats GetStats(RpcPriority priority) {
+        var lane = (int)priority;
+        var sent = Interlocked.Read(ref LaneSent[lane]);
+        var latencyTicks = Interlocked.Read(ref LaneLatencyTicks[lane]);
+        return new RpcLaneStats(
+            Interlocked.Read(ref LaneDepth[lane]),
+            sent,
+            sent == 0 ? TimeSpan.Zero : Stopwatch.GetElapsedTime(0, latencyTicks / sent),
+            Stopwatch.GetElapsedTime(0, Interlocked.Read(ref LaneMaxLatencyTicks[lane])));
+    }
+
+    // Completes once the frame has been written to the socket
+    public Task Enqueue(byte[] payload, RpcPriority priority) {
+        var frame = new PendingFrame(payload, Stopwatch.GetTimestamp(),
+            new TaskCompletionSource(TaskCreationOptions.RunContinuationsAsynchronously));
+
+        if (!lanes[(int)priority].Writer.TryWrite(frame)) {
+            frame.Sent.SetException(new InvalidOperationException("RPC send queue is stopped"));
+            return frame.Sent.Task;
+        }
+
+        Interlocked.Increment(ref LaneDepth[(int)priority]);
+        available.Release();
+        return frame.Sent.Task;
+    }
+
+    public void Stop() {
+        foreach (var lane in lanes) {
+            lane.Writer.TryComplete();
+        }
+
+        stop.Cancel();
+    }
+
+    private async Task WriteLoopAsync() {
+        try {
+            while (true) {
+                await available.WaitAsync(stop.Token);
+                if (!TryDequeue(out var frame, out var lane)) {
+                    continue;
+                }
+
+                try {
+                    await transport.SendAsync(frame.Payload, stop.Token);
+                    RecordSent(lane, Stopwatch.GetTimestamp() - frame.EnqueuedAt);
+                    frame.Sent.TrySetResult();
+                }
+                catch (Exception ex) {
+                    frame.Sent.TrySetException(ex);
+                }
+            }
+        }
+        catch (OperationCanceledException) {
+            // Stopped
+        }
+
+        // Fail whatever was still waiting so nobody awaits a dead socket forever
+        while (TryDequeue(out var frame, out _)) {
+            frame.Sent.TrySetCanceled();
+        }
+    }
+
+    private bool TryDequeue(out PendingFrame frame, out int lane) {
+        for (lane = 0; lane < LaneCount; lane++) {
+            if (lanes[lane].Reader.TryRead(out frame!)) {
+                Interlocked.Decrement(ref LaneDepth[lane]);
+                return true;
+            }
+        }
+
+        frame = null!;
+        return false;
+    }
+
+    private static void RecordSent(int lane, long latencyTicks) {
+        Interlocked.Increment(ref LaneSent[lane]);
+        Metrics.RpcSendQueueLatency((RpcPriority)lane).Observe(Stopwatch.GetElapsedTime(0, latencyTicks));
+        Interlocked.Add(ref LaneLatencyTicks[lane], latencyTicks);
+
+        var max = Interlocked.Read(ref LaneMaxLatencyTicks[lane]);
+        while (latencyTicks > max) {
+            var previous = Interlocked.CompareExchange(ref LaneMaxLatencyTicks[lane], latencyTicks, max);
+            if (previous == max) {
+                break;
+            }
+
+            max = previous;
+        }
+
+        var latency = Stopwatch.GetElapsedTime(0, latencyTicks);
+        if (latency > SlowSendThreshold) {
+            Console.WriteLine(
+                $"INFO: Slow RPC send on {(RpcPriority)lane} lane: {latency.TotalMilliseconds:F0}ms, " +
+                $"{Interlocked.Read(ref LaneDepth[lane])} still queued");
+        }
+    }
+}
@@ -0,0 +1,107 @@
+using System;
+using System.IO;
+using System.Net.WebSockets;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Pebble_Companion;
+
+public enum RpcTransportKind {
+    Ipc,
+    WebSocket,
+}
+
+// Carries whole RPC messages to and from one Discord client. RpcSendQueue is
+// the only caller of SendAsync and the RpcClient reader the only caller of
+// ReceiveAsync; a transport that writes from its receive side too (IPC answers
+// pings) has to serialize that itself.
+public interface IRpcTransport : IDisposable {
+    RpcTransportKind Kind { get; }
+
+    // Identifies the client in logs and while probing, e.g. "port 6463"
+    string Endpoint { get; }
+
+    // The next complete message, null once Discord closed the connection
+    Task<string?> ReceiveAsync(CancellationToken cancellationToken);
+
+    Task SendAsync(byte[] payload, CancellationToken cancellationToken);
+
+    // Completes a close Discord started. Call only after the send queue stopped.
+    Task CloseAsync();
+}
+
+// The local WebSocket RPC server Discord runs on the first free port of 6463-6472
+public sealed class WebSocketTransport : IRpcTransport {
+    private readonly ClientWebSocket ws;
+    private readonly byte[] buffer = new byte[4096];
+    private readonly MemoryStream message = new();
+
+    private WebSocketTransport(int port, ClientWebSocket ws) {
+        Endpoint = $"port {port}";
+        this.ws = ws;
+    }
+
+    public RpcTransportKind Kind => RpcTransportKind.WebSocket;
+
+    public string Endpoint { get; }
+
+    public static async Task<IRpcTransport?> TryConnectAsync(int port, TimeSpan timeout,
+        CancellationToken cancellationToken) {
+        var ws = new ClientWebSocket();
+        ws.Options.SetRequestHeader("Origin", "http://localhost:3000");
+        using var connectTimeout = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
+        connectTimeout.CancelAfter(timeout);
+        try {
+            await ws.ConnectAsync(new Uri($"ws://127.0.0.1:{port}/?v=1&encoding=json&client_id={Rpc.ClientId}"),
+                connectTimeout.Token);
+            return new WebSocketTransport(port, ws);
+        }
+        catch (Exception) when (!cancellationToken.IsCancellationRequested) {
+            ws.Dispose();
+            return null;
+        }
+    }
+
+    public async Task<string?> ReceiveAsync(CancellationToken cancellationToken) {
+        while (true) {
+            var result = await ws.ReceiveAsync(new ArraySegment<byte>(buffer), cancellationToken);
+            switch (result.MessageType) {
+                case WebSocketMessageType.Text:
+                    // Discord may split large payloads (e.g. busy channels) over several frames
+                    message.Write(buffer, 0, result.Count);
+                    if (!result.EndOfMessage) {
+                        continue;
+                    }
+
+                    var text = Encoding.UTF8.GetString(message.GetBuffer(), 0, (int)message.Length);
+                    message.SetLength(0);
+                    return text;
+                case WebSocketMessageType.Close:
+                    //Log reason by using result.CloseStatus and result.CloseStatusDescription
+                    Console.WriteLine("Close status: " + result.CloseStatus);
+                    Console.WriteLine("Close status description: " + result.CloseStatusDescription);
+                    return null;
+                case WebSocketMessageType.Binary:
+                    Console.WriteLine("Received binary message, how did we get here?");
+                    break;
+                default:
+                    Console.WriteLine("Unknown message type");
+                    break;
+            }
+        }
+    }
+
+    public Task SendAsync(byte[] payload, CancellationToken cancellationToken) {
+        return ws.SendAsync(new ArraySegment<byte>(payload), WebSocketMessageType.Text, true, cancellationToken);
+    }
+
+    public Task CloseAsync() {
+        return ws.CloseAsync(WebSocketCloseStatus.NormalClosure, "Connection closed by server", CancellationToken.None);
+    }
+
+    public void Dispose() {
+        ws.Dispose();
+        message.Dispose();
+    }
+}
@@ -0,0 +1,47 @@
+using System;
+using System.Diagnostics;
+using System.Threading;
+
+namespace Pebble_Companion;
+
+// Holds up to `capacity` tokens, refilled continuously at `refillPerSecond`.
+// Each admitted operation takes one token.
+public sealed class TokenBucket {
+    private readonly Lock sync = new();
+    private readonly double capacity;
+    private readonly double refillPerSecond;
+    private double tokens;
+    private long lastRefill;
+
+    public TokenBucket(double capacity, double refillPerSecond) {
+        this.capacity = capacity;
+        this.refillPerSecond = refillPerSecond;
+        tokens = capacity;
+        lastRefill = Stopwatch.GetTimestamp();
+    }
+
+    public bool TryTake() {
+        lock (sync) {
+            Refill();
+            if (tokens < 1) {
+                return false;
+            }
+
+            tokens -= 1;
+            return true;
+        }
+    }
+
+    // Gives back a token taken for an operation that ended up not running
+    public void Refund() {
+        lock (sync) {
+            tokens = Math.Min(capacity, tokens + 1);
+        }
+    }
+
+    private void Refill() {
+        var now = Stopwatch.GetTimestamp();
+        tokens = Math.Min(capacity, tokens + Stopwatch.GetElapsedTime(lastRefill, now).TotalSeconds * refillPerSecond);
+        lastRefill = now;
+    }
+}
@@ -0,0 +1,71 @@
+using System;
+using System.IO;
+using System.Text.Json;
+
+namespace Pebble_Companion;
+
+public record StoredTokens(string AccessToken, string? RefreshToken);
+
+// Persists the Discord OAuth tokens so a restart can AUTHENTICATE straight away
+// instead of going through AUTHORIZE and the token exchange again.
+// The file lives in the per-user application data folder and is only readable
+// by the current user.
+public static class TokenStore {
+    private static readonly string StoreDirectory =
+        Path.Combine(Environment.GetFolderPath(Environment.SpecialFolder.ApplicationData), "PebbleCompanion");
+
+    private static readonly string FilePath = Path.Combine(StoreDirectory, "token.json");
+
+    public static StoredTokens? Load() {
+        try {
+            if (!File.Exists(FilePath)) {
+                return null;
+            }
+
+            var tokens = JsonSerializer.Deserialize(File.ReadAllText(FilePath), DiscordJsonContext.Default.StoredTokens);
+            return string.IsNullOrEmpty(tokens?.AccessToken) ? null : tokens;
+        }
+        catch (Exception ex) {
+            Console.WriteLine($"ERROR: Failed to load cached token: {ex.Message}");
+            return null;
+        }
+    }
+
+    public static void Save(StoredTokens tokens) {
+        try {
+            if (OperatingSystem.IsWindows()) {
+                Directory.CreateDirectory(StoreDirectory);
+            }
+            else {
+                Directory.CreateDirectory(StoreDirectory, UnixFileMode.UserRead | UnixFileMode.UserWrite | UnixFileMode.UserExecute);
+            }
+
+            // Write to a temporary file first so a crash never leaves a truncated token behind.
+            // It is created owner-only, the token is never readable by anyone else, not even briefly.
+            var tempPath = FilePath + ".tmp";
+            File.Delete(tempPath);
+            var options = new FileStreamOptions { Mode = FileMode.CreateNew, Access = FileAccess.Write };
+            if (!OperatingSystem.IsWindows()) {
+                options.UnixCreateMode = UnixFileMode.UserRead | UnixFileMode.UserWrite;
+            }
+
+            using (var file = new FileStream(tempPath, options)) {
+                JsonSerializer.Serialize(file, tokens, DiscordJsonContext.Default.StoredTokens);
+            }
+
+            File.Move(tempPath, FilePath, true);
+        }
+        catch (Exception ex) {
+            Console.WriteLine($"ERROR: Failed to save token: {ex.Message}");
+        }
+    }
+
+    public static void Clear() {
+        try {
+            File.Delete(FilePath);
+        }
+        catch (Exception ex) {
+            Console.WriteLine($"ERROR: Failed to delete cached token: {ex.Message}");
+        }
+    }
+}
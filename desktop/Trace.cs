@@ -0,0 +1,100 @@
+using System;
+using System.Collections.Concurrent;
+using System.Diagnostics;
+using System.Linq;
+
+namespace Pebble_Companion;
+
+// Per-hop latency of traced mute presses. The watch, the phone and this server
+// each measure spans on their own clock; once the watch reports its round trip
+// the spans are combined into a breakdown:
+//   watch     debounce before the command left the watch
+//   bluetooth watch round trip minus everything the phone saw
+//   phone     time spent in the phone's JS, in and out
+//   lan       phone WebSocket round trip minus the server's span
+//   server    our own processing, excluding Discord
+//   discord   SET_VOICE_SETTINGS queued until VOICE_SETTINGS_UPDATE arrived
+public static class Trace {
+    public static readonly string[] Hops = ["watch", "bluetooth", "phone", "lan", "server", "discord"];
+
+    private static readonly TimeSpan TraceTtl = TimeSpan.FromSeconds(30);
+
+    private sealed class Spans {
+        public long Received;
+        public long DiscordSent;
+        public long DiscordResponded;
+        public long Broadcast;
+    }
+
+    private static readonly ConcurrentDictionary<long, Spans> Pending = new();
+
+    public static void Begin(long traceId) {
+        var now = Stopwatch.GetTimestamp();
+        foreach (var (id, spans) in Pending) {
+            if (Stopwatch.GetElapsedTime(spans.Received, now) > TraceTtl) {
+                Pending.TryRemove(id, out _);
+            }
+        }
+
+        Pending[traceId] = new Spans { Received = now };
+    }
+
+    public static void MarkDiscordSent(long traceId) {
+        if (Pending.TryGetValue(traceId, out var spans)) {
+            spans.DiscordSent = Stopwatch.GetTimestamp();
+        }
+    }
+
+    public static void MarkDiscordResponded(long traceId) {
+        if (Pending.TryGetValue(traceId, out var spans)) {
+            spans.DiscordResponded = Stopwatch.GetTimestamp();
+        }
+    }
+
+    public static void MarkBroadcast(long traceId) {
+        if (Pending.TryGetValue(traceId, out var spans)) {
+            spans.Broadcast = Stopwatch.GetTimestamp();
+        }
+    }
+
+    // Longest span a report can claim; anything above is garbage, not latency
+    private const double MaxReportedMs = 60_000;
+
+    public static void Complete(long traceId, double watchDebounceMs, double watchRttMs, double phoneMs,
+        double wsRttMs) {
+        if (!IsValidSpan(watchDebounceMs) || !IsValidSpan(watchRttMs) || !IsValidSpan(phoneMs) ||
+            !IsValidSpan(wsRttMs)) {
+            Pending.TryRemove(traceId, out _);
+            Console.WriteLine($"INFO: Trace {traceId} report has invalid spans, ignoring report");
+            return;
+        }
+
+        if (!Pending.TryRemove(traceId, out var spans) || spans.DiscordSent == 0 || spans.DiscordResponded == 0 ||
+            spans.Broadcast == 0) {
+            Console.WriteLine($"INFO: Incomplete trace {traceId}, ignoring report");
+            return;
+        }
+
+        var serverTotal = Stopwatch.GetElapsedTime(spans.Received, spans.Broadcast);
+        var discord = Stopwatch.GetElapsedTime(spans.DiscordSent, spans.DiscordResponded);
+        var durations = new[] {
+            TimeSpan.FromMilliseconds(watchDebounceMs),
+            NonNegative(TimeSpan.FromMilliseconds(watchRttMs - phoneMs - wsRttMs)),
+            TimeSpan.FromMilliseconds(phoneMs),
+            NonNegative(TimeSpan.FromMilliseconds(wsRttMs) - serverTotal),
+            NonNegative(serverTotal - discord),
+            discord,
+        };
+
+        for (var i = 0; i < Hops.Length; i++) {
+            Metrics.TraceHop(i).Observe(durations[i]);
+        }
+
+        Console.WriteLine($"INFO: Trace {traceId}: " +
+                          string.Join(", ", Hops.Select((hop, i) => $"{hop} {durations[i].TotalMilliseconds:F0}ms")));
+    }
+
+    private static bool IsValidSpan(double ms) => double.IsFinite(ms) && ms is >= 0 and <= MaxReportedMs;
+
+    private static TimeSpan NonNegative(TimeSpan value) => value < TimeSpan.Zero ? TimeSpan.Zero : value;
+}
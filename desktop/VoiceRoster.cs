@@ -0,0 +1,85 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading;
+
+namespace Pebble_Companion;
+
+// Who is in the current voice channel, kept in memory so the watch can page
+// through it without another round trip to Discord. Written from the RPC
+// receive loop and read by the WebSocket clients, hence the lock.
+public sealed class VoiceRoster {
+    // Versions are unique across rosters, so the watch notices when Rpc
+    // switches to another Discord client's roster too
+    private static int _nextVersion;
+
+    private readonly Lock rosterLock = new();
+    private readonly List<Participant> participants = [];
+    private int version;
+
+    public void Reset(List<Participant> newParticipants) {
+        lock (rosterLock) {
+            participants.Clear();
+            participants.AddRange(newParticipants);
+            version = Interlocked.Increment(ref _nextVersion);
+        }
+    }
+
+    public void Clear() {
+        Reset([]);
+    }
+
+    public void Add(Participant participant) {
+        lock (rosterLock) {
+            // GET_CHANNEL and VOICE_STATE_CREATE can both report the same user
+            if (participant.UserId != null && participants.Any(p => p.UserId == participant.UserId)) {
+                return;
+            }
+
+            participants.Add(participant);
+            version = Interlocked.Increment(ref _nextVersion);
+        }
+    }
+
+    public void Remove(string? userId) {
+        lock (rosterLock) {
+            if (userId != null && participants.RemoveAll(p => p.UserId == userId) > 0) {
+                version = Interlocked.Increment(ref _nextVersion);
+            }
+        }
+    }
+
+    // Volume changes don't move rows, so they leave the version alone
+    public void SetVolume(string? userId, int volume) {
+        lock (rosterLock) {
+            var index = participants.FindIndex(p => p.UserId == userId);
+            if (index >= 0) {
+                participants[index] = participants[index] with { Volume = volume };
+            }
+        }
+    }
+
+    // The version changes whenever rows may have shifted, so the watch knows
+    // to drop what it has cached
+    public (int Total, int Version, List<Participant> Page) GetPage(int offset, int count) {
+        lock (rosterLock) {
+            var start = Math.Clamp(offset, 0, participants.Count);
+            var page = participants
+                .Skip(start)
+                .Take(Math.Max(0, count))
+                .ToList();
+            return (participants.Count, version, page);
+        }
+    }
+
+    // A row the watch picked is only trusted if the roster hasn't changed since
+    public string? GetUserId(int row, int expectedVersion) {
+        lock (rosterLock) {
+            if (expectedVersion != version || row < 0 || row >= participants.Count) {
+                return null;
+            }
+
+            return participants[row].UserId;
+        }
+    }
+}
@@ -0,0 +1,93 @@
+using System;
+using System.Collections.Generic;
+using System.Text.Json;
+
+namespace Pebble_Companion;
+
+// Compact, immutable copies of the Discord state the bridge keeps between
+// messages. They are parsed when a message arrives so its JsonDocument can be
+// disposed right away instead of being kept alive by a retained JsonElement,
+// and record equality makes "did anything change?" a cheap comparison.
+
+public sealed record VoiceSettings(bool Mute, bool Deaf) {
+    public static VoiceSettings Parse(JsonElement data) {
+        return new VoiceSettings(data.GetProperty("mute").GetBoolean(), data.GetProperty("deaf").GetBoolean());
+    }
+}
+
+// Type follows Discord: 1 DM, 2 guild voice, 3 group DM
+public sealed record VoiceChannel(string? Id, string? Name, int Type, string? GuildId, int UserCount,
+    string? FirstUserNick) {
+    public static VoiceChannel Parse(JsonElement data) {
+        var userCount = 1; // at least us, when Discord leaves out voice_states
+        string? firstUserNick = null;
+        if (data.TryGetProperty("voice_states", out var voiceStates) && voiceStates.ValueKind == JsonValueKind.Array) {
+            userCount = voiceStates.GetArrayLength();
+            if (userCount > 0 && voiceStates[0].TryGetProperty("nick", out var nick)) {
+                firstUserNick = nick.GetString();
+            }
+        }
+
+        return new VoiceChannel(
+            GetString(data, "id"),
+            GetString(data, "name"),
+            data.GetProperty("type").GetInt32(),
+            GetString(data, "guild_id"),
+            userCount,
+            firstUserNick);
+    }
+
+    private static string? GetString(JsonElement data, string property) {
+        return data.TryGetProperty(property, out var value) && value.ValueKind == JsonValueKind.String
+            ? value.GetString()
+            : null;
+    }
+}
+
+public sealed record Guild(string? Id, string? Name) {
+    public static Guild Parse(JsonElement data) {
+        return new Guild(data.GetProperty("id").GetString(), data.GetProperty("name").GetString());
+    }
+}
+
+// One entry of the current channel's voice_states. Name is what Discord shows:
+// the server nick if set, else the display name, else the username. Volume is
+// our local volume for them, 0-200 with 100 unchanged.
+public sealed record Participant(string? UserId, string Name, int Volume = 100) {
+    public static Participant Parse(JsonElement voiceState) {
+        string? userId = null;
+        string? name = null;
+        if (voiceState.TryGetProperty("user", out var user) && user.ValueKind == JsonValueKind.Object) {
+            userId = user.TryGetProperty("id", out var id) ? id.GetString() : null;
+            if (user.TryGetProperty("global_name", out var globalName) && globalName.ValueKind == JsonValueKind.String) {
+                name = globalName.GetString();
+            }
+            if (name == null && user.TryGetProperty("username", out var username)) {
+                name = username.GetString();
+            }
+        }
+
+        if (voiceState.TryGetProperty("nick", out var nick) && nick.ValueKind == JsonValueKind.String &&
+            !string.IsNullOrEmpty(nick.GetString())) {
+            name = nick.GetString();
+        }
+
+        var volume = 100;
+        if (voiceState.TryGetProperty("volume", out var volumeElement) && volumeElement.ValueKind == JsonValueKind.Number) {
+            volume = Math.Clamp((int)Math.Round(volumeElement.GetDouble()), 0, 200);
+        }
+
+        return new Participant(userId, name ?? "Unknown", volume);
+    }
+
+    public static List<Participant> ParseAll(JsonElement channel) {
+        var participants = new List<Participant>();
+        if (channel.TryGetProperty("voice_states", out var voiceStates) && voiceStates.ValueKind == JsonValueKind.Array) {
+            foreach (var voiceState in voiceStates.EnumerateArray()) {
+                participants.Add(Parse(voiceState));
+            }
+        }
+
+        return participants;
+    }
+}
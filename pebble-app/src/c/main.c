@@ -1,5 +1,7 @@
 #include <pebble.h>
 #include "modules/app_message.h"
+#include "modules/glance.h"
+#include "modules/outbox.h"
 #include "windows/main_window.h"
 #include "windows/loading_window.h"
 #include "windows/join_channel_window.h"
@@ -160,6 +162,15 @@ static void connection_handler(bool is_connected) {
   }
 }
 
+// A button press the phone had to hold back while the desktop was unreachable
+// was dropped, buzz so the user knows it never happened
+static void command_status_handler(CommandKind kind, CommandStatus status) {
+  if (status == COMMAND_STATUS_EXPIRED) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Queued command %d expired", (int)kind);
+    vibes_double_pulse();
+  }
+}
+
 static void init() {
   // Initialize app message system
   init_app_message();
@@ -167,6 +178,7 @@ static void init() {
   // Register for connection updates and voice info
   register_connection_callback(connection_handler);
   register_voice_info_callback(voice_info_callback);
+  register_command_status_callback(command_status_handler);
   
   // Start with the loading window
   loading_window_push();
@@ -177,6 +189,9 @@ static void deinit() {
   if (s_leave_timer) {
     app_timer_cancel(s_leave_timer);
   }
+  
+  glance_deinit();
+  outbox_deinit();
 }
 
 int main() {
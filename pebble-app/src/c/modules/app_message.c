@@ -2,21 +2,64 @@
 #include <string.h>
 #include "../windows/error_window.h"
 #include "../windows/loading_window.h"
+#include "trace.h"
+#include "participants.h"
+#include "glance.h"
+#include "outbox.h"
 
 // State tracking
 static bool s_is_muted = false;
 static bool s_is_deafened = false;
+static bool s_ptt_mode = false;
 
 // Callback storage
 static StateChangeCallback s_state_change_callback = NULL;
 static VoiceInfoCallback s_voice_info_callback = NULL;
 static ConnectionCallback s_connection_callback = NULL;
+static PttModeCallback s_ptt_mode_callback = NULL;
+static CommandStatusCallback s_command_status_callback = NULL;
+
+// Buffer budgets. The firmware allows far bigger inboxes than we want to
+// spend heap on, especially on aplite, so take the smaller of the two.
+#if defined(PBL_PLATFORM_APLITE)
+  #define INBOX_BUDGET 1024
+  #define OUTBOX_BUDGET 256
+  #define REASSEMBLY_BUDGET 2048
+#elif defined(PBL_PLATFORM_EMERY)
+  #define INBOX_BUDGET 4096
+  #define OUTBOX_BUDGET 512
+  #define REASSEMBLY_BUDGET 8192
+#else
+  #define INBOX_BUDGET 2048
+  #define OUTBOX_BUDGET 512
+  #define REASSEMBLY_BUDGET 8192
+#endif
+
+// A message whose fragments stop arriving is dropped after this. It outlasts
+// the phone's retries of a single fragment, about 10s in total.
+#define FRAGMENT_TIMEOUT_MS 12000
+
+static uint32_t s_inbox_size = 0;
+static bool s_inbox_size_reported = false;
+
+// Reassembly of a fragmented message: the phone splits a serialized
+// dictionary into FRAG_DATA chunks that are concatenated back here
+static uint8_t *s_frag_buffer = NULL;
+static uint16_t s_frag_capacity = 0;
+static uint16_t s_frag_length = 0;
+static uint32_t s_frag_id = 0;
+static uint8_t s_frag_next_index = 0;
+static uint8_t s_frag_count = 0;
+static AppTimer *s_frag_timer = NULL;
 
 // Voice info storage
 static char s_server_name[64] = "";
 static char s_voice_channel_name[64] = "";  // Change from "Loading..." to empty string
 static int s_voice_user_count = 0;
 
+// Mute/deafen aren't known until the desktop has sent them
+static bool s_voice_state_known = false;
+
 void register_state_change_callback(StateChangeCallback callback) {
   s_state_change_callback = callback;
 }
@@ -29,9 +72,19 @@ void register_connection_callback(ConnectionCallback callback) {
   s_connection_callback = callback;
 }
 
-void inbox_received_callback(DictionaryIterator *iter, void *context) {
-  APP_LOG(APP_LOG_LEVEL_INFO, "Message received!");
-  
+void register_ptt_mode_callback(PttModeCallback callback) {
+  s_ptt_mode_callback = callback;
+}
+
+void register_command_status_callback(CommandStatusCallback callback) {
+  s_command_status_callback = callback;
+}
+
+bool ptt_mode_enabled(void) {
+  return s_ptt_mode;
+}
+
+static void handle_message(DictionaryIterator *iter) {
   bool state_changed = false;
   bool voice_info_changed = false;
 
@@ -54,6 +107,20 @@ void inbox_received_callback(DictionaryIterator *iter, void *context) {
       strcpy(s_voice_channel_name, "");
       s_voice_user_count = 0;
       strcpy(s_server_name, "");
+      participants_set_count(0);
+      s_voice_state_known = false;
+      glance_set_unknown();
+    }
+  }
+  
+  // Push-to-talk setting from the config page
+  Tuple *ptt_mode_tuple = dict_find(iter, MESSAGE_KEY_PTT_MODE);
+  if (ptt_mode_tuple) {
+    s_ptt_mode = ptt_mode_tuple->value->uint8 != 0;
+    persist_write_bool(PERSIST_KEY_PTT_MODE, s_ptt_mode);
+    APP_LOG(APP_LOG_LEVEL_INFO, "Push-to-talk mode: %d", s_ptt_mode);
+    if (s_ptt_mode_callback) {
+      s_ptt_mode_callback(s_ptt_mode);
     }
   }
   
@@ -71,6 +138,10 @@ void inbox_received_callback(DictionaryIterator *iter, void *context) {
     state_changed = true;
   }
   
+  if (mute_tuple && deafen_tuple) {
+    s_voice_state_known = true;
+  }
+  
   // Check for voice channel info updates
   Tuple *voice_name_tuple = dict_find(iter, MESSAGE_KEY_VOICE_CHANNEL_NAME);
   if(voice_name_tuple) {
@@ -85,6 +156,7 @@ void inbox_received_callback(DictionaryIterator *iter, void *context) {
     s_voice_user_count = user_count_tuple->value->int32;
     voice_info_changed = true;
     APP_LOG(APP_LOG_LEVEL_INFO, "Received user count: %d", s_voice_user_count);
+    participants_set_count(s_voice_user_count > 0 ? s_voice_user_count : 0);
   }
   
   Tuple *server_name_tuple = dict_find(iter, MESSAGE_KEY_VOICE_SERVER_NAME);
@@ -94,6 +166,33 @@ void inbox_received_callback(DictionaryIterator *iter, void *context) {
     APP_LOG(APP_LOG_LEVEL_INFO, "Received server name: %s", s_server_name);
   }
   
+  // A traced mute press has made the round trip
+  Tuple *trace_tuple = dict_find(iter, MESSAGE_KEY_TRACE_ID);
+  if(trace_tuple) {
+    trace_complete(trace_tuple->value->uint32);
+  }
+  
+  // A command pressed while the phone was offline was queued, delivered or dropped
+  Tuple *command_status_tuple = dict_find(iter, MESSAGE_KEY_COMMAND_STATUS);
+  Tuple *command_kind_tuple = dict_find(iter, MESSAGE_KEY_COMMAND_KIND);
+  if(command_status_tuple && command_kind_tuple) {
+    APP_LOG(APP_LOG_LEVEL_INFO, "Command %d status: %d",
+            (int)command_kind_tuple->value->uint8, (int)command_status_tuple->value->uint8);
+    if(s_command_status_callback) {
+      s_command_status_callback((CommandKind)command_kind_tuple->value->uint8,
+                                (CommandStatus)command_status_tuple->value->uint8);
+    }
+  }
+  
+  // A page of the participant list
+  if(dict_find(iter, MESSAGE_KEY_PARTICIPANT_NAMES)) {
+    participants_handle_page(iter);
+  }
+  
+  if ((state_changed || voice_info_changed) && s_voice_state_known) {
+    glance_set_state(s_voice_channel_name, s_is_muted, s_is_deafened);
+  }
+  
   // Notify the UI if state changed and callback is registered
   if(state_changed && s_state_change_callback) {
     s_state_change_callback(s_is_muted, s_is_deafened);
@@ -106,22 +205,148 @@ void inbox_received_callback(DictionaryIterator *iter, void *context) {
   }
 }
   
+// ---------------------- FRAGMENTS ----------------------
+
+static void reset_fragments(void) {
+  if (s_frag_timer) {
+    app_timer_cancel(s_frag_timer);
+    s_frag_timer = NULL;
+  }
+  
+  free(s_frag_buffer);
+  s_frag_buffer = NULL;
+  s_frag_capacity = 0;
+  s_frag_length = 0;
+  s_frag_count = 0;
+  s_frag_next_index = 0;
+}
+
+static void fragment_timeout_callback(void *data) {
+  s_frag_timer = NULL;
+  APP_LOG(APP_LOG_LEVEL_WARNING, "Fragmented message %lu timed out at %d/%d",
+          (unsigned long)s_frag_id, s_frag_next_index, s_frag_count);
+  reset_fragments();
+}
+
+static void handle_fragment(DictionaryIterator *iter) {
+  Tuple *id_tuple = dict_find(iter, MESSAGE_KEY_FRAG_ID);
+  Tuple *index_tuple = dict_find(iter, MESSAGE_KEY_FRAG_INDEX);
+  Tuple *count_tuple = dict_find(iter, MESSAGE_KEY_FRAG_COUNT);
+  Tuple *data_tuple = dict_find(iter, MESSAGE_KEY_FRAG_DATA);
+  if (!id_tuple || !index_tuple || !count_tuple || !data_tuple) {
+    return;
+  }
+  
+  uint32_t id = id_tuple->value->uint32;
+  uint8_t index = index_tuple->value->uint8;
+  uint8_t count = count_tuple->value->uint8;
+  
+  if (index == 0) {
+    // A new message replaces whatever was half received
+    reset_fragments();
+    
+    // Every fragment but the last is as long as the first one
+    uint32_t capacity = (uint32_t)count * data_tuple->length;
+    if (count == 0 || capacity > REASSEMBLY_BUDGET) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Fragmented message %lu too large: %lu bytes",
+              (unsigned long)id, (unsigned long)capacity);
+      return;
+    }
+    
+    s_frag_buffer = malloc(capacity);
+    if (!s_frag_buffer) {
+      return;
+    }
+    s_frag_capacity = capacity;
+    s_frag_id = id;
+    s_frag_count = count;
+  }
+  
+  // AppMessages arrive in order, so a gap means one was lost
+  if (!s_frag_buffer || id != s_frag_id || index != s_frag_next_index || count != s_frag_count ||
+      s_frag_length + data_tuple->length > s_frag_capacity) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Dropping fragment %d of message %lu", index, (unsigned long)id);
+    reset_fragments();
+    return;
+  }
+  
+  memcpy(s_frag_buffer + s_frag_length, data_tuple->value->data, data_tuple->length);
+  s_frag_length += data_tuple->length;
+  s_frag_next_index++;
+  
+  if (s_frag_next_index < s_frag_count) {
+    if (s_frag_timer) {
+      app_timer_reschedule(s_frag_timer, FRAGMENT_TIMEOUT_MS);
+    } else {
+      s_frag_timer = app_timer_register(FRAGMENT_TIMEOUT_MS, fragment_timeout_callback, NULL);
+    }
+    return;
+  }
+  
+  // Complete: read it back as if it had arrived in one piece
+  DictionaryIterator reassembled;
+  if (dict_read_begin_from_buffer(&reassembled, s_frag_buffer, s_frag_length)) {
+    handle_message(&reassembled);
+  }
+  reset_fragments();
+}
+
+// The phone splits anything bigger than our inbox, so it needs to know the size
+static void report_inbox_size(void) {
+  OutboxField fields[] = {
+    { MESSAGE_KEY_INBOX_SIZE, s_inbox_size, 4 },
+  };
+  outbox_post(OUTBOX_SLOT_INBOX_SIZE, fields, ARRAY_LENGTH(fields));
+  s_inbox_size_reported = true;
+}
+
+void inbox_received_callback(DictionaryIterator *iter, void *context) {
+  APP_LOG(APP_LOG_LEVEL_INFO, "Message received!");
+  
+  // The first message shows the phone side is up
+  if (!s_inbox_size_reported) {
+    report_inbox_size();
+  }
+  
+  if (dict_find(iter, MESSAGE_KEY_FRAG_DATA)) {
+    handle_fragment(iter);
+    return;
+  }
+  
+  handle_message(iter);
+}
+  
 void inbox_dropped_callback(AppMessageResult reason, void *context) {
   // A message was received, but had to be dropped
   APP_LOG(APP_LOG_LEVEL_ERROR, "Message dropped. Reason: %d", (int)reason);
 }
 
-void outbox_failed_callback(DictionaryIterator *iter, AppMessageResult reason, void *context) {
-  // The message just sent failed to be delivered
-  APP_LOG(APP_LOG_LEVEL_ERROR, "Message send failed. Reason: %d", (int)reason);
-}
-
 void init_app_message() {
+  s_ptt_mode = persist_exists(PERSIST_KEY_PTT_MODE) && persist_read_bool(PERSIST_KEY_PTT_MODE);
+  
   // Register AppMessage handlers
   app_message_register_inbox_received(inbox_received_callback);
   app_message_register_inbox_dropped(inbox_dropped_callback);
+  app_message_register_outbox_sent(outbox_sent_callback);
   app_message_register_outbox_failed(outbox_failed_callback);
   
-  // Open AppMessage with adequate buffer sizes
-  app_message_open(256, 256);
+  // Open AppMessage with the largest buffers the platform budget allows
+  uint32_t inbox_size = app_message_inbox_size_maximum();
+  uint32_t outbox_size = app_message_outbox_size_maximum();
+  if (inbox_size > INBOX_BUDGET) {
+    inbox_size = INBOX_BUDGET;
+  }
+  if (outbox_size > OUTBOX_BUDGET) {
+    outbox_size = OUTBOX_BUDGET;
+  }
+  
+  if (app_message_open(inbox_size, outbox_size) == APP_MSG_OK) {
+    s_inbox_size = inbox_size;
+  } else {
+    // Fall back to what has always worked everywhere
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Couldn't open AppMessage with %lu/%lu bytes",
+            (unsigned long)inbox_size, (unsigned long)outbox_size);
+    app_message_open(256, 256);
+    s_inbox_size = 256;
+  }
 }
\ No newline at end of file
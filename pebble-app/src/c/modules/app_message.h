@@ -2,17 +2,41 @@
 
 #include <pebble.h>
 
+// Persistent storage keys
+#define PERSIST_KEY_PTT_MODE 1
+#define PERSIST_KEY_GLANCE_TEXT 2
+#define PERSIST_KEY_GLANCE_EXPIRY 3
+
+// Commands the phone couldn't deliver right away report back what became of them
+typedef enum {
+  COMMAND_KIND_MUTE = 0,
+  COMMAND_KIND_DEAFEN = 1,
+  COMMAND_KIND_LEAVE = 2,
+  COMMAND_KIND_PTT = 3,
+} CommandKind;
+
+typedef enum {
+  COMMAND_STATUS_DELIVERED = 0,
+  COMMAND_STATUS_QUEUED = 1,
+  COMMAND_STATUS_EXPIRED = 2,
+} CommandStatus;
+
 // Callback types
 typedef void (*StateChangeCallback)(bool is_muted, bool is_deafened);
 typedef void (*VoiceInfoCallback)(const char* channel_name, int user_count, const char* topic);
 typedef void (*ConnectionCallback)(bool is_connected);
+typedef void (*PttModeCallback)(bool enabled);
+typedef void (*CommandStatusCallback)(CommandKind kind, CommandStatus status);
 
 void register_state_change_callback(StateChangeCallback callback);
 void register_voice_info_callback(VoiceInfoCallback callback);
 void register_connection_callback(ConnectionCallback callback);
+void register_ptt_mode_callback(PttModeCallback callback);
+void register_command_status_callback(CommandStatusCallback callback);
+
+bool ptt_mode_enabled(void);
 
 void inbox_received_callback(DictionaryIterator *iterator, void *context);
 void inbox_dropped_callback(AppMessageResult reason, void *context);
-void outbox_failed_callback(DictionaryIterator *iterator, AppMessageResult reason, void *context);
 
 void init_app_message(void);
\ No newline at end of file
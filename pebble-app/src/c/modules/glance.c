@@ -0,0 +1,141 @@
+#include "glance.h"
+#include "app_message.h"
+#include <string.h>
+
+#define GLANCE_TEXT_LEN 80
+
+// Reloading the glance writes to flash, so changes are batched to at most
+// one reload a minute while the app runs; exit publishes whatever is pending
+#define GLANCE_MIN_INTERVAL_S 60
+
+// The desktop can change state after we exit, so don't show it for long
+#define GLANCE_TTL_S (30 * 60)
+
+// Republish an unchanged glance when it's this close to expiring
+#define GLANCE_REFRESH_MARGIN_S (10 * 60)
+
+static char s_desired[GLANCE_TEXT_LEN] = "";
+static char s_published[GLANCE_TEXT_LEN] = "";
+static time_t s_published_expiry = 0;
+static bool s_loaded = false;
+static time_t s_last_reload = 0;
+static AppTimer *s_reload_timer = NULL;
+
+static void load_published(void) {
+  if (s_loaded) {
+    return;
+  }
+  s_loaded = true;
+  
+  if (persist_exists(PERSIST_KEY_GLANCE_TEXT)) {
+    persist_read_string(PERSIST_KEY_GLANCE_TEXT, s_published, sizeof(s_published));
+    s_published_expiry = persist_read_int(PERSIST_KEY_GLANCE_EXPIRY);
+  }
+}
+
+static bool is_up_to_date(void) {
+  if (strcmp(s_desired, s_published) != 0) {
+    return false;
+  }
+  
+  // No slice expires, and a published one still has a while to go
+  return s_desired[0] == '\0' || s_published_expiry - time(NULL) > GLANCE_REFRESH_MARGIN_S;
+}
+
+static void prv_update_app_glance(AppGlanceReloadSession *session, size_t limit, void *context) {
+  // An empty state publishes no slice, which clears the glance
+  if (limit < 1 || s_desired[0] == '\0') {
+    return;
+  }
+  
+  const AppGlanceSlice slice = {
+    .layout = {
+      .icon = APP_GLANCE_SLICE_DEFAULT_ICON,
+      .subtitle_template_string = s_desired,
+    },
+    .expiration_time = s_published_expiry
+  };
+  
+  AppGlanceResult result = app_glance_add_slice(session, slice);
+  if (result != APP_GLANCE_RESULT_SUCCESS) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to add app glance: %d", result);
+  }
+}
+
+static void publish(void) {
+  if (s_reload_timer) {
+    app_timer_cancel(s_reload_timer);
+    s_reload_timer = NULL;
+  }
+  
+  if (is_up_to_date()) {
+    return;
+  }
+  
+  s_last_reload = time(NULL);
+  s_published_expiry = s_last_reload + GLANCE_TTL_S;
+  app_glance_reload(prv_update_app_glance, NULL);
+  
+  strcpy(s_published, s_desired);
+  persist_write_string(PERSIST_KEY_GLANCE_TEXT, s_published);
+  persist_write_int(PERSIST_KEY_GLANCE_EXPIRY, s_published_expiry);
+  APP_LOG(APP_LOG_LEVEL_INFO, "Published app glance: '%s'", s_published);
+}
+
+static void reload_timer_callback(void *data) {
+  s_reload_timer = NULL;
+  publish();
+}
+
+static void schedule_publish(void) {
+  load_published();
+  
+  if (is_up_to_date()) {
+    // Changed and changed back before the reload ran
+    if (s_reload_timer) {
+      app_timer_cancel(s_reload_timer);
+      s_reload_timer = NULL;
+    }
+    return;
+  }
+  
+  if (s_reload_timer) {
+    return;
+  }
+  
+  time_t wait_s = s_last_reload + GLANCE_MIN_INTERVAL_S - time(NULL);
+  if (wait_s < 0) {
+    wait_s = 0;
+  }
+  s_reload_timer = app_timer_register(wait_s * 1000, reload_timer_callback, NULL);
+}
+
+void glance_set_state(const char *channel_name, bool is_muted, bool is_deafened) {
+  const char *status = is_deafened ? "Deafened" : is_muted ? "Muted" : "Unmuted";
+  
+  if (channel_name[0] == '\0') {
+    snprintf(s_desired, sizeof(s_desired), "%s, not in a channel", status);
+  } else {
+    snprintf(s_desired, sizeof(s_desired), "%s in %s", status, channel_name);
+  }
+  
+  // Braces would be read as template syntax
+  for (char *c = s_desired; *c; c++) {
+    if (*c == '{' || *c == '}') {
+      *c = '(';
+    }
+  }
+  
+  schedule_publish();
+}
+
+void glance_set_unknown(void) {
+  s_desired[0] = '\0';
+  schedule_publish();
+}
+
+void glance_deinit(void) {
+  if (s_reload_timer) {
+    publish();
+  }
+}
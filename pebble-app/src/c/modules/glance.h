@@ -0,0 +1,15 @@
+#pragma once
+
+#include <pebble.h>
+
+// Launcher glance showing the last known voice state, so checking whether
+// you're muted doesn't need the app (and a connection to the desktop).
+
+// Latest state from the desktop; only real changes lead to a glance reload
+void glance_set_state(const char *channel_name, bool is_muted, bool is_deafened);
+
+// Lost the desktop: the glance is removed rather than left showing stale state
+void glance_set_unknown(void);
+
+// Publishes a pending change right away, call on exit
+void glance_deinit(void);
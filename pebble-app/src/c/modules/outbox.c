@@ -0,0 +1,216 @@
+#include "outbox.h"
+#include <string.h>
+
+// Backoff after a NACK, a timeout or a busy outbox: 100ms doubling up to 3.2s,
+// about 10s in total before a message is given up on
+#define RETRY_BASE_MS 100
+#define RETRY_MAX_MS 3200
+#define MAX_ATTEMPTS 8
+
+#define NO_SLOT -1
+
+typedef struct {
+  OutboxField fields[OUTBOX_MAX_FIELDS];
+  uint8_t count;
+  uint8_t attempts;
+  bool queued;
+} OutboxMessage;
+
+static OutboxMessage s_messages[OUTBOX_SLOT_COUNT];
+
+// Queued slots in send order. Each slot is in here at most once, so it can
+// never hold more than OUTBOX_SLOT_COUNT entries.
+static uint8_t s_order[OUTBOX_SLOT_COUNT];
+static uint8_t s_queued = 0;
+
+// The message AppMessage is sending right now, kept apart from its slot so a
+// newer post to the same slot can queue behind it
+static int s_inflight_slot = NO_SLOT;
+static OutboxMessage s_inflight;
+
+static AppTimer *s_retry_timer = NULL;
+static OutboxStateCallback s_state_callback = NULL;
+
+static void send_next(void);
+
+void register_outbox_state_callback(OutboxStateCallback callback) {
+  s_state_callback = callback;
+}
+
+static void notify(OutboxSlot slot, OutboxState state) {
+  if (s_state_callback) {
+    s_state_callback(slot, state);
+  }
+}
+
+bool outbox_is_pending(OutboxSlot slot) {
+  return s_messages[slot].queued || s_inflight_slot == (int)slot;
+}
+
+// ---------------------- QUEUE ----------------------
+
+static void remove_from_order(OutboxSlot slot) {
+  for (uint8_t i = 0; i < s_queued; i++) {
+    if (s_order[i] == slot) {
+      memmove(&s_order[i], &s_order[i + 1], s_queued - i - 1);
+      s_queued--;
+      return;
+    }
+  }
+}
+
+static void push_front(OutboxSlot slot) {
+  memmove(&s_order[1], &s_order[0], s_queued);
+  s_order[0] = slot;
+  s_queued++;
+}
+
+void outbox_post(OutboxSlot slot, const OutboxField *fields, uint8_t count) {
+  if (count > OUTBOX_MAX_FIELDS) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Outbox message for slot %d has %d fields", (int)slot, (int)count);
+    return;
+  }
+
+  bool was_pending = outbox_is_pending(slot);
+  OutboxMessage *message = &s_messages[slot];
+  memcpy(message->fields, fields, count * sizeof(OutboxField));
+  message->count = count;
+
+  if (message->queued) {
+    // Coalesced: keeps its place, the older contents are never sent
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Outbox slot %d replaced before sending", (int)slot);
+  } else {
+    message->attempts = 0;
+    message->queued = true;
+    s_order[s_queued++] = slot;
+  }
+
+  if (!was_pending) {
+    notify(slot, OUTBOX_STATE_PENDING);
+  }
+  send_next();
+}
+
+// ---------------------- SENDING ----------------------
+
+static void retry_timer_callback(void *data) {
+  s_retry_timer = NULL;
+  send_next();
+}
+
+// The front slot failed to go out. Wait before the next try so a busy or
+// unreachable phone isn't hammered, or drop it once it keeps failing.
+static void back_off(AppMessageResult reason) {
+  OutboxSlot slot = s_order[0];
+  OutboxMessage *message = &s_messages[slot];
+  message->attempts++;
+
+  if (message->attempts >= MAX_ATTEMPTS) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Giving up on outbox slot %d after %d attempts, reason %d",
+            (int)slot, (int)message->attempts, (int)reason);
+    remove_from_order(slot);
+    message->queued = false;
+    notify(slot, OUTBOX_STATE_FAILED);
+    send_next();
+    return;
+  }
+
+  uint32_t delay = RETRY_BASE_MS << (message->attempts - 1);
+  if (delay > RETRY_MAX_MS) {
+    delay = RETRY_MAX_MS;
+  }
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Outbox slot %d failed with %d, retrying in %lums",
+          (int)slot, (int)reason, (unsigned long)delay);
+  s_retry_timer = app_timer_register(delay, retry_timer_callback, NULL);
+}
+
+static void write_field(DictionaryIterator *iter, const OutboxField *field) {
+  switch (field->width) {
+    case 1:
+      dict_write_uint8(iter, field->key, (uint8_t)field->value);
+      break;
+    case 2:
+      dict_write_uint16(iter, field->key, (uint16_t)field->value);
+      break;
+    default:
+      dict_write_uint32(iter, field->key, field->value);
+      break;
+  }
+}
+
+static void send_next(void) {
+  if (s_inflight_slot != NO_SLOT || s_retry_timer || s_queued == 0) {
+    return;
+  }
+
+  OutboxSlot slot = s_order[0];
+  OutboxMessage *message = &s_messages[slot];
+
+  DictionaryIterator *iter;
+  AppMessageResult result = app_message_outbox_begin(&iter);
+  if (result == APP_MSG_OK && iter == NULL) {
+    result = APP_MSG_BUSY;
+  }
+  if (result == APP_MSG_OK) {
+    for (uint8_t i = 0; i < message->count; i++) {
+      write_field(iter, &message->fields[i]);
+    }
+    result = app_message_outbox_send();
+  }
+
+  if (result != APP_MSG_OK) {
+    back_off(result);
+    return;
+  }
+
+  s_inflight = *message;
+  s_inflight_slot = slot;
+  message->queued = false;
+  remove_from_order(slot);
+}
+
+void outbox_sent_callback(DictionaryIterator *iter, void *context) {
+  if (s_inflight_slot == NO_SLOT) {
+    return;
+  }
+
+  OutboxSlot slot = (OutboxSlot)s_inflight_slot;
+  s_inflight_slot = NO_SLOT;
+
+  // Still pending if it was posted to again while this one was in flight
+  if (!outbox_is_pending(slot)) {
+    notify(slot, OUTBOX_STATE_SENT);
+  }
+  send_next();
+}
+
+void outbox_failed_callback(DictionaryIterator *iter, AppMessageResult reason, void *context) {
+  APP_LOG(APP_LOG_LEVEL_ERROR, "Message send failed. Reason: %d", (int)reason);
+  if (s_inflight_slot == NO_SLOT) {
+    return;
+  }
+
+  // Back to the front of the queue. If the slot was posted to meanwhile the
+  // newer contents go instead, but the backoff carries on from this attempt.
+  OutboxSlot slot = (OutboxSlot)s_inflight_slot;
+  s_inflight_slot = NO_SLOT;
+
+  OutboxMessage *message = &s_messages[slot];
+  if (message->queued) {
+    remove_from_order(slot);
+    message->attempts = s_inflight.attempts;
+  } else {
+    *message = s_inflight;
+    message->queued = true;
+  }
+  push_front(slot);
+
+  back_off(reason);
+}
+
+void outbox_deinit(void) {
+  if (s_retry_timer) {
+    app_timer_cancel(s_retry_timer);
+    s_retry_timer = NULL;
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <pebble.h>
+
+// Every message to the phone goes through here. AppMessage takes one message
+// at a time, and a sender that called app_message_outbox_begin while another
+// was in flight simply lost its message. Senders now post to a slot instead:
+// slots go out in the order they were posted, one in flight at a time, and
+// posting to a slot that is still waiting replaces its contents, so only the
+// latest intent per slot is sent. Failed sends are retried with backoff.
+
+typedef enum {
+  OUTBOX_SLOT_MUTE,
+  OUTBOX_SLOT_DEAFEN,
+  OUTBOX_SLOT_PTT,
+  OUTBOX_SLOT_LEAVE,
+  OUTBOX_SLOT_VOLUME,
+  OUTBOX_SLOT_PARTICIPANTS,
+  OUTBOX_SLOT_TRACE,
+  OUTBOX_SLOT_INBOX_SIZE,
+  OUTBOX_SLOT_COUNT,
+} OutboxSlot;
+
+typedef enum {
+  OUTBOX_STATE_PENDING,  // queued or in flight
+  OUTBOX_STATE_SENT,     // acked by the phone
+  OUTBOX_STATE_FAILED,   // given up on after repeated failures
+} OutboxState;
+
+#define OUTBOX_MAX_FIELDS 3
+
+typedef struct {
+  uint32_t key;
+  uint32_t value;
+  uint8_t width;  // 1, 2 or 4 bytes, unsigned
+} OutboxField;
+
+typedef void (*OutboxStateCallback)(OutboxSlot slot, OutboxState state);
+
+// Queues a message for the slot, replacing one that hasn't been sent yet
+void outbox_post(OutboxSlot slot, const OutboxField *fields, uint8_t count);
+
+// True while the slot has a message queued or in flight
+bool outbox_is_pending(OutboxSlot slot);
+
+void register_outbox_state_callback(OutboxStateCallback callback);
+
+void outbox_deinit(void);
+
+// Registered with AppMessage by init_app_message
+void outbox_sent_callback(DictionaryIterator *iter, void *context);
+void outbox_failed_callback(DictionaryIterator *iter, AppMessageResult reason, void *context);
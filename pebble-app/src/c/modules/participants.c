@@ -0,0 +1,303 @@
+#include "participants.h"
+#include "outbox.h"
+#include <string.h>
+
+// Fewer rows fit in aplite's heap
+#if defined(PBL_PLATFORM_APLITE)
+  #define CACHE_ROWS 10
+#else
+  #define CACHE_ROWS 30
+#endif
+
+#define REQUEST_TIMEOUT_MS 3000
+#define NO_PAGE -1
+
+// Names are interned: rows with the same name share one slot
+typedef struct {
+  char name[PARTICIPANT_NAME_LEN];
+  uint8_t refs;
+} NameSlot;
+
+typedef struct {
+  int16_t row;      // -1 when empty
+  uint8_t slot;
+  uint8_t volume;
+  uint32_t last_used;
+} CacheEntry;
+
+static NameSlot *s_slots = NULL;
+static CacheEntry *s_entries = NULL;
+static uint32_t s_clock = 0;
+
+static uint16_t s_count = 0;
+static uint32_t s_version = 0;
+static bool s_active = false;
+
+// One page request in flight, plus the next one wanted
+static int32_t s_inflight_offset = NO_PAGE;
+static int32_t s_wanted_offset = NO_PAGE;
+static AppTimer *s_request_timer = NULL;
+
+static ParticipantsChangedCallback s_changed_callback = NULL;
+
+static void send_wanted_page(void);
+
+// ---------------------- CACHE ----------------------
+
+static void clear_cache(void) {
+  for (int i = 0; i < CACHE_ROWS; i++) {
+    s_entries[i].row = -1;
+    s_slots[i].refs = 0;
+  }
+}
+
+static CacheEntry *find_entry(uint16_t row) {
+  for (int i = 0; i < CACHE_ROWS; i++) {
+    if (s_entries[i].row == row) {
+      return &s_entries[i];
+    }
+  }
+  return NULL;
+}
+
+// Copies at most PARTICIPANT_NAME_LEN - 1 bytes without splitting a UTF-8 sequence
+static void copy_truncated(char *dest, const char *src, size_t len) {
+  if (len > PARTICIPANT_NAME_LEN - 1) {
+    len = PARTICIPANT_NAME_LEN - 1;
+    while (len > 0 && ((uint8_t)src[len] & 0xC0) == 0x80) {
+      len--;
+    }
+  }
+  memcpy(dest, src, len);
+  dest[len] = '\0';
+}
+
+static int intern_name(const char *name, size_t len) {
+  char truncated[PARTICIPANT_NAME_LEN];
+  copy_truncated(truncated, name, len);
+  
+  int free_slot = -1;
+  for (int i = 0; i < CACHE_ROWS; i++) {
+    if (s_slots[i].refs > 0 && strcmp(s_slots[i].name, truncated) == 0) {
+      s_slots[i].refs++;
+      return i;
+    }
+    if (s_slots[i].refs == 0 && free_slot < 0) {
+      free_slot = i;
+    }
+  }
+  
+  // There are as many slots as entries, so one is always free here
+  strcpy(s_slots[free_slot].name, truncated);
+  s_slots[free_slot].refs = 1;
+  return free_slot;
+}
+
+static void store_row(uint16_t row, const char *name, size_t len, uint8_t volume) {
+  CacheEntry *entry = find_entry(row);
+  if (!entry) {
+    // Take an empty entry, or evict the least recently used one
+    entry = &s_entries[0];
+    for (int i = 0; i < CACHE_ROWS; i++) {
+      if (s_entries[i].row < 0) {
+        entry = &s_entries[i];
+        break;
+      }
+      if (s_entries[i].last_used < entry->last_used) {
+        entry = &s_entries[i];
+      }
+    }
+  }
+  
+  if (entry->row >= 0) {
+    s_slots[entry->slot].refs--;
+  }
+  
+  entry->row = row;
+  entry->slot = intern_name(name, len);
+  entry->volume = volume;
+  entry->last_used = ++s_clock;
+}
+
+// ---------------------- REQUESTS ----------------------
+
+static void request_timer_callback(void *data) {
+  s_request_timer = NULL;
+  
+  if (s_inflight_offset != NO_PAGE) {
+    // Lost somewhere between here and the desktop, ask again if still needed
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Participant page %ld timed out", (long)s_inflight_offset);
+    if (s_wanted_offset == NO_PAGE) {
+      s_wanted_offset = s_inflight_offset;
+    }
+    s_inflight_offset = NO_PAGE;
+  }
+  
+  send_wanted_page();
+}
+
+static void send_wanted_page(void) {
+  if (!s_active || s_inflight_offset != NO_PAGE || s_wanted_offset == NO_PAGE) {
+    return;
+  }
+  
+  OutboxField fields[] = {
+    { MESSAGE_KEY_PARTICIPANT_OFFSET, (uint32_t)s_wanted_offset, 2 },
+    { MESSAGE_KEY_PARTICIPANT_COUNT, PARTICIPANTS_PAGE_SIZE, 1 },
+  };
+  outbox_post(OUTBOX_SLOT_PARTICIPANTS, fields, ARRAY_LENGTH(fields));
+  
+  s_inflight_offset = s_wanted_offset;
+  s_wanted_offset = NO_PAGE;
+  
+  if (s_request_timer) {
+    app_timer_reschedule(s_request_timer, REQUEST_TIMEOUT_MS);
+  } else {
+    s_request_timer = app_timer_register(REQUEST_TIMEOUT_MS, request_timer_callback, NULL);
+  }
+}
+
+static void want_page(uint16_t row) {
+  int32_t offset = row - row % PARTICIPANTS_PAGE_SIZE;
+  if (offset == s_inflight_offset) {
+    return;
+  }
+  
+  // The newest need wins: when scrolling fast, skip the pages scrolled past
+  s_wanted_offset = offset;
+  send_wanted_page();
+}
+
+// ---------------------- API ----------------------
+
+void participants_init(ParticipantsChangedCallback callback) {
+  s_slots = malloc(sizeof(NameSlot) * CACHE_ROWS);
+  s_entries = malloc(sizeof(CacheEntry) * CACHE_ROWS);
+  clear_cache();
+  
+  s_changed_callback = callback;
+  s_inflight_offset = NO_PAGE;
+  s_wanted_offset = NO_PAGE;
+  s_active = true;
+  
+  if (s_count > 0) {
+    want_page(0);
+  }
+}
+
+void participants_deinit(void) {
+  s_active = false;
+  s_changed_callback = NULL;
+  
+  if (s_request_timer) {
+    app_timer_cancel(s_request_timer);
+    s_request_timer = NULL;
+  }
+  
+  free(s_slots);
+  free(s_entries);
+  s_slots = NULL;
+  s_entries = NULL;
+}
+
+uint16_t participants_count(void) {
+  return s_count;
+}
+
+const char *participants_get(uint16_t row) {
+  if (!s_active) {
+    return NULL;
+  }
+  
+  CacheEntry *entry = find_entry(row);
+  if (!entry) {
+    want_page(row);
+    return NULL;
+  }
+  
+  entry->last_used = ++s_clock;
+  return s_slots[entry->slot].name;
+}
+
+int participants_get_volume(uint16_t row) {
+  CacheEntry *entry = s_active ? find_entry(row) : NULL;
+  return entry ? entry->volume : -1;
+}
+
+void participants_set_volume(uint16_t row, uint8_t volume) {
+  CacheEntry *entry = s_active ? find_entry(row) : NULL;
+  if (entry) {
+    entry->volume = volume;
+  }
+}
+
+uint32_t participants_version(void) {
+  return s_version;
+}
+
+void participants_prefetch(uint16_t row) {
+  if (s_active && row < s_count && !find_entry(row)) {
+    want_page(row);
+  }
+}
+
+void participants_set_count(uint16_t count) {
+  if (count == s_count) {
+    return;
+  }
+  
+  // Someone joined or left, cached rows may have shifted
+  s_count = count;
+  if (s_active) {
+    clear_cache();
+    if (s_changed_callback) {
+      s_changed_callback();
+    }
+  }
+}
+
+void participants_handle_page(DictionaryIterator *iter) {
+  Tuple *names_tuple = dict_find(iter, MESSAGE_KEY_PARTICIPANT_NAMES);
+  Tuple *offset_tuple = dict_find(iter, MESSAGE_KEY_PARTICIPANT_OFFSET);
+  Tuple *total_tuple = dict_find(iter, MESSAGE_KEY_PARTICIPANT_TOTAL);
+  Tuple *version_tuple = dict_find(iter, MESSAGE_KEY_PARTICIPANT_VERSION);
+  Tuple *volumes_tuple = dict_find(iter, MESSAGE_KEY_PARTICIPANT_VOLUMES);
+  if (!names_tuple || !offset_tuple || !total_tuple || !version_tuple || !s_active) {
+    return;
+  }
+  
+  uint16_t offset = offset_tuple->value->uint16;
+  uint32_t version = version_tuple->value->uint32;
+  if (version != s_version) {
+    // The roster changed on the desktop since the cached rows were fetched
+    clear_cache();
+    s_version = version;
+  }
+  s_count = total_tuple->value->uint16;
+  
+  // Names arrive newline separated, volumes as one byte per name
+  const char *name = names_tuple->value->cstring;
+  uint16_t row = offset;
+  uint16_t index = 0;
+  while (*name && row < s_count) {
+    const char *end = strchr(name, '\n');
+    size_t len = end ? (size_t)(end - name) : strlen(name);
+    uint8_t volume = volumes_tuple && index < volumes_tuple->length ? volumes_tuple->value->data[index] : 100;
+    store_row(row++, name, len, volume);
+    index++;
+    if (!end) {
+      break;
+    }
+    name = end + 1;
+  }
+  
+  if (s_inflight_offset == offset) {
+    s_inflight_offset = NO_PAGE;
+  }
+  
+  if (s_changed_callback) {
+    s_changed_callback();
+  }
+  
+  send_wanted_page();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <pebble.h>
+
+// Participant names for the current voice channel, fetched page by page from
+// the desktop. Only a small LRU of rows is kept in RAM, so scrolling a large
+// channel never holds the whole roster on the watch.
+
+#define PARTICIPANTS_PAGE_SIZE 5
+#define PARTICIPANT_NAME_LEN 24
+
+typedef void (*ParticipantsChangedCallback)(void);
+
+void participants_init(ParticipantsChangedCallback callback);
+void participants_deinit(void);
+
+uint16_t participants_count(void);
+
+// Cached name for a row, or NULL while its page is being fetched
+const char *participants_get(uint16_t row);
+
+// Volume in Discord's 0-200 range, or -1 while unknown
+int participants_get_volume(uint16_t row);
+
+// Records a volume set from the watch so the list shows it without a refetch
+void participants_set_volume(uint16_t row, uint8_t volume);
+
+// Rows are only meaningful together with the roster version they came from
+uint32_t participants_version(void);
+
+// Fetches the page containing this row if it is not cached yet
+void participants_prefetch(uint16_t row);
+
+// Called from the inbox handler
+void participants_handle_page(DictionaryIterator *iter);
+void participants_set_count(uint16_t count);
@@ -0,0 +1,54 @@
+#include "trace.h"
+#include "outbox.h"
+
+static uint32_t s_next_trace_id = 1;
+static uint32_t s_trace_id = 0;
+static uint64_t s_pressed_at = 0;
+static uint64_t s_sent_at = 0;
+
+static uint64_t now_ms(void) {
+  time_t seconds;
+  uint16_t millis;
+  time_ms(&seconds, &millis);
+  return (uint64_t)seconds * 1000 + millis;
+}
+
+void trace_begin(void) {
+  // Presses inside the debounce window belong to the same command
+  if (s_trace_id != 0 && s_sent_at == 0) {
+    return;
+  }
+  
+  s_trace_id = s_next_trace_id++;
+  s_pressed_at = now_ms();
+  s_sent_at = 0;
+}
+
+uint32_t trace_mark_sent(void) {
+  if (s_trace_id == 0 || s_sent_at != 0) {
+    return 0;
+  }
+  
+  s_sent_at = now_ms();
+  return s_trace_id;
+}
+
+void trace_complete(uint32_t trace_id) {
+  if (trace_id != s_trace_id || s_sent_at == 0) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Ignoring reply for stale trace %lu", (unsigned long)trace_id);
+    return;
+  }
+  
+  uint32_t rtt = (uint32_t)(now_ms() - s_sent_at);
+  uint32_t debounce = (uint32_t)(s_sent_at - s_pressed_at);
+  s_trace_id = 0;
+  APP_LOG(APP_LOG_LEVEL_INFO, "Trace %lu: %lums debounce, %lums round trip",
+          (unsigned long)trace_id, (unsigned long)debounce, (unsigned long)rtt);
+  
+  OutboxField fields[] = {
+    { MESSAGE_KEY_TRACE_ID, trace_id, 4 },
+    { MESSAGE_KEY_TRACE_RTT, rtt, 4 },
+    { MESSAGE_KEY_TRACE_DEBOUNCE, debounce, 4 },
+  };
+  outbox_post(OUTBOX_SLOT_TRACE, fields, ARRAY_LENGTH(fields));
+}
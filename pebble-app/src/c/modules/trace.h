@@ -0,0 +1,18 @@
+#pragma once
+
+#include <pebble.h>
+
+// End-to-end tracing of mute presses. A trace id starts at the press, travels
+// with SET_MUTE through the phone and the desktop server and comes back on the
+// resulting MUTE_STATE. The watch then reports how long it waited so the
+// server can break the latency down per hop.
+
+// Starts a trace for a new press, unless one is already waiting to be sent
+void trace_begin(void);
+
+// Id to attach to the outgoing command (0 when nothing is being traced);
+// marks the moment the command left the watch
+uint32_t trace_mark_sent(void);
+
+// Called with the TRACE_ID echoed back by the phone
+void trace_complete(uint32_t trace_id);
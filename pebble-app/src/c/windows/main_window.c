@@ -1,5 +1,8 @@
 #include "main_window.h"
 #include "../modules/app_message.h"
+#include "../modules/trace.h"
+#include "../modules/outbox.h"
+#include "participants_window.h"
 #include <pebble.h>
 
 // ---------------------- DECLARATIONS ----------------------
@@ -42,6 +45,20 @@ static bool s_is_in_channel = false;
 static bool s_is_window_loaded = false;
 static bool s_has_pending_data = false;
 
+// Debounced mute/deafen presses: a burst of presses collapses into one
+// SET_MUTE / SET_DEAFEN carrying the final desired state
+#define PRESS_DEBOUNCE_MS 300
+static AppTimer *s_mute_debounce_timer = NULL;
+static AppTimer *s_deafen_debounce_timer = NULL;
+static bool s_desired_mute = false;
+static bool s_desired_deafen = false;
+
+// Push-to-talk: holding Select unmutes, releasing mutes again. Every edge
+// carries a sequence number so the desktop can drop out-of-order events.
+#define PTT_HOLD_DELAY_MS 150
+static bool s_ptt_talking = false;
+static uint32_t s_ptt_seq = 0;
+
 // Voice info storage
 static char s_server_name_text[64] = "";
 static char s_channel_name_text[64] = "";
@@ -66,16 +83,10 @@ static Layer *s_confirm_icon_layer;
 
 static void confirm_yes_click_handler(ClickRecognizerRef recognizer, void *context) {
   // Send the leave channel message
-  DictionaryIterator *iter;
-  app_message_outbox_begin(&iter);
-  
-  if (iter == NULL) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Cannot create outbox for leave channel message");
-    return;
-  }
-  
-  dict_write_uint8(iter, MESSAGE_KEY_LEAVE_CHANNEL, 1);
-  app_message_outbox_send();
+  OutboxField fields[] = {
+    { MESSAGE_KEY_LEAVE_CHANNEL, 1, 1 },
+  };
+  outbox_post(OUTBOX_SLOT_LEAVE, fields, ARRAY_LENGTH(fields));
   
   // Close the confirmation window
   window_stack_remove(s_confirm_window, true);
@@ -194,24 +205,6 @@ static void show_leave_confirmation(void) {
   window_stack_push(s_confirm_window, true);
 }
 
-// ---------------------- APP GLANCE ----------------------
-
-static void prv_update_app_glance(AppGlanceReloadSession *session, size_t limit, void *context) {
-  return; // Disable AppGlance for now
-  const AppGlanceSlice slice = {
-    .layout = {
-      .icon = APP_GLANCE_SLICE_DEFAULT_ICON,
-      .subtitle_template_string = s_channel_name_text,
-    },
-    .expiration_time = time(NULL) + 30 * 60 // Expire after 30 minutes
-  };
-  
-  AppGlanceResult result = app_glance_add_slice(session, slice);
-  if (result != APP_GLANCE_RESULT_SUCCESS) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to add app glance: %d", result);
-  }
-}
-
 // ---------------------- UI LAYOUT FUNCTIONS ----------------------
 
 static void update_layout(void) {
@@ -302,6 +295,18 @@ static void voice_info_handler(const char* channel_name, int user_count, const c
   update_layout();
 }
 
+// While a press is still being debounced, show the state the user asked for
+static bool displayed_muted(void) {
+  if (s_ptt_talking) {
+    return false;
+  }
+  return s_mute_debounce_timer ? s_desired_mute : s_is_muted;
+}
+
+static bool displayed_deafened(void) {
+  return s_deafen_debounce_timer ? s_desired_deafen : s_is_deafened;
+}
+
 static void update_discord_icon(void) {
   // Free the existing icon if it exists
   if (s_discord_icon) {
@@ -309,9 +314,9 @@ static void update_discord_icon(void) {
   }
   
   // Choose the appropriate icon based on status
-  if (s_is_deafened) {
+  if (displayed_deafened()) {
     s_discord_icon = gdraw_command_image_create_with_resource(RESOURCE_ID_STATUS_DEAFENED);
-  } else if (s_is_muted) {
+  } else if (displayed_muted()) {
     s_discord_icon = gdraw_command_image_create_with_resource(RESOURCE_ID_STATUS_MUTED);
   } else {
     s_discord_icon = gdraw_command_image_create_with_resource(RESOURCE_ID_DISCORD_50);
@@ -333,40 +338,124 @@ static void state_change_handler(bool is_muted, bool is_deafened) {
 
 // ---------------------- BUTTON ACTIONS ----------------------
 
+static void send_set_state(OutboxSlot slot, uint32_t key, bool value, uint32_t trace_id) {
+  OutboxField fields[] = {
+    { key, value ? 1 : 0, 1 },
+    { MESSAGE_KEY_TRACE_ID, trace_id, 4 },
+  };
+  outbox_post(slot, fields, trace_id != 0 ? 2 : 1);
+}
+
+static void mute_debounce_callback(void *data) {
+  s_mute_debounce_timer = NULL;
+  send_set_state(OUTBOX_SLOT_MUTE, MESSAGE_KEY_SET_MUTE, s_desired_mute, trace_mark_sent());
+}
+
+static void deafen_debounce_callback(void *data) {
+  s_deafen_debounce_timer = NULL;
+  send_set_state(OUTBOX_SLOT_DEAFEN, MESSAGE_KEY_SET_DEAFEN, s_desired_deafen, 0);
+}
+
 static void mute_click_handler(ClickRecognizerRef recognizer, void *context) {
-  DictionaryIterator *iter;
-  app_message_outbox_begin(&iter);
+  trace_begin();
+  s_desired_mute = !displayed_muted();
   
-  if (iter == NULL) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Cannot create outbox for toggle mute message");
-    return;
+  if (s_mute_debounce_timer) {
+    app_timer_reschedule(s_mute_debounce_timer, PRESS_DEBOUNCE_MS);
+  } else {
+    s_mute_debounce_timer = app_timer_register(PRESS_DEBOUNCE_MS, mute_debounce_callback, NULL);
   }
   
-  dict_write_uint8(iter, MESSAGE_KEY_TOGGLE_MUTE, 1);
-  app_message_outbox_send();
+  update_action_bar_icons();
+  update_discord_icon();
 }
 
 static void deafen_click_handler(ClickRecognizerRef recognizer, void *context) {
-  DictionaryIterator *iter;
-  app_message_outbox_begin(&iter);
+  s_desired_deafen = !displayed_deafened();
   
-  if (iter == NULL) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Cannot create outbox for toggle deafen message");
-    return;
+  if (s_deafen_debounce_timer) {
+    app_timer_reschedule(s_deafen_debounce_timer, PRESS_DEBOUNCE_MS);
+  } else {
+    s_deafen_debounce_timer = app_timer_register(PRESS_DEBOUNCE_MS, deafen_debounce_callback, NULL);
+  }
+  
+  update_action_bar_icons();
+  update_discord_icon();
+}
+
+// Send any press that is still waiting out the debounce window right away
+static void flush_pending_presses(void) {
+  if (s_mute_debounce_timer) {
+    app_timer_cancel(s_mute_debounce_timer);
+    mute_debounce_callback(NULL);
   }
+  if (s_deafen_debounce_timer) {
+    app_timer_cancel(s_deafen_debounce_timer);
+    deafen_debounce_callback(NULL);
+  }
+}
+
+static void send_ptt_edge(void) {
+  OutboxField fields[] = {
+    { MESSAGE_KEY_PTT_STATE, s_ptt_talking ? 1 : 0, 1 },
+    { MESSAGE_KEY_PTT_SEQ, s_ptt_seq, 4 },
+  };
+  outbox_post(OUTBOX_SLOT_PTT, fields, ARRAY_LENGTH(fields));
+}
+
+static void ptt_edge(bool talking) {
+  s_ptt_talking = talking;
+  s_ptt_seq++;
+  
+  // A debounced mute press would fight the held button
+  if (s_mute_debounce_timer) {
+    app_timer_cancel(s_mute_debounce_timer);
+    s_mute_debounce_timer = NULL;
+  }
+  
+  // Only the latest edge matters, one still waiting in the outbox is replaced
+  send_ptt_edge();
   
-  dict_write_uint8(iter, MESSAGE_KEY_TOGGLE_DEAFEN, 1);
-  app_message_outbox_send();
+  update_action_bar_icons();
+  update_discord_icon();
+}
+
+static void ptt_down_handler(ClickRecognizerRef recognizer, void *context) {
+  ptt_edge(true);
+}
+
+static void ptt_up_handler(ClickRecognizerRef recognizer, void *context) {
+  ptt_edge(false);
 }
 
 static void leave_click_handler(ClickRecognizerRef recognizer, void *context) {
   show_leave_confirmation();
 }
 
+static void participants_long_click_handler(ClickRecognizerRef recognizer, void *context) {
+  participants_window_push();
+}
+
 static void action_bar_click_config_provider(void *context) {
   window_single_click_subscribe(BUTTON_ID_UP, deafen_click_handler);
+  window_long_click_subscribe(BUTTON_ID_UP, 0, participants_long_click_handler, NULL);
   window_single_click_subscribe(BUTTON_ID_DOWN, mute_click_handler);
   window_single_click_subscribe(BUTTON_ID_SELECT, leave_click_handler);
+  
+  if (ptt_mode_enabled()) {
+    window_long_click_subscribe(BUTTON_ID_SELECT, PTT_HOLD_DELAY_MS, ptt_down_handler, ptt_up_handler);
+  }
+}
+
+static void ptt_mode_handler(bool enabled) {
+  if (!enabled && s_ptt_talking) {
+    ptt_edge(false);
+  }
+  
+  // Re-apply the click config so the long press is (un)subscribed
+  if (s_action_bar) {
+    action_bar_layer_set_click_config_provider(s_action_bar, action_bar_click_config_provider);
+  }
 }
 
 static void update_action_bar_icons(void) {
@@ -375,9 +464,33 @@ static void update_action_bar_icons(void) {
   action_bar_layer_set_background_color(s_action_bar, GColorBlack);
   action_bar_layer_set_icon(s_action_bar, BUTTON_ID_SELECT, s_leave_icon);
   action_bar_layer_set_icon(s_action_bar, BUTTON_ID_DOWN, 
-                          s_is_muted ? s_mute_on_icon : s_mute_off_icon);
+                          displayed_muted() ? s_mute_on_icon : s_mute_off_icon);
   action_bar_layer_set_icon(s_action_bar, BUTTON_ID_UP, 
-                          s_is_deafened ? s_deafen_on_icon : s_deafen_off_icon);
+                          displayed_deafened() ? s_deafen_on_icon : s_deafen_off_icon);
+}
+
+// A dotted line under the status bar while a command hasn't reached the phone
+static void update_pending_indicator(void) {
+  if (!s_is_window_loaded) return;
+  
+  bool pending = outbox_is_pending(OUTBOX_SLOT_MUTE) || outbox_is_pending(OUTBOX_SLOT_DEAFEN) ||
+                 outbox_is_pending(OUTBOX_SLOT_PTT) || outbox_is_pending(OUTBOX_SLOT_LEAVE);
+  status_bar_layer_set_separator_mode(s_status_bar,
+      pending ? StatusBarLayerSeparatorModeDotted : StatusBarLayerSeparatorModeNone);
+}
+
+static void outbox_state_handler(OutboxSlot slot, OutboxState state) {
+  if (slot != OUTBOX_SLOT_MUTE && slot != OUTBOX_SLOT_DEAFEN &&
+      slot != OUTBOX_SLOT_PTT && slot != OUTBOX_SLOT_LEAVE) {
+    return;
+  }
+  
+  // The outbox gave up retrying, so the press never made it
+  if (state == OUTBOX_STATE_FAILED) {
+    vibes_double_pulse();
+  }
+  
+  update_pending_indicator();
 }
 
 // ---------------------- WINDOW LIFECYCLE ----------------------
@@ -516,6 +629,7 @@ static void window_load(Window *window) {
   // Set flag indicating window is now loaded
   s_is_window_loaded = true;
   APP_LOG(APP_LOG_LEVEL_INFO, "Main window load complete");
+  update_pending_indicator();
   
   // Apply any pending voice info
   if (s_has_pending_data) {
@@ -527,6 +641,11 @@ static void window_load(Window *window) {
 }
 
 static void window_unload(Window *window) {
+  flush_pending_presses();
+  if (s_ptt_talking) {
+    ptt_edge(false);
+  }
+  
   // Destroy UI elements
   if (s_status_bar) status_bar_layer_destroy(s_status_bar);
   if (s_channel_name_layer) text_layer_destroy(s_channel_name_layer);
@@ -543,7 +662,6 @@ static void window_unload(Window *window) {
   if (s_deafen_on_icon) gbitmap_destroy(s_deafen_on_icon);
   if (s_leave_icon) gbitmap_destroy(s_leave_icon);
   
-  app_glance_reload(prv_update_app_glance, NULL);
   window_destroy(s_window);
   s_window = NULL;
   s_is_window_loaded = false;
@@ -574,6 +692,8 @@ void main_window_push() {
   if (!s_window) {
     register_state_change_callback(state_change_handler);
     register_voice_info_callback(voice_info_handler);
+    register_ptt_mode_callback(ptt_mode_handler);
+    register_outbox_state_callback(outbox_state_handler);
     
     s_window = window_create();
     window_set_window_handlers(s_window, (WindowHandlers) {
@@ -0,0 +1,106 @@
+#include "participants_window.h"
+#include "../modules/participants.h"
+#include "volume_window.h"
+
+static Window *s_window;
+static MenuLayer *s_menu_layer;
+
+static uint16_t get_num_rows_callback(MenuLayer *menu_layer, uint16_t section_index, void *context) {
+  return participants_count();
+}
+
+static void draw_row_callback(GContext *ctx, const Layer *cell_layer, MenuIndex *cell_index, void *context) {
+  // Rows outside the cache are fetched on demand and redrawn once they arrive
+  const char *name = participants_get(cell_index->row);
+  
+  // Only shown when someone isn't at the default 100%
+  static char s_volume_text[16];
+  int volume = participants_get_volume(cell_index->row);
+  const char *subtitle = NULL;
+  if (name && volume >= 0 && volume != 100) {
+    snprintf(s_volume_text, sizeof(s_volume_text), "Volume %d%%", volume);
+    subtitle = s_volume_text;
+  }
+  
+  menu_cell_basic_draw(ctx, cell_layer, name ? name : "...", subtitle, NULL);
+}
+
+static void select_click_callback(MenuLayer *menu_layer, MenuIndex *cell_index, void *context) {
+  const char *name = participants_get(cell_index->row);
+  int volume = participants_get_volume(cell_index->row);
+  if (name && volume >= 0) {
+    volume_window_push(cell_index->row, name, volume);
+  }
+}
+
+static void selection_changed_callback(MenuLayer *menu_layer, MenuIndex new_index, MenuIndex old_index, void *context) {
+  // Keep one page ahead of the scroll direction
+  if (new_index.row > old_index.row) {
+    participants_prefetch(new_index.row + PARTICIPANTS_PAGE_SIZE);
+  } else if (new_index.row >= PARTICIPANTS_PAGE_SIZE) {
+    participants_prefetch(new_index.row - PARTICIPANTS_PAGE_SIZE);
+  }
+}
+
+static void participants_changed(void) {
+  if (s_menu_layer) {
+    menu_layer_reload_data(s_menu_layer);
+  }
+}
+
+static void window_load(Window *window) {
+  Layer *window_layer = window_get_root_layer(window);
+  GRect bounds = layer_get_bounds(window_layer);
+  
+  s_menu_layer = menu_layer_create(bounds);
+  menu_layer_set_callbacks(s_menu_layer, NULL, (MenuLayerCallbacks) {
+    .get_num_rows = get_num_rows_callback,
+    .draw_row = draw_row_callback,
+    .select_click = select_click_callback,
+    .selection_changed = selection_changed_callback
+  });
+  
+  #if PBL_COLOR
+    menu_layer_set_highlight_colors(s_menu_layer, GColorIndigo, GColorWhite);
+  #endif
+  
+  menu_layer_set_click_config_onto_window(s_menu_layer, window);
+  layer_add_child(window_layer, menu_layer_get_layer(s_menu_layer));
+  
+  participants_init(participants_changed);
+  participants_prefetch(PARTICIPANTS_PAGE_SIZE);
+}
+
+static void window_unload(Window *window) {
+  participants_deinit();
+  
+  if (s_menu_layer) {
+    menu_layer_destroy(s_menu_layer);
+    s_menu_layer = NULL;
+  }
+  
+  window_destroy(s_window);
+  s_window = NULL;
+}
+
+void participants_window_push() {
+  if (!s_window) {
+    s_window = window_create();
+    window_set_window_handlers(s_window, (WindowHandlers) {
+      .load = window_load,
+      .unload = window_unload
+    });
+  }
+  
+  window_stack_push(s_window, true);
+}
+
+Window* participants_window_get_window() {
+  return s_window;
+}
+
+void participants_window_pop() {
+  if (s_window) {
+    window_stack_remove(s_window, true);
+  }
+}
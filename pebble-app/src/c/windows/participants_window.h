@@ -0,0 +1,11 @@
+#pragma once
+
+#include <pebble.h>
+
+// Initialize and push the participant list window to the window stack
+void participants_window_push(void);
+
+// Close the participant list window
+void participants_window_pop(void);
+
+Window* participants_window_get_window(void);
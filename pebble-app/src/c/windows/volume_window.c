@@ -0,0 +1,197 @@
+#include "volume_window.h"
+#include "../modules/participants.h"
+#include "../modules/outbox.h"
+#include <string.h>
+
+// Discord's user volume range, 100 being unchanged
+#define VOLUME_MAX 200
+#define VOLUME_DEFAULT 100
+
+// Holding a button repeats; the step grows the longer it's held
+#define REPEAT_INTERVAL_MS 100
+
+// While adjusting, at most one message per interval goes to the phone:
+// the first change right away, then the latest value each interval
+#define SEND_INTERVAL_MS 400
+
+static Window *s_window;
+static TextLayer *s_name_layer;
+static TextLayer *s_volume_layer;
+static TextLayer *s_hint_layer;
+
+static char s_name[PARTICIPANT_NAME_LEN];
+static char s_volume_text[8];
+static uint16_t s_row;
+static uint32_t s_version;
+static int s_volume;
+static int s_sent_volume;
+static AppTimer *s_send_timer = NULL;
+
+static void send_timer_callback(void *data);
+
+static void send_volume(void) {
+  OutboxField fields[] = {
+    { MESSAGE_KEY_PARTICIPANT_ROW, s_row, 2 },
+    { MESSAGE_KEY_PARTICIPANT_VERSION, s_version, 4 },
+    { MESSAGE_KEY_USER_VOLUME, (uint32_t)s_volume, 1 },
+  };
+  outbox_post(OUTBOX_SLOT_VOLUME, fields, ARRAY_LENGTH(fields));
+  
+  s_sent_volume = s_volume;
+  participants_set_volume(s_row, s_volume);
+}
+
+static void send_timer_callback(void *data) {
+  s_send_timer = NULL;
+  if (s_volume == s_sent_volume) {
+    return;
+  }
+  
+  // Keep the interval going while the value keeps changing
+  send_volume();
+  s_send_timer = app_timer_register(SEND_INTERVAL_MS, send_timer_callback, NULL);
+}
+
+static void volume_changed(void) {
+  snprintf(s_volume_text, sizeof(s_volume_text), "%d%%", s_volume);
+  text_layer_set_text(s_volume_layer, s_volume_text);
+  
+  if (s_send_timer) {
+    // Picked up by the running interval
+    return;
+  }
+  
+  send_volume();
+  s_send_timer = app_timer_register(SEND_INTERVAL_MS, send_timer_callback, NULL);
+}
+
+static int step_for(ClickRecognizerRef recognizer) {
+  uint8_t repeats = click_number_of_clicks_counted(recognizer);
+  if (repeats > 15) {
+    return 10;
+  }
+  if (repeats > 5) {
+    return 5;
+  }
+  return 1;
+}
+
+static void adjust(int delta) {
+  int volume = s_volume + delta;
+  if (volume < 0) {
+    volume = 0;
+  } else if (volume > VOLUME_MAX) {
+    volume = VOLUME_MAX;
+  }
+  
+  if (volume != s_volume) {
+    s_volume = volume;
+    volume_changed();
+  }
+}
+
+static void up_click_handler(ClickRecognizerRef recognizer, void *context) {
+  adjust(step_for(recognizer));
+}
+
+static void down_click_handler(ClickRecognizerRef recognizer, void *context) {
+  adjust(-step_for(recognizer));
+}
+
+static void select_click_handler(ClickRecognizerRef recognizer, void *context) {
+  adjust(VOLUME_DEFAULT - s_volume);
+}
+
+static void click_config_provider(void *context) {
+  window_single_repeating_click_subscribe(BUTTON_ID_UP, REPEAT_INTERVAL_MS, up_click_handler);
+  window_single_repeating_click_subscribe(BUTTON_ID_DOWN, REPEAT_INTERVAL_MS, down_click_handler);
+  window_single_click_subscribe(BUTTON_ID_SELECT, select_click_handler);
+}
+
+static TextLayer *create_text_layer(Layer *window_layer, GRect frame, const char *font_key) {
+  TextLayer *layer = text_layer_create(frame);
+  text_layer_set_font(layer, fonts_get_system_font(font_key));
+  text_layer_set_text_alignment(layer, GTextAlignmentCenter);
+  
+  #if PBL_COLOR
+    text_layer_set_text_color(layer, GColorWhite);
+    text_layer_set_background_color(layer, GColorClear);
+  #endif
+  
+  layer_add_child(window_layer, text_layer_get_layer(layer));
+  return layer;
+}
+
+static void window_load(Window *window) {
+  Layer *window_layer = window_get_root_layer(window);
+  GRect bounds = layer_get_bounds(window_layer);
+  
+  #if PBL_COLOR
+    window_set_background_color(window, GColorIndigo);
+  #endif
+  
+  int y_center = bounds.size.h / 2;
+  
+  s_name_layer = create_text_layer(window_layer, GRect(5, y_center - 60, bounds.size.w - 10, 30),
+                                   FONT_KEY_GOTHIC_24_BOLD);
+  text_layer_set_text(s_name_layer, s_name);
+  
+  s_volume_layer = create_text_layer(window_layer, GRect(0, y_center - 25, bounds.size.w, 50),
+                                     FONT_KEY_BITHAM_42_BOLD);
+  snprintf(s_volume_text, sizeof(s_volume_text), "%d%%", s_volume);
+  text_layer_set_text(s_volume_layer, s_volume_text);
+  
+  s_hint_layer = create_text_layer(window_layer, GRect(5, y_center + 30, bounds.size.w - 10, 24),
+                                   FONT_KEY_GOTHIC_18);
+  text_layer_set_text(s_hint_layer, "Select resets");
+  
+  window_set_click_config_provider(window, click_config_provider);
+}
+
+static void window_unload(Window *window) {
+  if (s_send_timer) {
+    app_timer_cancel(s_send_timer);
+    s_send_timer = NULL;
+  }
+  
+  // Don't lose the last step of an adjustment
+  if (s_volume != s_sent_volume) {
+    send_volume();
+  }
+  
+  text_layer_destroy(s_name_layer);
+  text_layer_destroy(s_volume_layer);
+  text_layer_destroy(s_hint_layer);
+  
+  window_destroy(s_window);
+  s_window = NULL;
+}
+
+void volume_window_push(uint16_t row, const char *name, uint8_t volume) {
+  s_row = row;
+  s_version = participants_version();
+  s_volume = volume;
+  s_sent_volume = volume;
+  strncpy(s_name, name, sizeof(s_name) - 1);
+  s_name[sizeof(s_name) - 1] = '\0';
+  
+  if (!s_window) {
+    s_window = window_create();
+    window_set_window_handlers(s_window, (WindowHandlers) {
+      .load = window_load,
+      .unload = window_unload
+    });
+  }
+  
+  window_stack_push(s_window, true);
+}
+
+Window* volume_window_get_window() {
+  return s_window;
+}
+
+void volume_window_pop() {
+  if (s_window) {
+    window_stack_remove(s_window, true);
+  }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <pebble.h>
+
+// Initialize and push the volume window for one participant row
+void volume_window_push(uint16_t row, const char *name, uint8_t volume);
+
+// Close the volume window
+void volume_window_pop(void);
+
+Window* volume_window_get_window(void);
@@ -65,6 +65,9 @@ Pebble.addEventListener("showConfiguration", function(e) {
     var dict = clay.getSettings(e.response);
     wsHost = dict[keys.WS_HOST];
     localStorage.setItem("WS_HOST", wsHost);
+    // The hosts changed, forget what the old ones taught us
+    localStorage.removeItem("WS_LAST_HOST");
+    localStorage.removeItem("WS_ADVERTISED");
     websocketHost = wsHost;
     wsPort = dict[keys.WS_PORT];
     websocketPort = wsPort;
@@ -128,84 +131,187 @@ function initWebSocket() {
     // Initial connection status - disconnected
     sendConnectionStatus(false);
     
-    // Replace with your WebSocket server address
-    const wsUrl = websocketUrl; 
+    raceConnect(candidateHosts(), onSocketOpen, function() {
+        console.log("Could not reach any WebSocket host");
+        scheduleRetry();
+    });
+}
+
+function onSocketOpen(winner, host) {
+    console.log("WebSocket connection established to " + host);
+    socket = winner;
+    websocketUrl = "ws://" + host + ":" + websocketPort;
     
-    try {
-        socket = new WebSocket(wsUrl);
-        
-        socket.onopen = function(e) {
-            console.log("WebSocket connection established");
-            
-            // Reset retry flag since we're now connected
-            isRetrying = false;
-            
-            // Send connected status to Pebble
-            sendConnectionStatus(true);
-            
-            // Request initial state as soon as connection is established
-            setTimeout(function() {
-                requestInitialStateFromServer();
-            }, 500); // Short delay to let the connection stabilize
-        };
-        
-        socket.onmessage = function(event) {
-            console.log("Message from server received");
-            handleMessageData(event.data);
-        };
-        
-        socket.onclose = function(event) {
-            console.log('WebSocket connection closed');
-            
-            // Send disconnected status to Pebble
-            sendConnectionStatus(false);
-            
-            // Check if we should retry based on time
-            if (Date.now() - connectionStartTime <= MAX_RETRY_TIME) {
-                console.log("Retrying connection... Time elapsed: " + 
-                          (Date.now() - connectionStartTime) + "ms");
-                // Attempt to reconnect after a delay
-                setTimeout(initWebSocket, 2000);
-            } else {
-                console.log("Exceeded maximum retry time, stopping reconnection attempts");
-                isRetrying = false;
-                
-                // Send timeout message to Pebble
-                Pebble.sendAppMessage({
-                    CONNECTION_TIMEOUT: 1
-                });
-            }
-        };
+    // Try this host first next time
+    localStorage.setItem("WS_LAST_HOST", host);
+    
+    // Reset retry flag since we're now connected
+    isRetrying = false;
+    
+    // Send connected status to Pebble
+    sendConnectionStatus(true);
+    
+    // No need to ask for the initial state: the server pushes its
+    // cached snapshot as the first message on every connection
+    
+    socket.onmessage = function(event) {
+        console.log("Message from server received");
+        handleMessageData(event.data);
+    };
+    
+    socket.onclose = function(event) {
+        console.log('WebSocket connection closed');
         
-        socket.onerror = function(error) {
-            console.log("WebSocket error occurred");
-            
-            // Send disconnected status to Pebble
-            sendConnectionStatus(false);
-        };
+        // Send disconnected status to Pebble
+        sendConnectionStatus(false);
         
-    } catch(err) {
-        console.log("WebSocket connection error: " + err.message);
+        if (!isRetrying) {
+            connectionStartTime = Date.now();
+            isRetrying = true;
+        }
+        scheduleRetry();
+    };
+    
+    socket.onerror = function(error) {
+        console.log("WebSocket error occurred");
         
         // Send disconnected status to Pebble
         sendConnectionStatus(false);
+    };
+}
+
+function scheduleRetry() {
+    // Check if we should retry based on time
+    if (Date.now() - connectionStartTime <= MAX_RETRY_TIME) {
+        console.log("Retrying connection... Time elapsed: " + 
+                  (Date.now() - connectionStartTime) + "ms");
+        // Attempt to reconnect after a delay
+        setTimeout(initWebSocket, 2000);
+    } else {
+        console.log("Exceeded maximum retry time, stopping reconnection attempts");
+        isRetrying = false;
         
-        // Check if we should retry based on time
-        if (Date.now() - connectionStartTime <= MAX_RETRY_TIME) {
-            console.log("Retrying connection after error... Time elapsed: " + 
-                      (Date.now() - connectionStartTime) + "ms");
-            // Attempt to reconnect after a delay
-            setTimeout(initWebSocket, 2000);
+        // Send timeout message to Pebble
+        Pebble.sendAppMessage({
+            CONNECTION_TIMEOUT: 1
+        });
+    }
+}
+
+// Hosts to try, best guess first: the host that worked last time, then the
+// configured ones (comma-separated), then the addresses the server advertised
+function candidateHosts() {
+    var hosts = [];
+    var add = function(host) {
+        host = host ? String(host).trim() : "";
+        if (host && hosts.indexOf(host) === -1) {
+            hosts.push(host);
+        }
+    };
+    
+    add(localStorage.getItem("WS_LAST_HOST"));
+    String(websocketHost).split(",").forEach(add);
+    try {
+        JSON.parse(localStorage.getItem("WS_ADVERTISED") || "[]").forEach(add);
+    } catch (e) {
+        console.log("Ignoring invalid advertised hosts");
+    }
+    return hosts;
+}
+
+// "Happy eyeballs": start an attempt per host, each one CONNECT_STAGGER after
+// the previous (or right away when the previous one fails), keep the first
+// socket that opens and close the rest.
+const CONNECT_STAGGER = 250;
+const CONNECT_TIMEOUT = 5000;
+
+function raceConnect(hosts, onWinner, onAllFailed) {
+    var attempts = [];
+    var next = 0;
+    var failed = 0;
+    var done = false;
+    var staggerTimer = null;
+    
+    var finish = function() {
+        done = true;
+        clearTimeout(staggerTimer);
+        clearTimeout(timeoutTimer);
+    };
+    
+    var attemptFailed = function() {
+        failed++;
+        if (done) {
+            return;
+        }
+        if (failed === hosts.length) {
+            finish();
+            onAllFailed();
         } else {
-            console.log("Exceeded maximum retry time after error, stopping reconnection attempts");
-            isRetrying = false;
-            
-            // Send timeout message to Pebble
-            Pebble.sendAppMessage({
-                CONNECTION_TIMEOUT: 1
+            startNext();
+        }
+    };
+    
+    var startNext = function() {
+        clearTimeout(staggerTimer);
+        if (done || next >= hosts.length) {
+            return;
+        }
+        var host = hosts[next++];
+        var attempt;
+        var settled = false;
+        
+        console.log("Trying WebSocket host " + host);
+        try {
+            attempt = new WebSocket("ws://" + host + ":" + websocketPort);
+        } catch (err) {
+            console.log("WebSocket connection error for " + host + ": " + err.message);
+            attemptFailed();
+            return;
+        }
+        attempts.push(attempt);
+        
+        attempt.onopen = function() {
+            settled = true;
+            if (done) {
+                attempt.close();
+                return;
+            }
+            finish();
+            attempts.forEach(function(other) {
+                if (other !== attempt) {
+                    other.close();
+                }
             });
+            onWinner(attempt, host);
+        };
+        attempt.onerror = attempt.onclose = function() {
+            if (!settled) {
+                settled = true;
+                attemptFailed();
+            }
+        };
+        
+        staggerTimer = setTimeout(startNext, CONNECT_STAGGER);
+    };
+    
+    // Unreachable hosts can hang instead of failing, don't wait on them forever
+    var timeoutTimer = setTimeout(function() {
+        if (done) {
+            return;
         }
+        finish();
+        attempts.forEach(function(attempt) {
+            attempt.close();
+        });
+        onAllFailed();
+    }, CONNECT_TIMEOUT);
+    
+    if (hosts.length === 0) {
+        finish();
+        onAllFailed();
+        return;
     }
+    startNext();
 }
 
 // Helper function to process message data
@@ -228,6 +334,8 @@ function handleMessageData(data) {
 
         switch (jsonData.cmd) {
             case "GET_INITIAL_STATE":
+                knownVoiceState.mute = !!jsonData.mute;
+                knownVoiceState.deaf = !!jsonData.deaf;
                 sendStateToPebble({
                     VOICE_CHANNEL_NAME: jsonData.channelName,
                     VOICE_USER_COUNT: jsonData.users,
@@ -235,12 +343,39 @@ function handleMessageData(data) {
                     MUTE_STATE: jsonData.mute ? 1 : 0,
                     DEAFEN_STATE: jsonData.deaf ? 1 : 0
                 });
+                // Discord is reachable again, apply what was pressed meanwhile
+                flushQueuedCommands();
                 break;
             case "USER_VOICE_STATE_UPDATE":
-                sendStateToPebble({
+                knownVoiceState.mute = !!jsonData.mute;
+                knownVoiceState.deaf = !!jsonData.deaf;
+                var update = {
                     MUTE_STATE: jsonData.mute ? 1 : 0,
                     DEAFEN_STATE: jsonData.deaf ? 1 : 0
-                });
+                };
+                var trace = jsonData.trace !== undefined ? traces[jsonData.trace] : undefined;
+                if (trace) {
+                    trace.wsReceived = Date.now();
+                    update.TRACE_ID = jsonData.trace;
+                }
+                sendStateToPebble(update);
+                if (trace) {
+                    trace.forwarded = Date.now();
+                }
+                break;
+            case "STATE_UPDATE":
+                // Coalesced channel changes, only the fields that changed are present
+                var changes = {};
+                if (jsonData.channelName !== undefined) {
+                    changes.VOICE_CHANNEL_NAME = jsonData.channelName;
+                }
+                if (jsonData.users !== undefined) {
+                    changes.VOICE_USER_COUNT = jsonData.users;
+                }
+                if (jsonData.serverName !== undefined) {
+                    changes.VOICE_SERVER_NAME = jsonData.serverName;
+                }
+                sendStateToPebble(changes);
                 break;
             case "USER_NUMBER_CHANGE":
                 sendStateToPebble({
@@ -258,6 +393,14 @@ function handleMessageData(data) {
                     VOICE_SERVER_NAME: jsonData.serverName
                 });
                 break;
+            case "PARTICIPANTS":
+                sendParticipantsPage(jsonData.offset, jsonData.total, jsonData.version, jsonData.names,
+                    jsonData.volumes);
+                break;
+            case "SERVER_ADDRESSES":
+                // Remembered as fallback candidates for when the configured host stops working
+                localStorage.setItem("WS_ADVERTISED", JSON.stringify(jsonData.addresses || []));
+                break;
             case "LEFT_CHANNEL":
                 sendStateToPebble({
                     VOICE_CHANNEL_NAME: "",
@@ -276,6 +419,11 @@ function handleMessageData(data) {
 }
 
 function sendStateToPebble(state) {
+        var encoded = encodeDictionary(state);
+        if (encoded.length > watchInboxSize) {
+            sendFragmented(encoded);
+            return;
+        }
 
         Pebble.sendAppMessage(state, 
             function() {
@@ -287,12 +435,165 @@ function sendStateToPebble(state) {
         );
 }
 
+// ---------------------- FRAGMENTATION ----------------------
+// Messages larger than the watch inbox are serialized the way the watch
+// stores a Dictionary and sent in FRAG_DATA chunks. The watch glues them
+// back together and handles the result like any other message.
+//
+// The watch reassembles one message at a time and starts over on every
+// index 0, so fragmented messages are queued and go out one after another.
+
+// Until the watch reports its inbox size, assume what older versions opened
+var watchInboxSize = 256;
+var nextFragmentId = 1;
+var fragmentQueue = [];
+var fragmentSending = false;
+
+// Dictionary layout: a count byte, then per tuple a key (4 bytes), a type
+// (1) and a length (2) before the value
+const DICT_HEADER_BYTES = 1;
+const TUPLE_HEADER_BYTES = 7;
+const INT_BYTES = 4;
+// FRAG_ID, FRAG_INDEX and FRAG_COUNT go out as ints, next to FRAG_DATA's header
+const FRAGMENT_OVERHEAD = DICT_HEADER_BYTES + 4 * TUPLE_HEADER_BYTES + 3 * INT_BYTES;
+
+// Same policy as the watch's outbox: 100ms doubling up to 3.2s, then give up
+// after 8 attempts
+const SEND_RETRY_BASE_MS = 100;
+const SEND_RETRY_MAX_MS = 3200;
+const SEND_MAX_ATTEMPTS = 8;
+
+const TUPLE_BYTE_ARRAY = 0;
+const TUPLE_CSTRING = 1;
+const TUPLE_INT = 3;
+
+function utf8Bytes(text) {
+    var binary = unescape(encodeURIComponent(text));
+    var bytes = [];
+    for (var i = 0; i < binary.length; i++) {
+        bytes.push(binary.charCodeAt(i));
+    }
+    return bytes;
+}
+
+function pushUint(bytes, value, width) {
+    for (var i = 0; i < width; i++) {
+        bytes.push((value >>> (8 * i)) & 0xff);
+    }
+}
+
+// Pebble Dictionary layout: tuple count, then per tuple a little-endian
+// uint32 key, a type byte, a uint16 length and the value
+function encodeDictionary(state) {
+    var names = Object.keys(state);
+    var bytes = [names.length];
+    names.forEach(function(name) {
+        var value = state[name];
+        var type;
+        var data;
+        if (typeof value === "string") {
+            type = TUPLE_CSTRING;
+            data = utf8Bytes(value).concat([0]);
+        } else if (Array.isArray(value)) {
+            type = TUPLE_BYTE_ARRAY;
+            data = value;
+        } else {
+            // Numbers and booleans go out as int32, like Pebble.sendAppMessage does
+            type = TUPLE_INT;
+            data = [];
+            pushUint(data, Number(value) | 0, INT_BYTES);
+        }
+        pushUint(bytes, keys[name], 4);
+        bytes.push(type);
+        pushUint(bytes, data.length, 2);
+        Array.prototype.push.apply(bytes, data);
+    });
+    return bytes;
+}
+
+// Sends a message, retrying with backoff; done(true) once it is acked,
+// done(false) once it is given up on
+function sendAppMessageWithRetry(message, description, done) {
+    var attempts = 0;
+    function attempt() {
+        Pebble.sendAppMessage(message, function() {
+            done(true);
+        }, function(e) {
+            attempts++;
+            if (attempts >= SEND_MAX_ATTEMPTS) {
+                console.log("Giving up on " + description + " after " + attempts + " attempts:", JSON.stringify(e));
+                done(false);
+                return;
+            }
+            setTimeout(attempt, Math.min(SEND_RETRY_BASE_MS * Math.pow(2, attempts - 1), SEND_RETRY_MAX_MS));
+        });
+    }
+    attempt();
+}
+
+function sendFragmented(encoded) {
+    fragmentQueue.push(encoded);
+    if (!fragmentSending) {
+        sendNextFragmented();
+    }
+}
+
+function sendNextFragmented() {
+    var encoded = fragmentQueue.shift();
+    if (encoded === undefined) {
+        fragmentSending = false;
+        return;
+    }
+    fragmentSending = true;
+
+    // Re-read for every message: the watch may have reported its size meanwhile
+    var chunkSize = watchInboxSize - FRAGMENT_OVERHEAD;
+    var count = Math.ceil(encoded.length / chunkSize);
+    if (count > 255) {
+        console.log("Message too large to fragment: " + encoded.length + " bytes");
+        sendNextFragmented();
+        return;
+    }
+    var id = nextFragmentId++;
+    console.log("Sending " + encoded.length + " bytes as " + count + " fragments");
+
+    // One at a time: the watch expects them in order
+    function sendFragment(index) {
+        sendAppMessageWithRetry({
+            FRAG_ID: id,
+            FRAG_INDEX: index,
+            FRAG_COUNT: count,
+            FRAG_DATA: encoded.slice(index * chunkSize, (index + 1) * chunkSize)
+        }, "fragment " + index + " of " + id, function(sent) {
+            // Given up on: the watch drops the partial message when its timeout expires
+            if (sent && index + 1 < count) {
+                sendFragment(index + 1);
+                return;
+            }
+            sendNextFragmented();
+        });
+    }
+    sendFragment(0);
+}
+
 
 // Listen for AppMessages from the Pebble
 Pebble.addEventListener("appmessage",
     function(e) {
+        // Push-to-talk edges take the priority lane: forward them before
+        // doing anything else, including logging
+        if (e.payload && e.payload.PTT_STATE !== undefined) {
+            sendPttEdge(e.payload.PTT_STATE === 1, e.payload.PTT_SEQ);
+            return;
+        }
+        
         console.log("AppMessage received: " + JSON.stringify(e.payload));
         
+        if (e.payload && e.payload.INBOX_SIZE !== undefined) {
+            watchInboxSize = e.payload.INBOX_SIZE;
+            return;
+        }
+        
         // Check if we received the toggleMute message
         if (e.payload && e.payload.TOGGLE_MUTE !== undefined) {
             sendMuteCommand();
@@ -301,10 +602,29 @@ Pebble.addEventListener("appmessage",
         else if (e.payload && e.payload.TOGGLE_DEAFEN !== undefined) {
             sendDeafenCommand();
         }
+        // Explicit desired states from the (debounced) watch buttons
+        else if (e.payload && e.payload.SET_MUTE !== undefined) {
+            sendSetMuteCommand(e.payload.SET_MUTE === 1, e.payload.TRACE_ID);
+        }
+        else if (e.payload && e.payload.SET_DEAFEN !== undefined) {
+            sendSetDeafenCommand(e.payload.SET_DEAFEN === 1);
+        }
         // Check if we received the leaveChannel message
         else if (e.payload && e.payload.LEAVE_CHANNEL !== undefined) {
             sendLeaveChannelCommand();
         }
+        // The participant list window wants a page of names
+        else if (e.payload && e.payload.PARTICIPANT_COUNT !== undefined) {
+            requestParticipants(e.payload.PARTICIPANT_OFFSET, e.payload.PARTICIPANT_COUNT);
+        }
+        // Already throttled on the watch while a button is held
+        else if (e.payload && e.payload.USER_VOLUME !== undefined) {
+            sendSetUserVolumeCommand(e.payload.PARTICIPANT_ROW, e.payload.PARTICIPANT_VERSION, e.payload.USER_VOLUME);
+        }
+        // The watch finished a traced round trip
+        else if (e.payload && e.payload.TRACE_RTT !== undefined) {
+            sendTraceReport(e.payload.TRACE_ID, e.payload.TRACE_DEBOUNCE, e.payload.TRACE_RTT);
+        }
     }
 );
 
@@ -318,12 +638,13 @@ function sendMuteCommand() {
         qemu_mute_state = !qemu_mute_state;
         return;
     }
-    if (socket && socket.readyState === WebSocket.OPEN) {
-        console.log("Sending mute command to server");
-        socket.send("mute");
-    } else {
-        console.log("WebSocket not connected, cannot send mute command");
+    if (!socketOpen() && knownVoiceState.mute !== null) {
+        // A queued toggle can't be collapsed with a later press, the state it leads to can
+        sendSetMuteCommand(!intendedValue("mute", knownVoiceState.mute));
+        return;
     }
+    console.log("Sending mute command to server");
+    sendOrQueueCommand("mute", "mute");
 }
 
 var qemu_deafen_state = 0;
@@ -336,32 +657,278 @@ function sendDeafenCommand() {
         qemu_deafen_state = !qemu_deafen_state;
         return;
     }
-    if (socket && socket.readyState === WebSocket.OPEN) {
-        console.log("Sending deafen command to server");
-        socket.send("deafen");
+    if (!socketOpen() && knownVoiceState.deaf !== null) {
+        sendSetDeafenCommand(!intendedValue("deafen", knownVoiceState.deaf));
+        return;
+    }
+    console.log("Sending deafen command to server");
+    sendOrQueueCommand("deafen", "deafen");
+}
+
+function sendSetMuteCommand(mute, traceId) {
+    if (watchInfo.model.startsWith("qemu")) {
+        console.log("Running in emulator, skipping set mute command");
+        qemu_mute_state = mute ? 1 : 0;
+        sendStateToPebble({
+            MUTE_STATE: qemu_mute_state
+        });
+        return;
+    }
+    if (socketOpen()) {
+        console.log("Sending set mute command to server: " + mute);
+        var command = { cmd: "setMute", value: mute };
+        if (traceId !== undefined) {
+            beginTrace(traceId);
+            command.trace = traceId;
+        }
+        socket.send(JSON.stringify(command));
+        if (traceId !== undefined) {
+            traces[traceId].wsSent = Date.now();
+        }
     } else {
-        console.log("WebSocket not connected, cannot send deafen command");
+        // Untraced, the hops of a queued press say nothing about latency
+        sendOrQueueCommand("mute", JSON.stringify({ cmd: "setMute", value: mute }), mute);
     }
 }
 
-function sendLeaveChannelCommand() {
+function sendSetDeafenCommand(deaf) {
+    if (watchInfo.model.startsWith("qemu")) {
+        console.log("Running in emulator, skipping set deafen command");
+        qemu_deafen_state = deaf ? 1 : 0;
+        sendStateToPebble({
+            DEAFEN_STATE: qemu_deafen_state
+        });
+        return;
+    }
+    console.log("Sending set deafen command to server: " + deaf);
+    sendOrQueueCommand("deafen", JSON.stringify({ cmd: "setDeafen", value: deaf }), deaf);
+}
+
+var lastPttSeq = -1;
+function sendPttEdge(talking, seq) {
+    // Bluetooth delivery can reorder retries, only the newest edge counts
+    if (seq <= lastPttSeq) {
+        console.log("Dropping stale push-to-talk edge " + seq);
+        return;
+    }
+    lastPttSeq = seq;
+    if (watchInfo.model.startsWith("qemu")) {
+        qemu_mute_state = talking ? 0 : 1;
+        sendStateToPebble({
+            MUTE_STATE: qemu_mute_state
+        });
+        return;
+    }
+    sendOrQueueCommand("ptt", JSON.stringify({ cmd: "ptt", talking: talking, seq: seq }), talking);
+}
+
+// Timestamps of traced mute presses on the phone, keyed by trace id.
+// All spans are measured on one clock each, so no clock sync is needed:
+// the server combines them with its own spans into a per-hop breakdown.
+var traces = {};
+const TRACE_TTL = 30000;
+
+function beginTrace(traceId) {
+    var now = Date.now();
+    for (var id in traces) {
+        if (now - traces[id].received > TRACE_TTL) {
+            delete traces[id];
+        }
+    }
+    traces[traceId] = { received: now };
+}
+
+function sendTraceReport(traceId, watchDebounce, watchRtt) {
+    var trace = traces[traceId];
+    delete traces[traceId];
+    if (!trace || trace.forwarded === undefined) {
+        return;
+    }
+    if (socket && socket.readyState === WebSocket.OPEN) {
+        socket.send(JSON.stringify({
+            cmd: "traceReport",
+            trace: traceId,
+            watchDebounceMs: watchDebounce,
+            watchRttMs: watchRtt,
+            // Time spent in this script on the way in and on the way out
+            phoneMs: (trace.wsSent - trace.received) + (trace.forwarded - trace.wsReceived),
+            wsRttMs: trace.wsReceived - trace.wsSent
+        }));
+    }
+}
+
+// Names are cut to what the watch keeps per row (PARTICIPANT_NAME_LEN - 1 bytes
+// of UTF-8), so a page of them fits in one AppMessage
+const PARTICIPANT_NAME_BYTES = 23;
+
+function truncateUtf8(text, maxBytes) {
+    var bytes = 0;
+    for (var i = 0; i < text.length; i++) {
+        var code = text.codePointAt(i);
+        var size = code < 0x80 ? 1 : code < 0x800 ? 2 : code < 0x10000 ? 3 : 4;
+        if (bytes + size > maxBytes) {
+            return text.substring(0, i);
+        }
+        bytes += size;
+        if (code >= 0x10000) {
+            i++; // surrogate pair
+        }
+    }
+    return text;
+}
+
+function requestParticipants(offset, count) {
+    if (watchInfo.model.startsWith("qemu")) {
+        var names = [];
+        for (var i = offset; i < Math.min(offset + count, 42); i++) {
+            names.push("Fake User " + (i + 1));
+        }
+        sendParticipantsPage(offset, 42, 1, names, names.map(function() { return 100; }));
+        return;
+    }
     if (socket && socket.readyState === WebSocket.OPEN) {
-        console.log("Sending leave channel command to server");
-        socket.send("leaveChannel");
+        socket.send(JSON.stringify({ cmd: "getParticipants", offset: offset, count: count }));
     } else {
-        console.log("WebSocket not connected, cannot send leave channel command");
+        console.log("WebSocket not connected, cannot request participants");
     }
 }
 
-function requestInitialStateFromServer() {
+function sendSetUserVolumeCommand(row, version, volume) {
+    if (watchInfo.model.startsWith("qemu")) {
+        console.log("Running in emulator, skipping set user volume command");
+        return;
+    }
     if (socket && socket.readyState === WebSocket.OPEN) {
-        console.log("Requesting initial state from server");
-        socket.send("getInitialState");
+        socket.send(JSON.stringify({ cmd: "setUserVolume", row: row, version: version, volume: volume }));
     } else {
-        console.log("WebSocket not connected, cannot request initial state");
+        console.log("WebSocket not connected, cannot send set user volume command");
+    }
+}
+
+function sendParticipantsPage(offset, total, version, names, volumes) {
+    sendStateToPebble({
+        PARTICIPANT_OFFSET: offset,
+        PARTICIPANT_TOTAL: total,
+        PARTICIPANT_VERSION: version,
+        // One byte each, Discord volumes go from 0 to 200
+        PARTICIPANT_VOLUMES: volumes,
+        PARTICIPANT_NAMES: names.map(function(name) {
+            // The watch splits on newlines
+            return truncateUtf8(name.replace(/\n/g, " "), PARTICIPANT_NAME_BYTES);
+        }).join("\n")
+    });
+}
+
+function sendLeaveChannelCommand() {
+    console.log("Sending leave channel command to server");
+    sendOrQueueCommand("leave", "leaveChannel");
+}
+
+// ---------------------- OFFLINE QUEUE ----------------------
+// Commands pressed while the socket is down (a Wi-Fi blip, the desktop
+// restarting) wait here instead of being dropped. Only the final intent of
+// each kind is kept, and each kind has its own lifetime: muting half a minute
+// late is still what the user wanted, a push-to-talk edge that late is not.
+// The watch hears when a command is queued and whether it was later
+// delivered or expired.
+
+const COMMAND_KIND = { mute: 0, deafen: 1, leave: 2, ptt: 3 };
+const COMMAND_STATUS = { delivered: 0, queued: 1, expired: 2 };
+const COMMAND_TTL = { mute: 30000, deafen: 30000, leave: 10000, ptt: 3000 };
+
+// kind -> { message, value, expiresAt }
+var queuedCommands = {};
+var queueExpiryTimer = null;
+
+// Last state the desktop reported, so a toggle pressed offline can be turned
+// into the state it was meant to reach
+var knownVoiceState = { mute: null, deaf: null };
+
+function socketOpen() {
+    return socket && socket.readyState === WebSocket.OPEN;
+}
+
+// The state a queued set command leads to, or the fallback when none is queued
+function intendedValue(kind, fallback) {
+    var queued = queuedCommands[kind];
+    return queued && queued.value !== undefined ? queued.value : fallback;
+}
+
+function sendOrQueueCommand(kind, message, value) {
+    if (socketOpen()) {
+        socket.send(message);
+        return;
+    }
+
+    console.log("WebSocket not connected, queueing " + kind + " command");
+    var replaced = queuedCommands[kind] !== undefined;
+    queuedCommands[kind] = { message: message, value: value, expiresAt: Date.now() + COMMAND_TTL[kind] };
+    scheduleQueueExpiry();
+    // Superseding a queued command doesn't change what the watch was told
+    if (!replaced) {
+        sendCommandStatus(kind, COMMAND_STATUS.queued);
+    }
+}
+
+// Called once the snapshot arrived on a fresh connection: the desktop is
+// talking to Discord again, so the queued commands will actually apply
+function flushQueuedCommands() {
+    expireQueuedCommands();
+    for (var kind in queuedCommands) {
+        if (!socketOpen()) {
+            return;
+        }
+        console.log("Sending queued " + kind + " command");
+        socket.send(queuedCommands[kind].message);
+        delete queuedCommands[kind];
+        sendCommandStatus(kind, COMMAND_STATUS.delivered);
+    }
+    scheduleQueueExpiry();
+}
+
+function expireQueuedCommands() {
+    var now = Date.now();
+    for (var kind in queuedCommands) {
+        if (queuedCommands[kind].expiresAt <= now) {
+            console.log("Queued " + kind + " command expired");
+            delete queuedCommands[kind];
+            sendCommandStatus(kind, COMMAND_STATUS.expired);
+        }
     }
 }
 
+function scheduleQueueExpiry() {
+    if (queueExpiryTimer !== null) {
+        clearTimeout(queueExpiryTimer);
+        queueExpiryTimer = null;
+    }
+
+    var next = Infinity;
+    for (var kind in queuedCommands) {
+        next = Math.min(next, queuedCommands[kind].expiresAt);
+    }
+    if (next === Infinity) {
+        return;
+    }
+
+    queueExpiryTimer = setTimeout(function() {
+        queueExpiryTimer = null;
+        expireQueuedCommands();
+        scheduleQueueExpiry();
+    }, Math.max(0, next - Date.now()));
+}
+
+function sendCommandStatus(kind, status) {
+    Pebble.sendAppMessage({
+        COMMAND_KIND: COMMAND_KIND[kind],
+        COMMAND_STATUS: status
+    },
+    function() {},
+    function(e) {
+        console.log("Failed to send command status: " + JSON.stringify(e));
+    });
+}
+
 
 // Make sure to clean up when the app closes
 Pebble.addEventListener("unload", function() {
@@ -0,0 +1,446 @@
+#include "../src/c/modules/outbox.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Host tests for the outbox. The phone below takes one message at a time like
+// AppMessage does, and a test decides when it acks or NACKs, when it's busy
+// and when a retry timer fires.
+
+#define KEY_MUTE 1
+#define KEY_DEAFEN 2
+#define KEY_PTT 3
+
+#define MAX_LOG 32
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: %s: CHECK(%s) failed\n", __FILE__, __LINE__, s_test, #cond); \
+      exit(1); \
+    } \
+  } while (0)
+
+#define CHECK_EQ(actual, expected) \
+  do { \
+    long actual_ = (long)(actual); \
+    long expected_ = (long)(expected); \
+    if (actual_ != expected_) { \
+      fprintf(stderr, "%s:%d: %s: %s is %ld, expected %ld\n", __FILE__, __LINE__, s_test, #actual, \
+              actual_, expected_); \
+      exit(1); \
+    } \
+  } while (0)
+
+static const char *s_test = "";
+static bool s_verbose = false;
+
+// ---------------------- STUB PHONE ----------------------
+
+static DictionaryIterator s_dict;
+static bool s_in_flight = false;
+
+// Results to return instead of APP_MSG_OK, for the next calls
+static int s_begin_failures = 0;
+static AppMessageResult s_begin_failure = APP_MSG_BUSY;
+static int s_send_failures = 0;
+
+static DictionaryIterator s_sent[MAX_LOG];
+static int s_sent_count = 0;
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt, ...) {
+  if (!s_verbose) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "  %s:%d ", src_filename, src_line_number);
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator) {
+  if (s_begin_failures > 0) {
+    s_begin_failures--;
+    return s_begin_failure;
+  }
+  // AppMessage's own rule: one message at a time
+  if (s_in_flight) {
+    return APP_MSG_BUSY;
+  }
+  memset(&s_dict, 0, sizeof(s_dict));
+  *iterator = &s_dict;
+  return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+  if (s_send_failures > 0) {
+    s_send_failures--;
+    return APP_MSG_BUSY;
+  }
+  if (s_sent_count < MAX_LOG) {
+    s_sent[s_sent_count] = s_dict;
+  }
+  s_sent_count++;
+  s_in_flight = true;
+  return APP_MSG_OK;
+}
+
+static DictionaryResult dict_write(DictionaryIterator *iter, uint32_t key, uint32_t value) {
+  if (iter->count == STUB_DICT_MAX_FIELDS) {
+    return DICT_NOT_ENOUGH_STORAGE;
+  }
+  iter->keys[iter->count] = key;
+  iter->values[iter->count] = value;
+  iter->count++;
+  return DICT_OK;
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value) {
+  return dict_write(iter, key, value);
+}
+
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key, const uint16_t value) {
+  return dict_write(iter, key, value);
+}
+
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value) {
+  return dict_write(iter, key, value);
+}
+
+static void ack(void) {
+  CHECK(s_in_flight);
+  s_in_flight = false;
+  outbox_sent_callback(&s_dict, NULL);
+}
+
+static void nack(AppMessageResult reason) {
+  CHECK(s_in_flight);
+  s_in_flight = false;
+  outbox_failed_callback(&s_dict, reason, NULL);
+}
+
+// The field the last message sent had for the key
+static uint32_t sent_value(uint32_t key) {
+  CHECK(s_sent_count > 0);
+  const DictionaryIterator *dict = &s_sent[s_sent_count - 1];
+  for (uint8_t i = 0; i < dict->count; i++) {
+    if (dict->keys[i] == key) {
+      return dict->values[i];
+    }
+  }
+  fprintf(stderr, "%s: the last message sent has no key %lu\n", s_test, (unsigned long)key);
+  exit(1);
+}
+
+// ---------------------- STUB TIMER ----------------------
+
+// The outbox keeps one retry timer at a time
+struct AppTimer {
+  AppTimerCallback callback;
+  void *data;
+};
+
+static AppTimer s_timer;
+static bool s_timer_active = false;
+static uint32_t s_timer_delays[MAX_LOG];
+static int s_timer_count = 0;
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data) {
+  CHECK(!s_timer_active);
+  s_timer = (AppTimer){ .callback = callback, .data = callback_data };
+  s_timer_active = true;
+  if (s_timer_count < MAX_LOG) {
+    s_timer_delays[s_timer_count] = timeout_ms;
+  }
+  s_timer_count++;
+  return &s_timer;
+}
+
+void app_timer_cancel(AppTimer *timer_handle) {
+  CHECK(timer_handle == &s_timer);
+  s_timer_active = false;
+}
+
+static void fire_timer(void) {
+  CHECK(s_timer_active);
+  s_timer_active = false;
+  s_timer.callback(s_timer.data);
+}
+
+static uint32_t last_delay(void) {
+  CHECK(s_timer_count > 0);
+  return s_timer_delays[s_timer_count - 1];
+}
+
+// ---------------------- STATE CALLBACK ----------------------
+
+static int s_notified[OUTBOX_SLOT_COUNT][OUTBOX_STATE_FAILED + 1];
+
+static void state_callback(OutboxSlot slot, OutboxState state) {
+  s_notified[slot][state]++;
+}
+
+// ---------------------- HELPERS ----------------------
+
+static void post(OutboxSlot slot, uint32_t key, uint32_t value) {
+  OutboxField fields[] = {
+    { .key = key, .value = value, .width = 1 },
+  };
+  outbox_post(slot, fields, ARRAY_LENGTH(fields));
+}
+
+static bool any_pending(void) {
+  for (int slot = 0; slot < OUTBOX_SLOT_COUNT; slot++) {
+    if (outbox_is_pending((OutboxSlot)slot)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The outbox keeps its state between tests, so each one has to leave it idle
+static void begin_test(const char *name) {
+  s_test = name;
+  s_sent_count = 0;
+  s_timer_count = 0;
+  s_begin_failures = 0;
+  s_begin_failure = APP_MSG_BUSY;
+  s_send_failures = 0;
+  memset(s_notified, 0, sizeof(s_notified));
+}
+
+static void end_test(void) {
+  CHECK(!any_pending());
+  CHECK(!s_in_flight);
+  CHECK(!s_timer_active);
+  printf("ok %s\n", s_test);
+}
+
+// ---------------------- TESTS ----------------------
+
+static void test_one_message_in_flight(void) {
+  begin_test("one_message_in_flight");
+  post(OUTBOX_SLOT_MUTE, KEY_MUTE, 1);
+  post(OUTBOX_SLOT_DEAFEN, KEY_DEAFEN, 1);
+  CHECK_EQ(s_sent_count, 1);
+  CHECK_EQ(sent_value(KEY_MUTE), 1);
+  CHECK(outbox_is_pending(OUTBOX_SLOT_MUTE));
+  CHECK(outbox_is_pending(OUTBOX_SLOT_DEAFEN));
+  CHECK_EQ(s_notified[OUTBOX_SLOT_MUTE][OUTBOX_STATE_PENDING], 1);
+
+  ack();
+  CHECK(!outbox_is_pending(OUTBOX_SLOT_MUTE));
+  CHECK_EQ(s_notified[OUTBOX_SLOT_MUTE][OUTBOX_STATE_SENT], 1);
+  CHECK_EQ(s_sent_count, 2);
+  CHECK_EQ(sent_value(KEY_DEAFEN), 1);
+
+  ack();
+  CHECK_EQ(s_notified[OUTBOX_SLOT_DEAFEN][OUTBOX_STATE_SENT], 1);
+  CHECK_EQ(s_timer_count, 0);
+  end_test();
+}
+
+// Presses made while the slot waits replace each other, only the last goes
+static void test_coalesces_per_slot(void) {
+  begin_test("coalesces_per_slot");
+  post(OUTBOX_SLOT_MUTE, KEY_MUTE, 1);
+  post(OUTBOX_SLOT_DEAFEN, KEY_DEAFEN, 1);
+  post(OUTBOX_SLOT_MUTE, KEY_MUTE, 0);
+  post(OUTBOX_SLOT_MUTE, KEY_MUTE, 1);
+  post(OUTBOX_SLOT_MUTE, KEY_MUTE, 0);
+  CHECK_EQ(s_sent_count, 1);
+
+  // The first mute is acked, but a newer one is still waiting
+  ack();
+  CHECK(outbox_is_pending(OUTBOX_SLOT_MUTE));
+  CHECK_EQ(s_notified[OUTBOX_SLOT_MUTE][OUTBOX_STATE_SENT], 0);
+  // Kept the place of the first post behind the one in flight
+  CHECK_EQ(sent_value(KEY_DEAFEN), 1);
+
+  ack();
+  CHECK_EQ(s_sent_count, 3);
+  CHECK_EQ(sent_value(KEY_MUTE), 0);
+
+  ack();
+  CHECK_EQ(s_notified[OUTBOX_SLOT_MUTE][OUTBOX_STATE_PENDING], 1);
+  CHECK_EQ(s_notified[OUTBOX_SLOT_MUTE][OUTBOX_STATE_SENT], 1);
+  end_test();
+}
+
+static void test_busy_backs_off(void) {
+  begin_test("busy_backs_off");
+  s_begin_failures = 3;
+  post(OUTBOX_SLOT_MUTE, KEY_MUTE, 1);
+  CHECK_EQ(s_sent_count, 0);
+  CHECK_EQ(last_delay(), 100);
+
+  // Nothing goes out before the timer, not even another slot
+  post(OUTBOX_SLOT_DEAFEN, KEY_DEAFEN, 1);
+  CHECK_EQ(s_sent_count, 0);
+
+  fire_timer();
+  CHECK_EQ(last_delay(), 200);
+  fire_timer();
+  CHECK_EQ(last_delay(), 400);
+  fire_timer();
+  CHECK_EQ(s_sent_count, 1);
+  CHECK_EQ(sent_value(KEY_MUTE), 1);
+
+  ack();
+  CHECK_EQ(sent_value(KEY_DEAFEN), 1);
+  ack();
+  end_test();
+}
+
+static void test_send_failure_backs_off(void) {
+  begin_test("send_failure_backs_off");
+  s_send_failures = 1;
+  post(OUTBOX_SLOT_PTT, KEY_PTT, 1);
+  CHECK_EQ(s_sent_count, 0);
+  CHECK_EQ(last_delay(), 100);
+
+  fire_timer();
+  CHECK_EQ(s_sent_count, 1);
+  CHECK_EQ(sent_value(KEY_PTT), 1);
+  ack();
+  end_test();
+}
+
+// A NACKed message goes before everything queued behind it
+static void test_nack_goes_to_front(void) {
+  begin_test("nack_goes_to_front");
+  post(OUTBOX_SLOT_MUTE, KEY_MUTE, 1);
+  post(OUTBOX_SLOT_DEAFEN, KEY_DEAFEN, 1);
+  post(OUTBOX_SLOT_PTT, KEY_PTT, 1);
+
+  nack(APP_MSG_SEND_REJECTED);
+  CHECK(outbox_is_pending(OUTBOX_SLOT_MUTE));
+  CHECK_EQ(s_notified[OUTBOX_SLOT_MUTE][OUTBOX_STATE_PENDING], 1);
+  CHECK_EQ(last_delay(), 100);
+  CHECK_EQ(s_sent_count, 1);
+
+  fire_timer();
+  CHECK_EQ(s_sent_count, 2);
+  CHECK_EQ(sent_value(KEY_MUTE), 1);
+  ack();
+  CHECK_EQ(sent_value(KEY_DEAFEN), 1);
+  ack();
+  CHECK_EQ(sent_value(KEY_PTT), 1);
+  ack();
+  CHECK_EQ(s_sent_count, 4);
+  end_test();
+}
+
+// A press made while the NACKed message was in flight is what gets retried,
+// without restarting the backoff
+static void test_nack_retries_newer_contents(void) {
+  begin_test("nack_retries_newer_contents");
+  post(OUTBOX_SLOT_MUTE, KEY_MUTE, 1);
+  post(OUTBOX_SLOT_DEAFEN, KEY_DEAFEN, 1);
+  nack(APP_MSG_SEND_TIMEOUT);
+  CHECK_EQ(last_delay(), 100);
+  fire_timer();
+  CHECK_EQ(sent_value(KEY_MUTE), 1);
+
+  // Pressed again during the second attempt
+  post(OUTBOX_SLOT_MUTE, KEY_MUTE, 0);
+  nack(APP_MSG_SEND_TIMEOUT);
+  CHECK_EQ(last_delay(), 200);
+  fire_timer();
+  CHECK_EQ(s_sent_count, 3);
+  CHECK_EQ(sent_value(KEY_MUTE), 0);
+
+  ack();
+  CHECK_EQ(sent_value(KEY_DEAFEN), 1);
+  ack();
+  CHECK_EQ(s_sent_count, 4);
+  CHECK_EQ(s_notified[OUTBOX_SLOT_MUTE][OUTBOX_STATE_SENT], 1);
+  end_test();
+}
+
+// A NACK storm: the retries double up to 3.2s, and after 8 attempts the
+// message is dropped and the next one goes out
+static void test_nack_storm_gives_up(void) {
+  begin_test("nack_storm_gives_up");
+  static const uint32_t delays[] = { 100, 200, 400, 800, 1600, 3200, 3200 };
+
+  post(OUTBOX_SLOT_PTT, KEY_PTT, 1);
+  post(OUTBOX_SLOT_DEAFEN, KEY_DEAFEN, 1);
+  for (size_t i = 0; i < ARRAY_LENGTH(delays); i++) {
+    nack(APP_MSG_SEND_REJECTED);
+    CHECK_EQ(last_delay(), delays[i]);
+    CHECK_EQ(s_notified[OUTBOX_SLOT_PTT][OUTBOX_STATE_FAILED], 0);
+    fire_timer();
+    CHECK_EQ(sent_value(KEY_PTT), 1);
+  }
+  CHECK_EQ(s_sent_count, 8);
+
+  nack(APP_MSG_SEND_REJECTED);
+  CHECK(!s_timer_active);
+  CHECK(!outbox_is_pending(OUTBOX_SLOT_PTT));
+  CHECK_EQ(s_notified[OUTBOX_SLOT_PTT][OUTBOX_STATE_FAILED], 1);
+  CHECK_EQ(s_notified[OUTBOX_SLOT_PTT][OUTBOX_STATE_SENT], 0);
+  CHECK_EQ(s_sent_count, 9);
+  CHECK_EQ(sent_value(KEY_DEAFEN), 1);
+  ack();
+
+  // The next post starts over
+  post(OUTBOX_SLOT_PTT, KEY_PTT, 0);
+  nack(APP_MSG_SEND_REJECTED);
+  CHECK_EQ(last_delay(), 100);
+  fire_timer();
+  ack();
+  CHECK_EQ(s_notified[OUTBOX_SLOT_PTT][OUTBOX_STATE_SENT], 1);
+  end_test();
+}
+
+// A BUSY storm with the phone never coming back gives up the same way
+static void test_busy_storm_gives_up(void) {
+  begin_test("busy_storm_gives_up");
+  s_begin_failures = 8;
+  s_begin_failure = APP_MSG_NOT_CONNECTED;
+  post(OUTBOX_SLOT_LEAVE, KEY_MUTE, 1);
+  for (int i = 0; i < 7; i++) {
+    fire_timer();
+  }
+  CHECK_EQ(s_timer_count, 7);
+  CHECK_EQ(last_delay(), 3200);
+  CHECK_EQ(s_sent_count, 0);
+  CHECK(!outbox_is_pending(OUTBOX_SLOT_LEAVE));
+  CHECK_EQ(s_notified[OUTBOX_SLOT_LEAVE][OUTBOX_STATE_FAILED], 1);
+  end_test();
+}
+
+static void test_deinit_cancels_retry(void) {
+  begin_test("deinit_cancels_retry");
+  s_begin_failures = 1;
+  post(OUTBOX_SLOT_VOLUME, KEY_MUTE, 1);
+  CHECK(s_timer_active);
+  outbox_deinit();
+  CHECK(!s_timer_active);
+
+  // Nothing else would send it here, so let it go out to leave the outbox idle
+  post(OUTBOX_SLOT_VOLUME, KEY_MUTE, 2);
+  CHECK_EQ(sent_value(KEY_MUTE), 2);
+  ack();
+  end_test();
+}
+
+int main(int argc, char **argv) {
+  s_verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+  register_outbox_state_callback(state_callback);
+
+  test_one_message_in_flight();
+  test_coalesces_per_slot();
+  test_busy_backs_off();
+  test_send_failure_backs_off();
+  test_nack_goes_to_front();
+  test_nack_retries_newer_contents();
+  test_nack_storm_gives_up();
+  test_busy_storm_gives_up();
+  test_deinit_cancels_retry();
+  return 0;
+}
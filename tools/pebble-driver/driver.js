@@ -0,0 +1,265 @@
+#!/usr/bin/env node
+// Runs the phone half of the watch app (pebble-app/src/pkjs/index.js) under
+// Node, without a phone or the Pebble SDK, for tests and benchmarks.
+//
+// The script gets a stubbed Pebble global, message_keys built from
+// package.json and a localStorage preset from the command line, and talks to
+// a real PebbleWSServer over a real WebSocket. The watch end is a line-based
+// JSON protocol:
+//
+//   stdin   {"type":"appmessage","payload":{"SET_MUTE":1}}  a message from the watch
+//           {"type":"nack","count":3}                      fail the next 3 sends to the watch
+//   stdout  {"type":"ready"}                               index.js got its "ready" event
+//           {"type":"send","t":12.5,"payload":{...}}       Pebble.sendAppMessage was called
+//
+// t is milliseconds since the driver started. Sends are acked after --ack-ms,
+// a stand-in for the Bluetooth round trip.
+//
+// usage: driver.js --host 127.0.0.1[,host2...] [--port 5983] [--ack-ms 0]
+//                  [--model pebble_time_steel] [--storage KEY=VALUE]... [--verbose]
+//                  [--unreachable host1[,host2...]]
+//
+// --unreachable hosts never answer, like the address of a network the laptop
+// has left: connecting to them hangs until index.js gives up.
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+const readline = require('readline');
+const vm = require('vm');
+const { spawn } = require('child_process');
+
+// Node 20 has WebSocket behind a flag, 22 and later by default
+if (typeof WebSocket === 'undefined') {
+    if (process.execArgv.indexOf('--experimental-websocket') !== -1) {
+        console.error('This Node has no WebSocket client, use Node 20.10 or later');
+        process.exit(2);
+    }
+    const child = spawn(process.execPath, ['--experimental-websocket', '--no-warnings', __filename]
+        .concat(process.argv.slice(2)), { stdio: 'inherit' });
+    child.on('exit', function(code, signal) {
+        process.exit(signal ? 1 : code);
+    });
+    ['SIGINT', 'SIGTERM'].forEach(function(signal) {
+        process.on(signal, function() {
+            child.kill(signal);
+        });
+    });
+    return;
+}
+
+const appDir = path.resolve(__dirname, '..', '..', 'pebble-app');
+const started = process.hrtime.bigint();
+
+function parseArgs(argv) {
+    const options = {
+        host: null, port: 5983, ackMs: 0, model: 'pebble_time_steel', storage: {}, verbose: false, unreachable: []
+    };
+    for (let i = 0; i < argv.length; i++) {
+        const value = argv[i + 1];
+        switch (argv[i]) {
+            case '--host': options.host = value; i++; break;
+            case '--port': options.port = Number(value); i++; break;
+            case '--ack-ms': options.ackMs = Number(value); i++; break;
+            case '--model': options.model = value; i++; break;
+            case '--storage': {
+                const split = value.indexOf('=');
+                options.storage[value.slice(0, split)] = value.slice(split + 1);
+                i++;
+                break;
+            }
+            case '--verbose': options.verbose = true; break;
+            case '--unreachable': options.unreachable = value.split(','); i++; break;
+            default:
+                console.error('Unknown option ' + argv[i]);
+                process.exit(2);
+        }
+    }
+    return options;
+}
+
+const options = parseArgs(process.argv.slice(2));
+
+function now() {
+    return Number(process.hrtime.bigint() - started) / 1e6;
+}
+
+function emit(message) {
+    process.stdout.write(JSON.stringify(message) + '\n');
+}
+
+// The SDK numbers message keys in package.json order, starting at 10000
+function messageKeys() {
+    const names = JSON.parse(fs.readFileSync(path.join(appDir, 'package.json'), 'utf8')).pebble.messageKeys;
+    const keys = {};
+    names.forEach(function(name, index) {
+        keys[name] = 10000 + index;
+    });
+    return keys;
+}
+
+function createStorage(initial) {
+    const items = Object.assign({}, initial);
+    return {
+        getItem: function(key) {
+            return Object.prototype.hasOwnProperty.call(items, key) ? items[key] : null;
+        },
+        setItem: function(key, value) {
+            items[key] = String(value);
+        },
+        removeItem: function(key) {
+            delete items[key];
+        },
+        clear: function() {
+            Object.keys(items).forEach(function(key) {
+                delete items[key];
+            });
+        }
+    };
+}
+
+function createPebble() {
+    const listeners = {};
+    let nacks = 0;
+    return {
+        nack: function(count) {
+            nacks += count;
+        },
+        dispatch: function(type, event) {
+            (listeners[type] || []).forEach(function(listener) {
+                listener(event);
+            });
+        },
+        api: {
+            addEventListener: function(type, listener) {
+                (listeners[type] = listeners[type] || []).push(listener);
+            },
+            removeEventListener: function(type, listener) {
+                listeners[type] = (listeners[type] || []).filter(function(other) {
+                    return other !== listener;
+                });
+            },
+            getActiveWatchInfo: function() {
+                return { model: options.model, platform: 'basalt', language: 'en_US', firmware: { major: 4, minor: 3 } };
+            },
+            sendAppMessage: function(payload, onSuccess, onFailure) {
+                emit({ type: 'send', t: now(), payload: payload });
+                const failed = nacks > 0;
+                if (failed) {
+                    nacks--;
+                }
+                setTimeout(function() {
+                    if (failed) {
+                        if (onFailure) {
+                            onFailure({ data: { transactionId: 0 }, error: { message: 'NACK' } });
+                        }
+                    } else if (onSuccess) {
+                        onSuccess({ data: { transactionId: 0 } });
+                    }
+                }, options.ackMs);
+            },
+            openURL: function() {},
+            showSimpleNotificationOnPebble: function() {}
+        }
+    };
+}
+
+// A connection attempt that never gets an answer. Closing it fails it the
+// way a browser does, with a 1006 close.
+function HangingSocket(url) {
+    this.url = url;
+    this.readyState = WebSocket.CONNECTING;
+    this.onopen = this.onclose = this.onerror = this.onmessage = null;
+}
+HangingSocket.prototype.send = function() {
+    throw new Error('WebSocket is not open');
+};
+HangingSocket.prototype.close = function() {
+    if (this.readyState === WebSocket.CLOSED) {
+        return;
+    }
+    this.readyState = WebSocket.CLOSED;
+    const socket = this;
+    setImmediate(function() {
+        if (socket.onclose) {
+            socket.onclose({ code: 1006, reason: '', wasClean: false });
+        }
+    });
+};
+
+function AppWebSocket(url, protocols) {
+    if (options.unreachable.indexOf(new URL(url).hostname) !== -1) {
+        return new HangingSocket(url);
+    }
+    return new WebSocket(url, protocols);
+}
+['CONNECTING', 'OPEN', 'CLOSING', 'CLOSED'].forEach(function(state) {
+    AppWebSocket[state] = WebSocket[state];
+});
+
+// Clay only matters for the settings page, which the driver replaces with --host
+function Clay() {}
+Clay.prototype.generateUrl = function() {
+    return 'about:blank';
+};
+Clay.prototype.getSettings = function() {
+    return {};
+};
+
+function loadApp(pebble, storage) {
+    const source = fs.readFileSync(path.join(appDir, 'src', 'pkjs', 'index.js'), 'utf8');
+    const modules = {
+        'message_keys': messageKeys(),
+        'pebble-clay': Clay,
+        './config.json': JSON.parse(fs.readFileSync(path.join(appDir, 'src', 'pkjs', 'config.json'), 'utf8'))
+    };
+    const appRequire = function(name) {
+        if (!Object.prototype.hasOwnProperty.call(modules, name)) {
+            throw new Error('index.js requires ' + name + ', which the driver does not provide');
+        }
+        return modules[name];
+    };
+    const appConsole = {
+        log: options.verbose ? console.error.bind(console) : function() {}
+    };
+    appConsole.error = appConsole.warn = appConsole.info = appConsole.log;
+
+    const wrapper = vm.runInThisContext(
+        '(function (require, Pebble, localStorage, console, WebSocket) {' + source + '\n})',
+        { filename: path.join(appDir, 'src', 'pkjs', 'index.js') });
+    wrapper(appRequire, pebble.api, storage, appConsole, AppWebSocket);
+}
+
+const storage = createStorage(options.storage);
+if (options.host) {
+    storage.setItem('WS_HOST', options.host);
+    storage.setItem('WS_PORT', String(options.port));
+}
+
+const pebble = createPebble();
+loadApp(pebble, storage);
+
+readline.createInterface({ input: process.stdin }).on('line', function(line) {
+    if (!line.trim()) {
+        return;
+    }
+    const message = JSON.parse(line);
+    switch (message.type) {
+        case 'appmessage':
+            pebble.dispatch('appmessage', { payload: message.payload });
+            break;
+        case 'nack':
+            pebble.nack(message.count);
+            break;
+        default:
+            console.error('Unknown driver message ' + message.type);
+            break;
+    }
+}).on('close', function() {
+    // The harness went away, so does the phone
+    pebble.dispatch('unload', {});
+    process.exit(0);
+});
+
+pebble.dispatch('ready', {});
+emit({ type: 'ready' });